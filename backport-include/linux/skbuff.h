@@ -183,6 +183,12 @@ skb_set_hash(struct sk_buff *skb, __u32 hash, enum pkt_hash_types type)
 	skb->rxhash = hash;
 #endif
 }
+
+#define skb_get_hash LINUX_BACKPORT(skb_get_hash)
+static inline __u32 skb_get_hash(struct sk_buff *skb)
+{
+	return skb_get_rxhash(skb);
+}
 #endif /* LINUX_VERSION_CODE < KERNEL_VERSION(3,14,0) */
 
 #if LINUX_VERSION_CODE < KERNEL_VERSION(3,16,0)
@@ -112,12 +112,10 @@ static inline void hci_uart_tx_complete(struct hci_uart *hu, int pkt_type)
 
 static inline struct sk_buff *hci_uart_dequeue(struct hci_uart *hu)
 {
-	struct sk_buff *skb = hu->tx_skb;
+	struct sk_buff *skb = __skb_dequeue(&hu->tx_q);
 
 	if (!skb)
 		skb = hu->proto->dequeue(hu);
-	else
-		hu->tx_skb = NULL;
 
 	return skb;
 }
@@ -136,11 +134,69 @@ int hci_uart_tx_wakeup(struct hci_uart *hu)
 	return 0;
 }
 
+/* Write skb together with as many of the following frames as fit into
+ * the tty write room, so a burst of small packets costs a single write.
+ * A frame that goes out on its own is written straight from the skb.
+ *
+ * Frames are only completed once the tty has taken all of their bytes.
+ * Returns false if the tty came up short, in which case the remainder is
+ * left at the head of tx_q for the next write wakeup.
+ */
+static bool hci_uart_write_batch(struct hci_uart *hu, struct sk_buff *skb)
+{
+	struct tty_struct *tty = hu->tty;
+	struct hci_dev *hdev = hu->hdev;
+	struct sk_buff_head batch;
+	const u8 *data = skb->data;
+	int room, fill = skb->len;
+	int len;
+
+	room = min_t(int, tty_write_room(tty), HCI_UART_TX_BUF_SIZE);
+
+	__skb_queue_head_init(&batch);
+	__skb_queue_tail(&batch, skb);
+
+	while (fill < room && (skb = hci_uart_dequeue(hu))) {
+		if (fill + skb->len > room) {
+			__skb_queue_head(&hu->tx_q, skb);
+			break;
+		}
+
+		if (data != hu->tx_buf) {
+			memcpy(hu->tx_buf, data, fill);
+			data = hu->tx_buf;
+		}
+
+		memcpy(hu->tx_buf + fill, skb->data, skb->len);
+		fill += skb->len;
+		__skb_queue_tail(&batch, skb);
+	}
+
+	len = tty->ops->write(tty, data, fill);
+	if (len < 0)
+		len = 0;
+	hdev->stat.byte_tx += len;
+
+	while ((skb = skb_peek(&batch))) {
+		if (len < skb->len) {
+			skb_pull(skb, len);
+			skb_queue_splice_init(&batch, &hu->tx_q);
+			return false;
+		}
+
+		len -= skb->len;
+		__skb_unlink(skb, &batch);
+		hci_uart_tx_complete(hu, bt_cb(skb)->pkt_type);
+		kfree_skb(skb);
+	}
+
+	return true;
+}
+
 static void hci_uart_write_work(struct work_struct *work)
 {
 	struct hci_uart *hu = container_of(work, struct hci_uart, write_work);
 	struct tty_struct *tty = hu->tty;
-	struct hci_dev *hdev = hu->hdev;
 	struct sk_buff *skb;
 
 	/* REVISIT: should we cope with bad skbs or ->write() returning
@@ -151,20 +207,9 @@ restart:
 	clear_bit(HCI_UART_TX_WAKEUP, &hu->tx_state);
 
 	while ((skb = hci_uart_dequeue(hu))) {
-		int len;
-
 		set_bit(TTY_DO_WRITE_WAKEUP, &tty->flags);
-		len = tty->ops->write(tty, skb->data, skb->len);
-		hdev->stat.byte_tx += len;
-
-		skb_pull(skb, len);
-		if (skb->len) {
-			hu->tx_skb = skb;
+		if (!hci_uart_write_batch(hu, skb))
 			break;
-		}
-
-		hci_uart_tx_complete(hu, bt_cb(skb)->pkt_type);
-		kfree_skb(skb);
 	}
 
 	if (test_bit(HCI_UART_TX_WAKEUP, &hu->tx_state))
@@ -220,9 +265,7 @@ static int hci_uart_flush(struct hci_dev *hdev)
 
 	BT_DBG("hdev %p tty %p", hdev, tty);
 
-	if (hu->tx_skb) {
-		kfree_skb(hu->tx_skb); hu->tx_skb = NULL;
-	}
+	skb_queue_purge(&hu->tx_q);
 
 	/* Flush any pending characters in the driver and discipline. */
 	tty_ldisc_flush(tty);
@@ -475,6 +518,8 @@ static int hci_uart_tty_open(struct tty_struct *tty)
 	hu->tty = tty;
 	tty->receive_room = 65536;
 
+	skb_queue_head_init(&hu->tx_q);
+
 	INIT_WORK(&hu->init_ready, hci_uart_init_work);
 	INIT_WORK(&hu->write_work, hci_uart_write_work);
 
@@ -523,6 +568,7 @@ static void hci_uart_tty_close(struct tty_struct *tty)
 		hu->proto->close(hu);
 	}
 
+	skb_queue_purge(&hu->tx_q);
 	kfree(hu);
 }
 
@@ -54,6 +54,9 @@
 #define HCI_UART_EXT_CONFIG	4
 #define HCI_UART_VND_DETECT	5
 
+/* Small frames are coalesced into a single tty write of up to this size */
+#define HCI_UART_TX_BUF_SIZE	1024
+
 struct hci_uart;
 
 struct hci_uart_proto {
@@ -84,8 +87,9 @@ struct hci_uart {
 	const struct hci_uart_proto *proto;
 	void			*priv;
 
-	struct sk_buff		*tx_skb;
+	struct sk_buff_head	tx_q;
 	unsigned long		tx_state;
+	u8			tx_buf[HCI_UART_TX_BUF_SIZE];
 
 	unsigned int init_speed;
 	unsigned int oper_speed;
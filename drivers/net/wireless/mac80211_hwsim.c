@@ -27,8 +27,14 @@
 #include <linux/etherdevice.h>
 #include <linux/platform_device.h>
 #include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include <linux/module.h>
 #include <linux/ktime.h>
+#include <linux/hashtable.h>
+#include <linux/random.h>
+#include <linux/smp.h>
+#include <linux/cpu.h>
+#include <linux/netdevice.h>
 #include <net/genetlink.h>
 #include "mac80211_hwsim.h"
 
@@ -61,6 +67,18 @@ static bool support_p2p_device = true;
 module_param(support_p2p_device, bool, 0444);
 MODULE_PARM_DESC(support_p2p_device, "Support P2P-Device interface type");
 
+static bool links_only = false;
+module_param(links_only, bool, 0644);
+MODULE_PARM_DESC(links_only, "Only deliver frames over configured links");
+
+static bool airtime_medium = false;
+module_param(airtime_medium, bool, 0444);
+MODULE_PARM_DESC(airtime_medium, "Simulate airtime and contention on each channel");
+
+static bool rx_percpu = false;
+module_param(rx_percpu, bool, 0444);
+MODULE_PARM_DESC(rx_percpu, "Poll RX per radio on a home CPU, NAPI style");
+
 /**
  * enum hwsim_regtest - the type of regulatory tests we offer
  *
@@ -204,6 +222,10 @@ static inline void hwsim_clear_magic(struct ieee80211_vif *vif)
 
 struct hwsim_sta_priv {
 	u32 magic;
+	/* in power save, its TX queues are only served on release */
+	bool asleep;
+	/* airtime of the data frames pulled from its TX queues, in usecs */
+	u64 tx_airtime;
 };
 
 #define HWSIM_STA_MAGIC	0x6d537749
@@ -228,6 +250,8 @@ static inline void hwsim_clear_sta_magic(struct ieee80211_sta *sta)
 
 struct hwsim_chanctx_priv {
 	u32 magic;
+	/* channel the radio listens on for this context */
+	struct ieee80211_channel *chan;
 };
 
 #define HWSIM_CHANCTX_MAGIC 0x6d53774a
@@ -469,12 +493,87 @@ static spinlock_t hwsim_radio_lock;
 static struct list_head hwsim_radios;
 static int hwsim_radio_idx;
 
+/*
+ * Receiver index: the radios listening on each frequency, so that a
+ * transmitted frame only visits its potential receivers. Looked up under
+ * RCU, updated under hwsim_rx_index_lock.
+ */
+#define HWSIM_RX_INDEX_BITS	6
+
+static DEFINE_HASHTABLE(hwsim_rx_index, HWSIM_RX_INDEX_BITS);
+static DEFINE_SPINLOCK(hwsim_rx_index_lock);
+
+struct hwsim_rx_entry {
+	struct hlist_node node;		/* in hwsim_rx_index */
+	struct list_head list;		/* in the radio's rx_entries */
+	struct mac80211_hwsim_data *data;
+	u32 freq;
+	int refs;
+	struct rcu_head rcu_head;
+};
+
+/*
+ * Channels of the airtime medium, created on first use. A channel is
+ * busy while a frame exchange is on air; frames queued in the meantime
+ * contend for it with a random backoff once it has been idle for DIFS,
+ * and frames picking the same backoff slot collide.
+ */
+static DEFINE_SPINLOCK(hwsim_medium_lock);
+static LIST_HEAD(hwsim_mediums);
+static u32 hwsim_medium_round;
+
+struct hwsim_medium {
+	struct list_head list;
+	u32 freq;
+	enum ieee80211_band band;
+	ktime_t busy_until;
+	struct list_head queue;		/* frames contending for the channel */
+	struct list_head in_flight;	/* frames on air until busy_until */
+	struct tasklet_hrtimer timer;
+};
+
+struct hwsim_air_frame {
+	struct list_head list;
+	struct mac80211_hwsim_data *data;
+	struct sk_buff *skb;
+	struct ieee80211_channel *chan;
+	u8 tries[IEEE80211_TX_MAX_RATES];
+	u8 collisions;
+	u16 cw, slot;
+	u32 round;
+	bool ack, report;
+};
+
+#define HWSIM_SLOT_US		9
+#define HWSIM_CW_MIN		15
+#define HWSIM_CW_MAX		1023
+#define HWSIM_AMPDU_MAX_LEN	65535
+#define HWSIM_AMPDU_MAX_SUBFRAMES	32
+
 static struct platform_driver mac80211_hwsim_driver = {
 	.driver = {
 		.name = "mac80211_hwsim",
 	},
 };
 
+/*
+ * A directed link from one radio to another, used by the in-kernel
+ * medium when no wmediumd is registered. Links are hashed by receiver
+ * in the transmitting radio, looked up under RCU and changed under
+ * hwsim_radio_lock.
+ */
+struct hwsim_link {
+	struct hlist_node node;
+	struct rcu_head rcu_head;
+	u32 rx_idx;
+	bool has_signal;
+	s32 signal;
+	u32 delay_us;
+	u16 per[HWSIM_LINK_MAX_RATES];
+};
+
+#define HWSIM_LINK_HASH_BITS	6
+
 struct mac80211_hwsim_data {
 	struct list_head list;
 	struct ieee80211_hw *hw;
@@ -515,6 +614,26 @@ struct mac80211_hwsim_data {
 	struct dentry *debugfs;
 
 	struct sk_buff_head pending;	/* packets pending */
+
+	/* receiver index entries, one per frequency listened on */
+	struct list_head rx_entries;
+
+	/* rx_percpu: frames wait in rx_queue for the radio's NAPI poll */
+	struct sk_buff_head rx_queue;
+	struct net_device napi_dev;
+	struct napi_struct rx_napi;
+	struct call_single_data rx_csd;
+	unsigned long rx_state;
+	int rx_cpu;
+
+	/* pulls data frames from the mac80211 TX queues */
+	struct tasklet_struct tx_tasklet;
+
+	/* links to other radios, keyed by the receiver's radio index */
+	DECLARE_HASHTABLE(links, HWSIM_LINK_HASH_BITS);
+	/* received frames held back by a link delay, in delivery order */
+	struct sk_buff_head rx_delayed;
+	struct tasklet_hrtimer rx_delay_timer;
 	/*
 	 * Only radios in the same group can communicate together (the
 	 * channel has to match too). Each bit represents a group. A
@@ -530,6 +649,9 @@ struct mac80211_hwsim_data {
 	/* absolute beacon transmission time. Used to cover up "tx" delay. */
 	u64 abs_bcn_ts;
 
+	/* last contention round of the airtime medium this radio was in */
+	u32 medium_round;
+
 	/* Stats */
 	u64 tx_pkts;
 	u64 rx_pkts;
@@ -537,6 +659,9 @@ struct mac80211_hwsim_data {
 	u64 rx_bytes;
 	u64 tx_dropped;
 	u64 tx_failed;
+
+	/* result of the last medium benchmark run, in frames/s */
+	u64 bench_fps;
 };
 
 
@@ -598,6 +723,10 @@ static const struct nla_policy hwsim_genl_policy[HWSIM_ATTR_MAX + 1] = {
 	[HWSIM_ATTR_RADIO_NAME] = { .type = NLA_STRING },
 	[HWSIM_ATTR_NO_VIF] = { .type = NLA_FLAG },
 	[HWSIM_ATTR_FREQ] = { .type = NLA_U32 },
+	[HWSIM_ATTR_LINK_RX_RADIO_ID] = { .type = NLA_U32 },
+	[HWSIM_ATTR_LINK_PER] = { .type = NLA_BINARY,
+				  .len = HWSIM_LINK_MAX_RATES * sizeof(u16) },
+	[HWSIM_ATTR_LINK_DELAY] = { .type = NLA_U32 },
 };
 
 static void mac80211_hwsim_tx_frame(struct ieee80211_hw *hw,
@@ -1039,33 +1168,105 @@ err_free_txskb:
 	data->tx_failed++;
 }
 
-static bool hwsim_chans_compat(struct ieee80211_channel *c1,
-			       struct ieee80211_channel *c2)
+static struct hwsim_rx_entry *
+hwsim_rx_entry_find(struct mac80211_hwsim_data *data, u32 freq)
 {
-	if (!c1 || !c2)
-		return false;
+	struct hwsim_rx_entry *entry;
+
+	list_for_each_entry(entry, &data->rx_entries, list)
+		if (entry->freq == freq)
+			return entry;
 
-	return c1->center_freq == c2->center_freq;
+	return NULL;
 }
 
-struct tx_iter_data {
-	struct ieee80211_channel *channel;
-	bool receive;
-};
+/*
+ * Start receiving on a channel. A radio can listen on the same frequency
+ * for several reasons (operating channel, scan or ROC, channel contexts),
+ * it only appears once in the receiver index.
+ */
+static int hwsim_rx_listen(struct mac80211_hwsim_data *data,
+			   struct ieee80211_channel *chan)
+{
+	struct hwsim_rx_entry *entry, *new_entry;
 
-static void mac80211_hwsim_tx_iter(void *_data, u8 *addr,
-				   struct ieee80211_vif *vif)
+	if (!chan)
+		return 0;
+
+	new_entry = kzalloc(sizeof(*new_entry), GFP_KERNEL);
+	if (!new_entry)
+		return -ENOMEM;
+
+	spin_lock_bh(&hwsim_rx_index_lock);
+	entry = hwsim_rx_entry_find(data, chan->center_freq);
+	if (entry) {
+		entry->refs++;
+		goto out;
+	}
+
+	entry = new_entry;
+	new_entry = NULL;
+	entry->data = data;
+	entry->freq = chan->center_freq;
+	entry->refs = 1;
+	list_add(&entry->list, &data->rx_entries);
+	hash_add_rcu(hwsim_rx_index, &entry->node, entry->freq);
+out:
+	spin_unlock_bh(&hwsim_rx_index_lock);
+	kfree(new_entry);
+
+	return 0;
+}
+
+static void hwsim_rx_unlisten(struct mac80211_hwsim_data *data,
+			      struct ieee80211_channel *chan)
 {
-	struct tx_iter_data *data = _data;
+	struct hwsim_rx_entry *entry;
 
-	if (!vif->chanctx_conf)
+	if (!chan)
 		return;
 
-	if (!hwsim_chans_compat(data->channel,
-				rcu_dereference(vif->chanctx_conf)->def.chan))
-		return;
+	spin_lock_bh(&hwsim_rx_index_lock);
+	entry = hwsim_rx_entry_find(data, chan->center_freq);
+	if (entry && !--entry->refs) {
+		hash_del_rcu(&entry->node);
+		list_del(&entry->list);
+		kfree_rcu(entry, rcu_head);
+	}
+	spin_unlock_bh(&hwsim_rx_index_lock);
+}
+
+static void hwsim_rx_unlisten_all(struct mac80211_hwsim_data *data)
+{
+	struct hwsim_rx_entry *entry, *tmp;
+
+	spin_lock_bh(&hwsim_rx_index_lock);
+	list_for_each_entry_safe(entry, tmp, &data->rx_entries, list) {
+		hash_del_rcu(&entry->node);
+		list_del(&entry->list);
+		kfree_rcu(entry, rcu_head);
+	}
+	spin_unlock_bh(&hwsim_rx_index_lock);
+}
+
+/* Move a listener to a new channel, or keep the old one on failure */
+static int hwsim_rx_switch(struct mac80211_hwsim_data *data,
+			   struct ieee80211_channel **chan,
+			   struct ieee80211_channel *new_chan)
+{
+	int err;
+
+	if (*chan == new_chan)
+		return 0;
+
+	err = hwsim_rx_listen(data, new_chan);
+	if (err)
+		return err;
 
-	data->receive = true;
+	hwsim_rx_unlisten(data, *chan);
+	*chan = new_chan;
+
+	return 0;
 }
 
 static void mac80211_hwsim_add_vendor_rtap(struct sk_buff *skb)
@@ -1115,130 +1316,989 @@ static void mac80211_hwsim_add_vendor_rtap(struct sk_buff *skb)
 #endif
 }
 
-static bool mac80211_hwsim_tx_frame_no_nl(struct ieee80211_hw *hw,
-					  struct sk_buff *skb,
-					  struct ieee80211_channel *chan)
+static void hwsim_rx_status_set_rate(struct ieee80211_rx_status *rx_status,
+				     struct ieee80211_tx_rate *rate)
+{
+	rx_status->flag &= ~(RX_FLAG_VHT | RX_FLAG_HT |
+			     RX_FLAG_40MHZ | RX_FLAG_SHORT_GI);
+	rx_status->vht_nss = 0;
+
+	if (rate->flags & IEEE80211_TX_RC_VHT_MCS) {
+		rx_status->rate_idx = ieee80211_rate_get_vht_mcs(rate);
+		rx_status->vht_nss = ieee80211_rate_get_vht_nss(rate);
+		rx_status->flag |= RX_FLAG_VHT;
+	} else {
+		rx_status->rate_idx = rate->idx;
+		if (rate->flags & IEEE80211_TX_RC_MCS)
+			rx_status->flag |= RX_FLAG_HT;
+	}
+	if (rate->flags & IEEE80211_TX_RC_40_MHZ_WIDTH)
+		rx_status->flag |= RX_FLAG_40MHZ;
+	if (rate->flags & IEEE80211_TX_RC_SHORT_GI)
+		rx_status->flag |= RX_FLAG_SHORT_GI;
+}
+
+static struct hwsim_link *hwsim_link_find(struct mac80211_hwsim_data *data,
+					  u32 rx_idx)
+{
+	struct hwsim_link *link;
+
+	hash_for_each_possible_rcu(data->links, link, node, rx_idx)
+		if (link->rx_idx == rx_idx)
+			return link;
+
+	return NULL;
+}
+
+static void hwsim_link_flush(struct mac80211_hwsim_data *data)
+{
+	struct hwsim_link *link;
+	struct hlist_node *tmp;
+	int bkt;
+
+	hash_for_each_safe(data->links, bkt, tmp, link, node) {
+		hash_del_rcu(&link->node);
+		kfree_rcu(link, rcu_head);
+	}
+}
+
+static bool hwsim_link_lost(struct hwsim_link *link,
+			    struct ieee80211_tx_rate *rate)
+{
+	int idx = rate->idx;
+
+	if (rate->flags & IEEE80211_TX_RC_VHT_MCS)
+		idx = ieee80211_rate_get_vht_mcs(rate);
+	idx = clamp(idx, 0, HWSIM_LINK_MAX_RATES - 1);
+
+	return prandom_u32_max(HWSIM_LINK_PER_SCALE) < link->per[idx];
+}
+
+/*
+ * Walk the retry chain of a frame over a lossy link. Returns the index
+ * of the rate the frame got through with, or -1 if every attempt was
+ * lost; @tries is filled with the attempts made at each rate.
+ */
+static int hwsim_link_tx_attempts(struct hwsim_link *link,
+				  struct ieee80211_tx_info *info, u8 *tries)
+{
+	int i, n;
+
+	for (i = 0; i < IEEE80211_TX_MAX_RATES; i++) {
+		struct ieee80211_tx_rate *rate = &info->control.rates[i];
+
+		if (rate->idx < 0 || !rate->count)
+			break;
+
+		for (n = 1; n <= rate->count; n++) {
+			if (!hwsim_link_lost(link, rate)) {
+				tries[i] = n;
+				return i;
+			}
+		}
+		tries[i] = rate->count;
+	}
+
+	return -1;
+}
+
+static void mac80211_hwsim_rx_delayed_add(struct mac80211_hwsim_data *data,
+					  struct sk_buff *skb, u32 delay_us)
+{
+	struct sk_buff *prev;
+	unsigned long flags;
+	ktime_t when = ktime_add_us(ktime_get(), delay_us);
+	bool first;
+
+	skb->tstamp = when;
+
+	spin_lock_irqsave(&data->rx_delayed.lock, flags);
+	skb_queue_reverse_walk(&data->rx_delayed, prev)
+		if (ktime_compare(prev->tstamp, when) <= 0)
+			break;
+	__skb_queue_after(&data->rx_delayed, prev, skb);
+	first = skb_peek(&data->rx_delayed) == skb;
+	spin_unlock_irqrestore(&data->rx_delayed.lock, flags);
+
+	if (first)
+		tasklet_hrtimer_start(&data->rx_delay_timer, when,
+				      HRTIMER_MODE_ABS);
+}
+
+static enum hrtimer_restart
+mac80211_hwsim_rx_delayed(struct hrtimer *timer)
+{
+	struct mac80211_hwsim_data *data =
+		container_of(timer, struct mac80211_hwsim_data,
+			     rx_delay_timer.timer);
+	struct sk_buff_head due;
+	struct sk_buff *skb;
+	unsigned long flags;
+	ktime_t now = ktime_get();
+
+	__skb_queue_head_init(&due);
+
+	spin_lock_irqsave(&data->rx_delayed.lock, flags);
+	while ((skb = skb_peek(&data->rx_delayed)) &&
+	       ktime_compare(skb->tstamp, now) <= 0) {
+		__skb_unlink(skb, &data->rx_delayed);
+		__skb_queue_tail(&due, skb);
+	}
+	if (skb)
+		tasklet_hrtimer_start(&data->rx_delay_timer, skb->tstamp,
+				      HRTIMER_MODE_ABS);
+	spin_unlock_irqrestore(&data->rx_delayed.lock, flags);
+
+	while ((skb = __skb_dequeue(&due))) {
+		skb->tstamp = ktime_set(0, 0);
+		if (data->started)
+			mac80211_hwsim_rx(data, skb);
+		else
+			dev_kfree_skb(skb);
+	}
+
+	return HRTIMER_NORESTART;
+}
+
+enum hwsim_rx_state {
+	HWSIM_RX_SCHED,		/* poll scheduled or running */
+	HWSIM_RX_KICK,		/* IPI to the home CPU in flight */
+};
+
+static void mac80211_hwsim_rx_kick(void *info)
+{
+	struct mac80211_hwsim_data *data = info;
+
+	napi_schedule(&data->rx_napi);
+	clear_bit_unlock(HWSIM_RX_KICK, &data->rx_state);
+}
+
+/*
+ * Hand a received frame to the radio. With rx_percpu the frame is queued
+ * and the radio's home CPU is kicked to poll it, like a device interrupt
+ * scheduling NAPI; otherwise it goes to mac80211 on the current CPU.
+ */
+static void mac80211_hwsim_rx(struct mac80211_hwsim_data *data,
+			      struct sk_buff *skb)
+{
+	if (!rx_percpu) {
+		ieee80211_rx_irqsafe(data->hw, skb);
+		return;
+	}
+
+	skb_queue_tail(&data->rx_queue, skb);
+	if (test_and_set_bit(HWSIM_RX_SCHED, &data->rx_state))
+		return;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,15,0)
+	set_bit(HWSIM_RX_KICK, &data->rx_state);
+	if (!smp_call_function_single_async(data->rx_cpu, &data->rx_csd))
+		return;
+	clear_bit(HWSIM_RX_KICK, &data->rx_state);
+#endif
+
+	/* home CPU not reachable, poll here */
+	local_bh_disable();
+	napi_schedule(&data->rx_napi);
+	local_bh_enable();
+}
+
+static int mac80211_hwsim_rx_poll(struct napi_struct *napi, int budget)
+{
+	struct mac80211_hwsim_data *data =
+		container_of(napi, struct mac80211_hwsim_data, rx_napi);
+	struct sk_buff *skb;
+	int done = 0;
+
+	while (done < budget && (skb = skb_dequeue(&data->rx_queue))) {
+		ieee80211_rx_napi(data->hw, skb, napi);
+		done++;
+	}
+
+	if (done < budget) {
+		napi_complete(napi);
+		clear_bit(HWSIM_RX_SCHED, &data->rx_state);
+		smp_mb__after_atomic();
+		if (!skb_queue_empty(&data->rx_queue) &&
+		    !test_and_set_bit(HWSIM_RX_SCHED, &data->rx_state))
+			napi_schedule(napi);
+	}
+
+	return done;
+}
+
+static int hwsim_rx_home_cpu(int idx)
+{
+	int cpu = cpumask_first(cpu_online_mask);
+	int n = idx % num_online_cpus();
+
+	while (n--)
+		cpu = cpumask_next(cpu, cpu_online_mask);
+
+	return cpu < nr_cpu_ids ? cpu : cpumask_first(cpu_online_mask);
+}
+
+/* timing of a PPDU on the airtime medium */
+struct hwsim_air_tx {
+	struct ieee80211_hw *hw;
+	enum ieee80211_band band;
+	u32 len;		/* bytes carried, A-MPDU delimiters included */
+	u32 start_us;		/* from now until the PPDU starts */
+	u32 sifs_us;
+	u32 ack_us;		/* ACK or BlockAck duration */
+};
+
+static const u8 hwsim_first_try[IEEE80211_TX_MAX_RATES] = { 1 };
+
+/* data bits per OFDM symbol for one spatial stream at 20/40/80 MHz */
+static const u16 hwsim_mcs_dbps[3][10] = {
+	{ 26, 52, 78, 104, 156, 208, 234, 260, 312, 347 },
+	{ 54, 108, 162, 216, 324, 432, 486, 540, 648, 720 },
+	{ 117, 234, 351, 468, 702, 936, 1053, 1170, 1404, 1560 },
+};
+
+static u32 hwsim_ofdm_symbols(u32 len, u32 dbps)
+{
+	/* service field, payload and tail bits */
+	return DIV_ROUND_UP(16 + 8 * len + 6, dbps);
+}
+
+static u32 hwsim_ppdu_airtime(struct hwsim_air_tx *air,
+			      struct ieee80211_tx_rate *rate)
+{
+	struct ieee80211_supported_band *sband;
+	int mcs, nss, bw = 0;
+	u32 dbps, bitrate, sym;
+
+	if (rate->flags & (IEEE80211_TX_RC_MCS | IEEE80211_TX_RC_VHT_MCS)) {
+		if (rate->flags & IEEE80211_TX_RC_VHT_MCS) {
+			mcs = ieee80211_rate_get_vht_mcs(rate);
+			nss = ieee80211_rate_get_vht_nss(rate);
+		} else {
+			mcs = rate->idx % 8;
+			nss = rate->idx / 8 + 1;
+		}
+		mcs = min(mcs, 9);
+
+		if (rate->flags & IEEE80211_TX_RC_40_MHZ_WIDTH)
+			bw = 1;
+		else if (rate->flags & (IEEE80211_TX_RC_80_MHZ_WIDTH |
+					IEEE80211_TX_RC_160_MHZ_WIDTH))
+			bw = 2;
+		dbps = hwsim_mcs_dbps[bw][mcs] * nss;
+		if (rate->flags & IEEE80211_TX_RC_160_MHZ_WIDTH)
+			dbps *= 2;
+
+		sym = hwsim_ofdm_symbols(air->len, dbps);
+		if (rate->flags & IEEE80211_TX_RC_SHORT_GI)
+			sym = DIV_ROUND_UP(sym * 36, 10);
+		else
+			sym *= 4;
+
+		/* legacy and HT/VHT preamble with one LTF per stream */
+		if (rate->flags & IEEE80211_TX_RC_VHT_MCS)
+			return 36 + 4 * nss + sym;
+		return 32 + 4 * nss + sym;
+	}
+
+	sband = air->hw->wiphy->bands[air->band];
+	if (!sband || rate->idx < 0 || rate->idx >= sband->n_bitrates)
+		return 0;
+	bitrate = sband->bitrates[rate->idx].bitrate;
+
+	if (air->band == IEEE80211_BAND_2GHZ && (bitrate == 10 ||
+	    bitrate == 20 || bitrate == 55 || bitrate == 110)) {
+		u32 preamble = 192;
+
+		if (bitrate != 10 &&
+		    (rate->flags & IEEE80211_TX_RC_USE_SHORT_PREAMBLE))
+			preamble = 96;
+		return preamble + DIV_ROUND_UP(air->len * 8 * 10, bitrate);
+	}
+
+	return 20 + 4 * hwsim_ofdm_symbols(air->len, bitrate * 4 / 10);
+}
+
+/*
+ * Time from the start of a frame exchange until the end of the last
+ * attempt listed in @tries. Failed attempts are followed by an ACK
+ * timeout and a backoff with a doubled contention window, @ack adds
+ * the acknowledgement of the final attempt.
+ */
+static u32 hwsim_air_exchange(struct hwsim_air_tx *air,
+			      struct ieee80211_tx_info *info,
+			      const u8 *tries, bool ack)
+{
+	u32 cw = HWSIM_CW_MIN, t = 0, ppdu;
+	int i, n, attempt = 0;
+
+	for (i = 0; i < IEEE80211_TX_MAX_RATES && tries[i]; i++) {
+		ppdu = hwsim_ppdu_airtime(air, &info->control.rates[i]);
+		for (n = 0; n < tries[i]; n++) {
+			if (attempt++) {
+				t += air->sifs_us + air->ack_us +
+				     air->sifs_us + 2 * HWSIM_SLOT_US +
+				     cw / 2 * HWSIM_SLOT_US;
+				cw = min_t(u32, 2 * cw + 1, HWSIM_CW_MAX);
+			}
+			t += ppdu;
+		}
+	}
+
+	if (ack)
+		t += air->sifs_us + air->ack_us;
+
+	return t;
+}
+
+static void hwsim_air_tx_init(struct hwsim_air_tx *air,
+			      struct ieee80211_hw *hw,
+			      struct ieee80211_channel *chan,
+			      u32 len, bool agg, u32 start_us)
+{
+	/* control responses at 6 Mbps: 14 byte ACK or 32 byte BlockAck */
+	air->hw = hw;
+	air->band = chan->band;
+	air->start_us = start_us;
+	air->sifs_us = chan->band == IEEE80211_BAND_2GHZ ? 10 : 16;
+	air->ack_us = 20 + 4 * hwsim_ofdm_symbols(agg ? 32 : 14, 24);
+	air->len = len;
+}
+
+static bool mac80211_hwsim_tx_frame_no_nl(struct ieee80211_hw *hw,
+					  struct sk_buff *skb,
+					  struct ieee80211_channel *chan,
+					  u8 *tries,
+					  struct hwsim_air_tx *air)
+{
+	struct mac80211_hwsim_data *data = hw->priv, *data2;
+	struct hwsim_rx_entry *entry;
+	struct page *page = NULL;
+	bool ack = false;
+	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *) skb->data;
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+	struct ieee80211_rx_status rx_status;
+	bool need_ack = !(info->flags & IEEE80211_TX_CTL_NO_ACK) &&
+			!is_multicast_ether_addr(hdr->addr1);
+	u32 first_us = 0;
+	u64 now;
+
+	/* without a lossy link, the first attempt always gets through */
+	memset(tries, 0, IEEE80211_TX_MAX_RATES);
+	tries[0] = 1;
+
+	memset(&rx_status, 0, sizeof(rx_status));
+	rx_status.flag |= RX_FLAG_MACTIME_START;
+	rx_status.freq = chan->center_freq;
+	rx_status.band = chan->band;
+
+	if (data->ps != PS_DISABLED)
+		hdr->frame_control |= cpu_to_le16(IEEE80211_FCTL_PM);
+
+	/* release the skb's source info */
+	skb_orphan(skb);
+	skb_dst_drop(skb);
+	skb->mark = 0;
+	secpath_reset(skb);
+	nf_reset(skb);
+
+	/*
+	 * Get absolute mactime here so all HWs RX at the "same time", and
+	 * absolute TX time for beacon mactime so the timestamp matches.
+	 * Giving beacons a different mactime than non-beacons looks messy, but
+	 * it helps the Toffset be exact and a ~10us mactime discrepancy
+	 * probably doesn't really matter.
+	 */
+	if (ieee80211_is_beacon(hdr->frame_control) ||
+	    ieee80211_is_probe_resp(hdr->frame_control))
+		now = data->abs_bcn_ts;
+	else
+		now = mac80211_hwsim_get_tsf_raw() + (air ? air->start_us : 0);
+
+	/* frames that are not retried are heard at the end of their PPDU */
+	if (air)
+		first_us = air->start_us + hwsim_air_exchange(air, info,
+							      hwsim_first_try,
+							      false);
+
+	/* Copy skb to all enabled radios that are on the current frequency */
+	rcu_read_lock();
+	hash_for_each_possible_rcu(hwsim_rx_index, entry, node,
+				   chan->center_freq) {
+		struct sk_buff *nskb;
+		struct hwsim_link *link;
+		bool is_dst, retried = false;
+		u32 delay_us;
+		int rate = 0;
+
+		if (entry->freq != chan->center_freq)
+			continue;
+
+		data2 = entry->data;
+		if (data == data2)
+			continue;
+
+		if (!data2->started || (data2->idle && !data2->tmp_chan) ||
+		    !hwsim_ps_rx_ok(data2, skb))
+			continue;
+
+		if (!(data->group & data2->group))
+			continue;
+
+		link = hwsim_link_find(data, data2->idx);
+		if (!link && links_only)
+			continue;
+
+		is_dst = mac80211_hwsim_addr_match(data2, hdr->addr1);
+
+		if (link && is_dst && need_ack) {
+			rate = hwsim_link_tx_attempts(link, info, tries);
+			if (rate < 0)
+				continue;
+			retried = true;
+		} else if (link && hwsim_link_lost(link,
+						   &info->control.rates[0])) {
+			continue;
+		}
+
+		/*
+		 * reserve some space for our vendor and the normal
+		 * radiotap header, since we're copying anyway
+		 */
+		if (skb->len < PAGE_SIZE && paged_rx) {
+			if (!page) {
+				page = alloc_page(GFP_ATOMIC);
+				if (!page)
+					continue;
+				memcpy(page_address(page), skb->data,
+				       skb->len);
+			}
+
+			nskb = dev_alloc_skb(128);
+			if (!nskb)
+				continue;
+
+			/* all receivers share one copy of the payload */
+			get_page(page);
+			skb_add_rx_frag(nskb, 0, page, 0, skb->len, skb->len);
+			skb_shinfo(nskb)->tx_flags |= SKBTX_SHARED_FRAG;
+		} else {
+			nskb = skb_copy(skb, GFP_ATOMIC);
+			if (!nskb)
+				continue;
+		}
+
+		if (is_dst)
+			ack = true;
+
+		hwsim_rx_status_set_rate(&rx_status,
+					 &info->control.rates[rate]);
+		if (link && link->has_signal)
+			rx_status.signal = link->signal;
+		else
+			rx_status.signal = data->power_level - 50;
+		rx_status.mactime = now + data2->tsf_offset;
+
+		memcpy(IEEE80211_SKB_RXCB(nskb), &rx_status, sizeof(rx_status));
+
+		mac80211_hwsim_add_vendor_rtap(nskb);
+
+		delay_us = link ? link->delay_us : 0;
+		if (air && retried)
+			delay_us += air->start_us +
+				    hwsim_air_exchange(air, info, tries, false);
+		else if (air)
+			delay_us += first_us;
+
+		data2->rx_pkts++;
+		data2->rx_bytes += nskb->len;
+		if (delay_us)
+			mac80211_hwsim_rx_delayed_add(data2, nskb, delay_us);
+		else
+			mac80211_hwsim_rx(data2, nskb);
+	}
+	rcu_read_unlock();
+
+	if (page)
+		put_page(page);
+
+	return ack;
+}
+
+#define HWSIM_BENCH_FRAME_LEN	256
+#define HWSIM_BENCH_MAX_FRAMES	1000000
+
+/*
+ * Medium benchmark: writing N to the "bench" debugfs file pushes N
+ * broadcast data frames from this radio through the in-kernel medium
+ * and reading it returns the frames/s achieved. Run it with different
+ * radios= counts to see how delivery scales with the number of radios.
+ */
+static int hwsim_fops_bench_read(void *dat, u64 *val)
+{
+	struct mac80211_hwsim_data *data = dat;
+
+	*val = data->bench_fps;
+	return 0;
+}
+
+static int hwsim_fops_bench_write(void *dat, u64 val)
+{
+	struct mac80211_hwsim_data *data = dat;
+	struct ieee80211_channel *chan = data->channel;
+	u8 tries[IEEE80211_TX_MAX_RATES];
+	struct ieee80211_hdr *hdr;
+	struct sk_buff *skb;
+	ktime_t start;
+	u64 i, ns;
+
+	if (!val || val > HWSIM_BENCH_MAX_FRAMES)
+		return -EINVAL;
+
+	if (!chan)
+		return -ENOLINK;
+
+	skb = dev_alloc_skb(HWSIM_BENCH_FRAME_LEN);
+	if (!skb)
+		return -ENOMEM;
+
+	hdr = (struct ieee80211_hdr *)skb_put(skb, HWSIM_BENCH_FRAME_LEN);
+	memset(hdr, 0, HWSIM_BENCH_FRAME_LEN);
+	hdr->frame_control = cpu_to_le16(IEEE80211_FTYPE_DATA |
+					 IEEE80211_STYPE_DATA);
+	eth_broadcast_addr(hdr->addr1);
+	memcpy(hdr->addr2, data->addresses[0].addr, ETH_ALEN);
+	eth_broadcast_addr(hdr->addr3);
+	IEEE80211_SKB_CB(skb)->flags = IEEE80211_TX_CTL_NO_ACK;
+
+	start = ktime_get();
+	for (i = 0; i < val; i++) {
+		local_bh_disable();
+		mac80211_hwsim_tx_frame_no_nl(data->hw, skb, chan, tries, NULL);
+		local_bh_enable();
+		cond_resched();
+	}
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	dev_kfree_skb(skb);
+
+	data->bench_fps = div64_u64(val * NSEC_PER_SEC, max_t(u64, ns, 1));
+	return 0;
+}
+
+DEFINE_SIMPLE_ATTRIBUTE(hwsim_fops_bench,
+			hwsim_fops_bench_read, hwsim_fops_bench_write,
+			"%llu\n");
+
+/*
+ * Airtime fairness report: the airtime of the data frames the TX
+ * scheduler handed out for each station, and Jain's fairness index over
+ * those stations (1000 when all got the same airtime). Run traffic to
+ * stations at different rates, then read "airtime_fairness"; writing
+ * to it clears the counters.
+ */
+struct hwsim_fairness {
+	struct seq_file *seq;
+	unsigned int n;
+	u64 sum, sum_sq;
+};
+
+static void hwsim_fairness_iter(void *arg, struct ieee80211_sta *sta)
+{
+	struct hwsim_fairness *f = arg;
+	struct hwsim_sta_priv *sp = (void *)sta->drv_priv;
+	u64 ms = div_u64(sp->tx_airtime, 1000);
+
+	seq_printf(f->seq, "%pM %llu\n", sta->addr, sp->tx_airtime);
+	f->n++;
+	f->sum += ms;
+	f->sum_sq += ms * ms;
+}
+
+static int hwsim_fairness_show(struct seq_file *seq, void *v)
+{
+	struct mac80211_hwsim_data *data = seq->private;
+	struct hwsim_fairness f = {
+		.seq = seq,
+	};
+
+	seq_puts(seq, "station airtime_us\n");
+	ieee80211_iterate_stations_atomic(data->hw, hwsim_fairness_iter, &f);
+	if (f.sum_sq)
+		seq_printf(seq, "jain_index %llu/1000\n",
+			   div64_u64(f.sum * f.sum * 1000, f.n * f.sum_sq));
+
+	return 0;
+}
+
+static void hwsim_fairness_clear_iter(void *arg, struct ieee80211_sta *sta)
+{
+	struct hwsim_sta_priv *sp = (void *)sta->drv_priv;
+
+	sp->tx_airtime = 0;
+}
+
+static ssize_t hwsim_fairness_write(struct file *file,
+				    const char __user *buf,
+				    size_t count, loff_t *ppos)
+{
+	struct seq_file *seq = file->private_data;
+	struct mac80211_hwsim_data *data = seq->private;
+
+	ieee80211_iterate_stations_atomic(data->hw, hwsim_fairness_clear_iter,
+					  NULL);
+	return count;
+}
+
+static int hwsim_fairness_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, hwsim_fairness_show, inode->i_private);
+}
+
+static const struct file_operations hwsim_fops_fairness = {
+	.open = hwsim_fairness_open,
+	.read = seq_read,
+	.write = hwsim_fairness_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static void mac80211_hwsim_tx_status(struct ieee80211_hw *hw,
+				     struct sk_buff *skb,
+				     struct ieee80211_channel *chan,
+				     const u8 *tries, bool ack)
+{
+	struct ieee80211_tx_info *txi = IEEE80211_SKB_CB(skb);
+	struct hwsim_air_tx air;
+	u32 tx_time;
+	int i;
+
+	if (ack && skb->len >= 16) {
+		struct ieee80211_hdr *hdr = (struct ieee80211_hdr *) skb->data;
+		mac80211_hwsim_monitor_ack(chan, hdr->addr2);
+	}
+
+	/* time on air of all attempts, charged by the airtime scheduler */
+	hwsim_air_tx_init(&air, hw, chan, skb->len, false, 0);
+	tx_time = hwsim_air_exchange(&air, txi, tries, ack);
+
+	ieee80211_tx_info_clear_status(txi);
+	txi->status.tx_time = min_t(u32, tx_time, U16_MAX);
+
+	/* report the attempts made on the link to the destination */
+	for (i = 0; i < IEEE80211_TX_MAX_RATES; i++) {
+		if (!tries[i]) {
+			txi->control.rates[i].idx = -1;
+			break;
+		}
+		txi->control.rates[i].count = tries[i];
+	}
+
+	if (!(txi->flags & IEEE80211_TX_CTL_NO_ACK) && ack)
+		txi->flags |= IEEE80211_TX_STAT_ACK;
+	ieee80211_tx_status_irqsafe(hw, skb);
+}
+
+static u32 hwsim_medium_difs(struct hwsim_medium *medium)
+{
+	return (medium->band == IEEE80211_BAND_2GHZ ? 10 : 16) +
+	       2 * HWSIM_SLOT_US;
+}
+
+static void hwsim_air_frame_drop(struct hwsim_air_frame *frame)
+{
+	if (frame->report)
+		ieee80211_free_txskb(frame->data->hw, frame->skb);
+	else
+		dev_kfree_skb(frame->skb);
+	kfree(frame);
+}
+
+static void hwsim_air_frame_done(struct hwsim_air_frame *frame)
+{
+	if (frame->report)
+		mac80211_hwsim_tx_status(frame->data->hw, frame->skb,
+					 frame->chan, frame->tries, frame->ack);
+	else
+		dev_kfree_skb(frame->skb);
+	kfree(frame);
+}
+
+static bool hwsim_air_can_aggregate(struct sk_buff *head, struct sk_buff *skb)
+{
+	struct ieee80211_hdr *h1 = (struct ieee80211_hdr *) head->data;
+	struct ieee80211_hdr *h2 = (struct ieee80211_hdr *) skb->data;
+
+	if (!(IEEE80211_SKB_CB(skb)->flags & IEEE80211_TX_CTL_AMPDU) ||
+	    !ieee80211_is_data_qos(h2->frame_control))
+		return false;
+
+	return ether_addr_equal(h1->addr1, h2->addr1) &&
+	       (*ieee80211_get_qos_ctl(h1) & IEEE80211_QOS_CTL_TID_MASK) ==
+	       (*ieee80211_get_qos_ctl(h2) & IEEE80211_QOS_CTL_TID_MASK);
+}
+
+/*
+ * One contention round: every radio with queued frames draws a backoff
+ * slot, the lowest slot transmits. The winner's A-MPDU subframes go out
+ * together in one PPDU; winners sharing a slot collide and retry with a
+ * doubled contention window. Called with hwsim_medium_lock held, returns
+ * the time the channel stays busy.
+ */
+static u32 hwsim_medium_contend(struct hwsim_medium *medium)
+{
+	struct hwsim_air_frame *frame, *tmp, *head;
+	struct hwsim_air_tx air;
+	LIST_HEAD(winners);
+	u32 round, best = U32_MAX, busy_us = 0, len, n = 0, t;
+	bool agg;
+
+	/* only the oldest frame of each radio contends */
+	round = ++hwsim_medium_round;
+	list_for_each_entry(frame, &medium->queue, list) {
+		if (frame->data->medium_round == round)
+			continue;
+		frame->data->medium_round = round;
+		frame->round = round;
+		frame->slot = prandom_u32_max(frame->cw + 1);
+		best = min_t(u32, best, frame->slot);
+	}
+
+	list_for_each_entry_safe(frame, tmp, &medium->queue, list)
+		if (frame->round == round && frame->slot == best)
+			list_move_tail(&frame->list, &winners);
+
+	if (list_is_singular(&winners)) {
+		head = list_first_entry(&winners, struct hwsim_air_frame, list);
+		agg = hwsim_air_can_aggregate(head->skb, head->skb);
+		len = head->skb->len;
+		if (agg) {
+			len = ALIGN(len + 4, 4);
+			list_for_each_entry_safe(frame, tmp, &medium->queue,
+						 list) {
+				if (frame->data != head->data)
+					continue;
+				if (!hwsim_air_can_aggregate(head->skb,
+							     frame->skb) ||
+				    ++n >= HWSIM_AMPDU_MAX_SUBFRAMES ||
+				    len + frame->skb->len + 4 >
+						HWSIM_AMPDU_MAX_LEN)
+					break;
+				len += ALIGN(frame->skb->len + 4, 4);
+				list_move_tail(&frame->list, &winners);
+			}
+		}
+
+		hwsim_air_tx_init(&air, head->data->hw, head->chan, len, agg,
+				  best * HWSIM_SLOT_US);
+		list_for_each_entry(frame, &winners, list) {
+			struct ieee80211_tx_info *info =
+				IEEE80211_SKB_CB(frame->skb);
+
+			frame->ack = mac80211_hwsim_tx_frame_no_nl(
+					frame->data->hw, frame->skb,
+					frame->chan, frame->tries, &air);
+			frame->tries[0] = min_t(u32, frame->tries[0] +
+						frame->collisions, U8_MAX);
+			t = hwsim_air_exchange(&air, info, frame->tries,
+				!(info->flags & IEEE80211_TX_CTL_NO_ACK));
+			busy_us = max(busy_us, t);
+		}
+		list_splice_tail(&winners, &medium->in_flight);
+		return best * HWSIM_SLOT_US + busy_us;
+	}
+
+	/* collision: nobody hears anything, unacked frames are done */
+	list_for_each_entry_safe(frame, tmp, &winners, list) {
+		struct ieee80211_tx_info *info = IEEE80211_SKB_CB(frame->skb);
+		struct ieee80211_hdr *hdr = (void *)frame->skb->data;
+
+		hwsim_air_tx_init(&air, frame->data->hw, frame->chan,
+				  frame->skb->len, false, 0);
+		t = hwsim_air_exchange(&air, info, hwsim_first_try, true);
+		busy_us = max(busy_us, t);
+
+		frame->collisions++;
+		frame->cw = min_t(u32, 2 * frame->cw + 1, HWSIM_CW_MAX);
+		if ((info->flags & IEEE80211_TX_CTL_NO_ACK) ||
+		    is_multicast_ether_addr(hdr->addr1) ||
+		    frame->collisions >= frame->data->hw->max_rate_tries) {
+			memset(frame->tries, 0, sizeof(frame->tries));
+			frame->tries[0] = frame->collisions;
+			frame->ack = false;
+			list_move_tail(&frame->list, &medium->in_flight);
+		} else {
+			/* retry ahead of the radio's later frames */
+			list_move(&frame->list, &medium->queue);
+		}
+	}
+
+	return best * HWSIM_SLOT_US + busy_us;
+}
+
+static enum hrtimer_restart hwsim_medium_timer(struct hrtimer *timer)
 {
-	struct mac80211_hwsim_data *data = hw->priv, *data2;
-	bool ack = false;
-	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *) skb->data;
-	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
-	struct ieee80211_rx_status rx_status;
-	u64 now;
+	struct hwsim_medium *medium =
+		container_of(timer, struct hwsim_medium, timer.timer);
+	struct hwsim_air_frame *frame, *tmp;
+	ktime_t now = ktime_get(), next;
 
-	memset(&rx_status, 0, sizeof(rx_status));
-	rx_status.flag |= RX_FLAG_MACTIME_START;
-	rx_status.freq = chan->center_freq;
-	rx_status.band = chan->band;
-	if (info->control.rates[0].flags & IEEE80211_TX_RC_VHT_MCS) {
-		rx_status.rate_idx =
-			ieee80211_rate_get_vht_mcs(&info->control.rates[0]);
-		rx_status.vht_nss =
-			ieee80211_rate_get_vht_nss(&info->control.rates[0]);
-		rx_status.flag |= RX_FLAG_VHT;
-	} else {
-		rx_status.rate_idx = info->control.rates[0].idx;
-		if (info->control.rates[0].flags & IEEE80211_TX_RC_MCS)
-			rx_status.flag |= RX_FLAG_HT;
-	}
-	if (info->control.rates[0].flags & IEEE80211_TX_RC_40_MHZ_WIDTH)
-		rx_status.flag |= RX_FLAG_40MHZ;
-	if (info->control.rates[0].flags & IEEE80211_TX_RC_SHORT_GI)
-		rx_status.flag |= RX_FLAG_SHORT_GI;
-	/* TODO: simulate real signal strength (and optional packet loss) */
-	rx_status.signal = data->power_level - 50;
+	spin_lock_bh(&hwsim_medium_lock);
 
-	if (data->ps != PS_DISABLED)
-		hdr->frame_control |= cpu_to_le16(IEEE80211_FCTL_PM);
+	if (ktime_compare(now, medium->busy_until) < 0) {
+		next = medium->busy_until;
+		goto out_rearm;
+	}
 
-	/* release the skb's source info */
-	skb_orphan(skb);
-	skb_dst_drop(skb);
-	skb->mark = 0;
-	secpath_reset(skb);
-	nf_reset(skb);
+	list_for_each_entry_safe(frame, tmp, &medium->in_flight, list) {
+		list_del(&frame->list);
+		hwsim_air_frame_done(frame);
+	}
 
-	/*
-	 * Get absolute mactime here so all HWs RX at the "same time", and
-	 * absolute TX time for beacon mactime so the timestamp matches.
-	 * Giving beacons a different mactime than non-beacons looks messy, but
-	 * it helps the Toffset be exact and a ~10us mactime discrepancy
-	 * probably doesn't really matter.
-	 */
-	if (ieee80211_is_beacon(hdr->frame_control) ||
-	    ieee80211_is_probe_resp(hdr->frame_control))
-		now = data->abs_bcn_ts;
-	else
-		now = mac80211_hwsim_get_tsf_raw();
+	if (list_empty(&medium->queue))
+		goto out;
 
-	/* Copy skb to all enabled radios that are on the current frequency */
-	spin_lock(&hwsim_radio_lock);
-	list_for_each_entry(data2, &hwsim_radios, list) {
-		struct sk_buff *nskb;
-		struct tx_iter_data tx_iter_data = {
-			.receive = false,
-			.channel = chan,
-		};
+	next = ktime_add_us(medium->busy_until, hwsim_medium_difs(medium));
+	if (ktime_compare(now, next) < 0)
+		goto out_rearm;
 
-		if (data == data2)
-			continue;
+	medium->busy_until = ktime_add_us(now, hwsim_medium_contend(medium));
+	next = medium->busy_until;
 
-		if (!data2->started || (data2->idle && !data2->tmp_chan) ||
-		    !hwsim_ps_rx_ok(data2, skb))
-			continue;
+out_rearm:
+	tasklet_hrtimer_start(&medium->timer, next, HRTIMER_MODE_ABS);
+out:
+	spin_unlock_bh(&hwsim_medium_lock);
+	return HRTIMER_NORESTART;
+}
 
-		if (!(data->group & data2->group))
-			continue;
+static struct hwsim_medium *hwsim_medium_get(struct ieee80211_channel *chan)
+{
+	struct hwsim_medium *medium;
 
-		if (!hwsim_chans_compat(chan, data2->tmp_chan) &&
-		    !hwsim_chans_compat(chan, data2->channel)) {
-			ieee80211_iterate_active_interfaces_atomic(
-				data2->hw, IEEE80211_IFACE_ITER_NORMAL,
-				mac80211_hwsim_tx_iter, &tx_iter_data);
-			if (!tx_iter_data.receive)
-				continue;
-		}
+	list_for_each_entry(medium, &hwsim_mediums, list)
+		if (medium->freq == chan->center_freq)
+			return medium;
 
-		/*
-		 * reserve some space for our vendor and the normal
-		 * radiotap header, since we're copying anyway
-		 */
-		if (skb->len < PAGE_SIZE && paged_rx) {
-			struct page *page = alloc_page(GFP_ATOMIC);
+	medium = kzalloc(sizeof(*medium), GFP_ATOMIC);
+	if (!medium)
+		return NULL;
 
-			if (!page)
-				continue;
+	medium->freq = chan->center_freq;
+	medium->band = chan->band;
+	INIT_LIST_HEAD(&medium->queue);
+	INIT_LIST_HEAD(&medium->in_flight);
+	tasklet_hrtimer_init(&medium->timer, hwsim_medium_timer,
+			     CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	list_add_tail(&medium->list, &hwsim_mediums);
 
-			nskb = dev_alloc_skb(128);
-			if (!nskb) {
-				__free_page(page);
-				continue;
-			}
+	return medium;
+}
 
-			memcpy(page_address(page), skb->data, skb->len);
-			skb_add_rx_frag(nskb, 0, page, 0, skb->len, skb->len);
-		} else {
-			nskb = skb_copy(skb, GFP_ATOMIC);
-			if (!nskb)
-				continue;
-		}
+/*
+ * Queue a frame on the airtime medium. It is delivered and, if @report
+ * is set, its TX status given once it won the channel and its exchange
+ * is over; otherwise it is freed then.
+ */
+static void hwsim_medium_tx(struct mac80211_hwsim_data *data,
+			    struct sk_buff *skb,
+			    struct ieee80211_channel *chan, bool report)
+{
+	struct hwsim_medium *medium;
+	struct hwsim_air_frame *frame;
+	ktime_t start;
+
+	frame = kzalloc(sizeof(*frame), GFP_ATOMIC);
+	if (!frame)
+		goto drop;
+
+	frame->data = data;
+	frame->skb = skb;
+	frame->chan = chan;
+	frame->cw = HWSIM_CW_MIN;
+	frame->report = report;
+
+	spin_lock_bh(&hwsim_medium_lock);
+	medium = hwsim_medium_get(chan);
+	if (!medium) {
+		spin_unlock_bh(&hwsim_medium_lock);
+		kfree(frame);
+		goto drop;
+	}
 
-		if (mac80211_hwsim_addr_match(data2, hdr->addr1))
-			ack = true;
+	list_add_tail(&frame->list, &medium->queue);
+	if (!hrtimer_is_queued(&medium->timer.timer)) {
+		/* an idle channel can be taken after DIFS */
+		start = ktime_get();
+		if (ktime_compare(start, medium->busy_until) < 0)
+			start = medium->busy_until;
+		tasklet_hrtimer_start(&medium->timer,
+				      ktime_add_us(start,
+						   hwsim_medium_difs(medium)),
+				      HRTIMER_MODE_ABS);
+	}
+	spin_unlock_bh(&hwsim_medium_lock);
+	return;
 
-		rx_status.mactime = now + data2->tsf_offset;
+drop:
+	data->tx_dropped++;
+	if (report)
+		ieee80211_free_txskb(data->hw, skb);
+	else
+		dev_kfree_skb(skb);
+}
 
-		memcpy(IEEE80211_SKB_RXCB(nskb), &rx_status, sizeof(rx_status));
+/* drop the frames of a radio that is going down from every channel */
+static void hwsim_medium_purge(struct mac80211_hwsim_data *data)
+{
+	struct hwsim_medium *medium;
+	struct hwsim_air_frame *frame, *tmp;
 
-		mac80211_hwsim_add_vendor_rtap(nskb);
+	spin_lock_bh(&hwsim_medium_lock);
+	list_for_each_entry(medium, &hwsim_mediums, list) {
+		list_for_each_entry_safe(frame, tmp, &medium->queue, list) {
+			if (frame->data != data)
+				continue;
+			list_del(&frame->list);
+			hwsim_air_frame_drop(frame);
+		}
+		list_for_each_entry_safe(frame, tmp, &medium->in_flight,
+					 list) {
+			if (frame->data != data)
+				continue;
+			list_del(&frame->list);
+			hwsim_air_frame_drop(frame);
+		}
+	}
+	spin_unlock_bh(&hwsim_medium_lock);
+}
 
-		data2->rx_pkts++;
-		data2->rx_bytes += nskb->len;
-		ieee80211_rx_irqsafe(data2->hw, nskb);
+static void hwsim_medium_free(void)
+{
+	struct hwsim_medium *medium, *tmp;
+
+	list_for_each_entry_safe(medium, tmp, &hwsim_mediums, list) {
+		tasklet_hrtimer_cancel(&medium->timer);
+		WARN_ON(!list_empty(&medium->queue) ||
+			!list_empty(&medium->in_flight));
+		list_del(&medium->list);
+		kfree(medium);
 	}
-	spin_unlock(&hwsim_radio_lock);
+}
 
-	return ack;
+/* channel a frame goes out on, must be called under RCU */
+static struct ieee80211_channel *
+hwsim_tx_channel(struct mac80211_hwsim_data *data,
+		 struct ieee80211_tx_info *txi)
+{
+	struct ieee80211_chanctx_conf *chanctx_conf;
+
+	if (!data->use_chanctx)
+		return data->channel;
+	if (txi->hw_queue == 4)
+		return data->tmp_chan;
+
+	chanctx_conf = rcu_dereference(txi->control.vif->chanctx_conf);
+	return chanctx_conf ? chanctx_conf->def.chan : NULL;
 }
 
 static void mac80211_hwsim_tx(struct ieee80211_hw *hw,
@@ -1247,8 +2307,8 @@ static void mac80211_hwsim_tx(struct ieee80211_hw *hw,
 {
 	struct mac80211_hwsim_data *data = hw->priv;
 	struct ieee80211_tx_info *txi = IEEE80211_SKB_CB(skb);
-	struct ieee80211_chanctx_conf *chanctx_conf;
 	struct ieee80211_channel *channel;
+	u8 tries[IEEE80211_TX_MAX_RATES];
 	bool ack;
 	u32 _portid;
 
@@ -1258,18 +2318,7 @@ static void mac80211_hwsim_tx(struct ieee80211_hw *hw,
 		return;
 	}
 
-	if (!data->use_chanctx) {
-		channel = data->channel;
-	} else if (txi->hw_queue == 4) {
-		channel = data->tmp_chan;
-	} else {
-		chanctx_conf = rcu_dereference(txi->control.vif->chanctx_conf);
-		if (chanctx_conf)
-			channel = chanctx_conf->def.chan;
-		else
-			channel = NULL;
-	}
-
+	channel = hwsim_tx_channel(data, txi);
 	if (WARN(!channel, "TX w/o channel - queue = %d\n", txi->hw_queue)) {
 		ieee80211_free_txskb(hw, skb);
 		return;
@@ -1303,22 +2352,149 @@ static void mac80211_hwsim_tx(struct ieee80211_hw *hw,
 	/* NO wmediumd detected, perfect medium simulation */
 	data->tx_pkts++;
 	data->tx_bytes += skb->len;
-	ack = mac80211_hwsim_tx_frame_no_nl(hw, skb, channel);
 
-	if (ack && skb->len >= 16) {
-		struct ieee80211_hdr *hdr = (struct ieee80211_hdr *) skb->data;
-		mac80211_hwsim_monitor_ack(channel, hdr->addr2);
+	if (airtime_medium)
+		return hwsim_medium_tx(data, skb, channel, true);
+
+	ack = mac80211_hwsim_tx_frame_no_nl(hw, skb, channel, tries, NULL);
+	mac80211_hwsim_tx_status(hw, skb, channel, tries, ack);
+}
+
+/* frames pulled from one TX queue each time it is picked */
+#define HWSIM_TXQ_BURST		4
+
+static void hwsim_txq_account(struct mac80211_hwsim_data *data,
+			      struct ieee80211_sta *sta, struct sk_buff *skb)
+{
+	struct hwsim_sta_priv *sp = (void *)sta->drv_priv;
+	struct ieee80211_tx_info *txi = IEEE80211_SKB_CB(skb);
+	struct ieee80211_channel *chan;
+	struct hwsim_air_tx air;
+
+	chan = hwsim_tx_channel(data, txi);
+	if (!chan)
+		return;
+
+	hwsim_air_tx_init(&air, data->hw, chan, skb->len, false, 0);
+	sp->tx_airtime += hwsim_air_exchange(&air, txi, hwsim_first_try,
+					     false);
+}
+
+/*
+ * Serve the TX queues in the order ieee80211_next_txq() picks them, one
+ * burst per queue and round. The tasklet reschedules itself while frames
+ * are left, so the TX status of a round (and the airtime it charges) is
+ * processed before the next round is picked.
+ */
+static void mac80211_hwsim_tx_queues(unsigned long arg)
+{
+	struct mac80211_hwsim_data *data = (void *)arg;
+	struct ieee80211_hw *hw = data->hw;
+	struct ieee80211_tx_control control = {};
+	struct ieee80211_txq *txq;
+	struct sk_buff *skb;
+	bool pending = false;
+	int ac, n;
+
+	rcu_read_lock();
+	for (ac = 0; ac < IEEE80211_NUM_ACS; ac++) {
+		ieee80211_txq_schedule_start(hw, ac);
+
+		while ((txq = ieee80211_next_txq(hw, ac))) {
+			struct hwsim_sta_priv *sp = NULL;
+
+			if (txq->sta)
+				sp = (void *)txq->sta->drv_priv;
+
+			for (n = 0; n < HWSIM_TXQ_BURST; n++) {
+				if (sp && ACCESS_ONCE(sp->asleep))
+					break;
+
+				skb = ieee80211_tx_dequeue(hw, txq);
+				if (!skb)
+					break;
+
+				if (txq->sta)
+					hwsim_txq_account(data, txq->sta, skb);
+				control.sta = txq->sta;
+				mac80211_hwsim_tx(hw, &control, skb);
+			}
+
+			if (n == HWSIM_TXQ_BURST)
+				pending = true;
+			ieee80211_return_txq(hw, txq);
+		}
 	}
+	rcu_read_unlock();
 
-	ieee80211_tx_info_clear_status(txi);
+	if (pending)
+		tasklet_schedule(&data->tx_tasklet);
+}
+
+static void mac80211_hwsim_wake_tx_queue(struct ieee80211_hw *hw,
+					 struct ieee80211_txq *txq)
+{
+	struct mac80211_hwsim_data *data = hw->priv;
 
-	/* frame was transmitted at most favorable rate at first attempt */
-	txi->control.rates[0].count = 1;
-	txi->control.rates[1].idx = -1;
+	tasklet_schedule(&data->tx_tasklet);
+}
 
-	if (!(txi->flags & IEEE80211_TX_CTL_NO_ACK) && ack)
-		txi->flags |= IEEE80211_TX_STAT_ACK;
-	ieee80211_tx_status_irqsafe(hw, skb);
+/*
+ * PS-Poll and U-APSD responses for a sleeping station come from its TX
+ * queues. The driver ends the service period, so it sets MORE_DATA and
+ * EOSP itself.
+ */
+static void
+mac80211_hwsim_release_buffered_frames(struct ieee80211_hw *hw,
+				       struct ieee80211_sta *sta,
+				       u16 tids, int nframes,
+				       enum ieee80211_frame_release_type reason,
+				       bool more_data)
+{
+	struct ieee80211_tx_control control = {
+		.sta = sta,
+	};
+	struct sk_buff_head frames;
+	struct sk_buff *skb;
+	int tid;
+
+	__skb_queue_head_init(&frames);
+	for (tid = 0; tid < IEEE80211_NUM_TIDS; tid++) {
+		if (!(tids & BIT(tid)))
+			continue;
+
+		while (skb_queue_len(&frames) < nframes &&
+		       (skb = ieee80211_tx_dequeue(hw, sta->txq[tid])))
+			__skb_queue_tail(&frames, skb);
+	}
+
+	if (skb_queue_empty(&frames)) {
+		ieee80211_sta_eosp(sta);
+		return;
+	}
+
+	/* the queues may hold more frames than were asked for */
+	if (skb_queue_len(&frames) == nframes)
+		more_data = true;
+
+	while ((skb = __skb_dequeue(&frames))) {
+		struct ieee80211_hdr *hdr = (void *)skb->data;
+		struct ieee80211_tx_info *txi = IEEE80211_SKB_CB(skb);
+
+		if (more_data || !skb_queue_empty(&frames))
+			hdr->frame_control |=
+				cpu_to_le16(IEEE80211_FCTL_MOREDATA);
+
+		if (skb_queue_empty(&frames)) {
+			if (reason == IEEE80211_FRAME_RELEASE_UAPSD &&
+			    ieee80211_is_data_qos(hdr->frame_control))
+				*ieee80211_get_qos_ctl(hdr) |=
+					IEEE80211_QOS_CTL_EOSP;
+			txi->flags |= IEEE80211_TX_STATUS_EOSP;
+		}
+
+		mac80211_hwsim_tx(hw, &control, skb);
+	}
 }
 
 
@@ -1326,6 +2502,9 @@ static int mac80211_hwsim_start(struct ieee80211_hw *hw)
 {
 	struct mac80211_hwsim_data *data = hw->priv;
 	wiphy_debug(hw->wiphy, "%s\n", __func__);
+	skb_queue_purge(&data->rx_queue);
+	clear_bit(HWSIM_RX_SCHED, &data->rx_state);
+	napi_enable(&data->rx_napi);
 	data->started = true;
 	return 0;
 }
@@ -1336,6 +2515,11 @@ static void mac80211_hwsim_stop(struct ieee80211_hw *hw)
 	struct mac80211_hwsim_data *data = hw->priv;
 	data->started = false;
 	tasklet_hrtimer_cancel(&data->beacon_timer);
+	tasklet_hrtimer_cancel(&data->rx_delay_timer);
+	skb_queue_purge(&data->rx_delayed);
+	hwsim_medium_purge(data);
+	napi_disable(&data->rx_napi);
+	skb_queue_purge(&data->rx_queue);
 	wiphy_debug(hw->wiphy, "%s\n", __func__);
 }
 
@@ -1394,6 +2578,7 @@ static void mac80211_hwsim_tx_frame(struct ieee80211_hw *hw,
 				    struct ieee80211_channel *chan)
 {
 	u32 _pid = ACCESS_ONCE(wmediumd_portid);
+	u8 tries[IEEE80211_TX_MAX_RATES];
 
 	if (ieee80211_hw_check(hw, SUPPORTS_RC_TABLE)) {
 		struct ieee80211_tx_info *txi = IEEE80211_SKB_CB(skb);
@@ -1407,7 +2592,10 @@ static void mac80211_hwsim_tx_frame(struct ieee80211_hw *hw,
 	if (_pid)
 		return mac80211_hwsim_tx_frame_nl(hw, skb, _pid);
 
-	mac80211_hwsim_tx_frame_no_nl(hw, skb, chan);
+	if (airtime_medium)
+		return hwsim_medium_tx(hw->priv, skb, chan, false);
+
+	mac80211_hwsim_tx_frame_no_nl(hw, skb, chan, tries, NULL);
 	dev_kfree_skb(skb);
 }
 
@@ -1496,6 +2684,7 @@ static int mac80211_hwsim_config(struct ieee80211_hw *hw, u32 changed)
 {
 	struct mac80211_hwsim_data *data = hw->priv;
 	struct ieee80211_conf *conf = &hw->conf;
+	int err;
 	static const char *smps_modes[IEEE80211_SMPS_NUM_MODES] = {
 		[IEEE80211_SMPS_AUTOMATIC] = "auto",
 		[IEEE80211_SMPS_OFF] = "off",
@@ -1524,7 +2713,9 @@ static int mac80211_hwsim_config(struct ieee80211_hw *hw, u32 changed)
 
 	data->idle = !!(conf->flags & IEEE80211_CONF_IDLE);
 
-	data->channel = conf->chandef.chan;
+	err = hwsim_rx_switch(data, &data->channel, conf->chandef.chan);
+	if (err)
+		return err;
 
 	WARN_ON(data->channel && data->use_chanctx);
 
@@ -1658,8 +2849,12 @@ static int mac80211_hwsim_sta_add(struct ieee80211_hw *hw,
 				  struct ieee80211_vif *vif,
 				  struct ieee80211_sta *sta)
 {
+	struct hwsim_sta_priv *sp = (void *)sta->drv_priv;
+
 	hwsim_check_magic(vif);
 	hwsim_set_sta_magic(sta);
+	sp->asleep = false;
+	sp->tx_airtime = 0;
 
 	return 0;
 }
@@ -1679,12 +2874,17 @@ static void mac80211_hwsim_sta_notify(struct ieee80211_hw *hw,
 				      enum sta_notify_cmd cmd,
 				      struct ieee80211_sta *sta)
 {
+	struct hwsim_sta_priv *sp = (void *)sta->drv_priv;
+
 	hwsim_check_magic(vif);
 
 	switch (cmd) {
 	case STA_NOTIFY_SLEEP:
+		ACCESS_ONCE(sp->asleep) = true;
+		break;
 	case STA_NOTIFY_AWAKE:
-		/* TODO: make good use of these flags */
+		/* mac80211 wakes the queues that have frames */
+		ACCESS_ONCE(sp->asleep) = false;
 		break;
 	default:
 		WARN(1, "Invalid sta notify: %d\n", cmd);
@@ -1854,15 +3054,22 @@ static void hw_scan_work(struct work_struct *work)
 	struct mac80211_hwsim_data *hwsim =
 		container_of(work, struct mac80211_hwsim_data, hw_scan.work);
 	struct cfg80211_scan_request *req = hwsim->hw_scan_request;
+	bool aborted = false;
 	int dwell, i;
 
 	mutex_lock(&hwsim->mutex);
-	if (hwsim->scan_chan_idx >= req->n_channels) {
-		wiphy_debug(hwsim->hw->wiphy, "hw scan complete\n");
-		ieee80211_scan_completed(hwsim->hw, false);
+	if (hwsim->scan_chan_idx < req->n_channels &&
+	    hwsim_rx_switch(hwsim, &hwsim->tmp_chan,
+			    req->channels[hwsim->scan_chan_idx]))
+		aborted = true;
+
+	if (aborted || hwsim->scan_chan_idx >= req->n_channels) {
+		wiphy_debug(hwsim->hw->wiphy, "hw scan %s\n",
+			    aborted ? "aborted" : "complete");
+		ieee80211_scan_completed(hwsim->hw, aborted);
 		hwsim->hw_scan_request = NULL;
 		hwsim->hw_scan_vif = NULL;
-		hwsim->tmp_chan = NULL;
+		hwsim_rx_switch(hwsim, &hwsim->tmp_chan, NULL);
 		mutex_unlock(&hwsim->mutex);
 		return;
 	}
@@ -1870,7 +3077,6 @@ static void hw_scan_work(struct work_struct *work)
 	wiphy_debug(hwsim->hw->wiphy, "hw scan %d MHz\n",
 		    req->channels[hwsim->scan_chan_idx]->center_freq);
 
-	hwsim->tmp_chan = req->channels[hwsim->scan_chan_idx];
 	if (hwsim->tmp_chan->flags & IEEE80211_CHAN_NO_IR ||
 	    !req->n_ssids) {
 		dwell = 120;
@@ -1945,7 +3151,7 @@ static void mac80211_hwsim_cancel_hw_scan(struct ieee80211_hw *hw,
 
 	mutex_lock(&hwsim->mutex);
 	ieee80211_scan_completed(hwsim->hw, true);
-	hwsim->tmp_chan = NULL;
+	hwsim_rx_switch(hwsim, &hwsim->tmp_chan, NULL);
 	hwsim->hw_scan_request = NULL;
 	hwsim->hw_scan_vif = NULL;
 	mutex_unlock(&hwsim->mutex);
@@ -1994,7 +3200,7 @@ static void hw_roc_done(struct work_struct *work)
 
 	mutex_lock(&hwsim->mutex);
 	ieee80211_remain_on_channel_expired(hwsim->hw);
-	hwsim->tmp_chan = NULL;
+	hwsim_rx_switch(hwsim, &hwsim->tmp_chan, NULL);
 	mutex_unlock(&hwsim->mutex);
 
 	wiphy_debug(hwsim->hw->wiphy, "hwsim ROC expired\n");
@@ -2007,6 +3213,7 @@ static int mac80211_hwsim_roc(struct ieee80211_hw *hw,
 			      enum ieee80211_roc_type type)
 {
 	struct mac80211_hwsim_data *hwsim = hw->priv;
+	int err;
 
 	mutex_lock(&hwsim->mutex);
 	if (WARN_ON(hwsim->tmp_chan || hwsim->hw_scan_request)) {
@@ -2014,8 +3221,10 @@ static int mac80211_hwsim_roc(struct ieee80211_hw *hw,
 		return -EBUSY;
 	}
 
-	hwsim->tmp_chan = chan;
+	err = hwsim_rx_switch(hwsim, &hwsim->tmp_chan, chan);
 	mutex_unlock(&hwsim->mutex);
+	if (err)
+		return err;
 
 	wiphy_debug(hw->wiphy, "hwsim ROC (%d MHz, %d ms)\n",
 		    chan->center_freq, duration);
@@ -2034,7 +3243,7 @@ static int mac80211_hwsim_croc(struct ieee80211_hw *hw)
 	cancel_delayed_work_sync(&hwsim->roc_done);
 
 	mutex_lock(&hwsim->mutex);
-	hwsim->tmp_chan = NULL;
+	hwsim_rx_switch(hwsim, &hwsim->tmp_chan, NULL);
 	mutex_unlock(&hwsim->mutex);
 
 	wiphy_debug(hw->wiphy, "hwsim ROC canceled\n");
@@ -2045,6 +3254,13 @@ static int mac80211_hwsim_croc(struct ieee80211_hw *hw)
 static int mac80211_hwsim_add_chanctx(struct ieee80211_hw *hw,
 				      struct ieee80211_chanctx_conf *ctx)
 {
+	struct hwsim_chanctx_priv *cp = (void *)ctx->drv_priv;
+	int err;
+
+	cp->chan = NULL;
+	err = hwsim_rx_switch(hw->priv, &cp->chan, ctx->def.chan);
+	if (err)
+		return err;
 	hwsim_set_chanctx_magic(ctx);
 	wiphy_debug(hw->wiphy,
 		    "add channel context control: %d MHz/width: %d/cfreqs:%d/%d MHz\n",
@@ -2056,6 +3272,9 @@ static int mac80211_hwsim_add_chanctx(struct ieee80211_hw *hw,
 static void mac80211_hwsim_remove_chanctx(struct ieee80211_hw *hw,
 					  struct ieee80211_chanctx_conf *ctx)
 {
+	struct hwsim_chanctx_priv *cp = (void *)ctx->drv_priv;
+
+	hwsim_rx_switch(hw->priv, &cp->chan, NULL);
 	wiphy_debug(hw->wiphy,
 		    "remove channel context control: %d MHz/width: %d/cfreqs:%d/%d MHz\n",
 		    ctx->def.chan->center_freq, ctx->def.width,
@@ -2068,7 +3287,12 @@ static void mac80211_hwsim_change_chanctx(struct ieee80211_hw *hw,
 					  struct ieee80211_chanctx_conf *ctx,
 					  u32 changed)
 {
+	struct hwsim_chanctx_priv *cp = (void *)ctx->drv_priv;
+
 	hwsim_check_chanctx_magic(ctx);
+	if (hwsim_rx_switch(hw->priv, &cp->chan, ctx->def.chan))
+		wiphy_warn(hw->wiphy, "can't listen on %d MHz\n",
+			   ctx->def.chan->center_freq);
 	wiphy_debug(hw->wiphy,
 		    "change channel context control: %d MHz/width: %d/cfreqs:%d/%d MHz\n",
 		    ctx->def.chan->center_freq, ctx->def.width,
@@ -2146,6 +3370,8 @@ static void mac80211_hwsim_get_et_stats(struct ieee80211_hw *hw,
 
 static const struct ieee80211_ops mac80211_hwsim_ops = {
 	.tx = mac80211_hwsim_tx,
+	.wake_tx_queue = mac80211_hwsim_wake_tx_queue,
+	.release_buffered_frames = mac80211_hwsim_release_buffered_frames,
 	.start = mac80211_hwsim_start,
 	.stop = mac80211_hwsim_stop,
 	.add_interface = mac80211_hwsim_add_interface,
@@ -2335,6 +3561,19 @@ static int mac80211_hwsim_new_radio(struct genl_info *info,
 	}
 
 	skb_queue_head_init(&data->pending);
+	skb_queue_head_init(&data->rx_delayed);
+	INIT_LIST_HEAD(&data->rx_entries);
+	hash_init(data->links);
+
+	skb_queue_head_init(&data->rx_queue);
+	init_dummy_netdev(&data->napi_dev);
+	netif_napi_add(&data->napi_dev, &data->rx_napi,
+		       mac80211_hwsim_rx_poll, 64);
+	data->rx_csd.func = mac80211_hwsim_rx_kick;
+	data->rx_csd.info = data;
+	data->rx_cpu = hwsim_rx_home_cpu(idx);
+	tasklet_init(&data->tx_tasklet, mac80211_hwsim_tx_queues,
+		     (unsigned long)data);
 
 	SET_IEEE80211_DEV(hw, data->dev);
 	eth_zero_addr(addr);
@@ -2530,6 +3769,10 @@ static int mac80211_hwsim_new_radio(struct genl_info *info,
 	debugfs_create_file("ps", 0666, data->debugfs, data, &hwsim_fops_ps);
 	debugfs_create_file("group", 0666, data->debugfs, data,
 			    &hwsim_fops_group);
+	debugfs_create_file("bench", 0600, data->debugfs, data,
+			    &hwsim_fops_bench);
+	debugfs_create_file("airtime_fairness", 0600, data->debugfs, data,
+			    &hwsim_fops_fairness);
 	if (!data->use_chanctx)
 		debugfs_create_file("dfs_simulate_radar", 0222,
 				    data->debugfs,
@@ -2538,6 +3781,9 @@ static int mac80211_hwsim_new_radio(struct genl_info *info,
 	tasklet_hrtimer_init(&data->beacon_timer,
 			     mac80211_hwsim_beacon,
 			     CLOCK_MONOTONIC_RAW, HRTIMER_MODE_ABS);
+	tasklet_hrtimer_init(&data->rx_delay_timer,
+			     mac80211_hwsim_rx_delayed,
+			     CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
 
 	spin_lock_bh(&hwsim_radio_lock);
 	list_add_tail(&data->list, &hwsim_radios);
@@ -2549,6 +3795,7 @@ static int mac80211_hwsim_new_radio(struct genl_info *info,
 	return idx;
 
 failed_hw:
+	netif_napi_del(&data->rx_napi);
 	device_release_driver(data->dev);
 failed_bind:
 	device_unregister(data->dev);
@@ -2597,9 +3844,44 @@ static void mac80211_hwsim_del_radio(struct mac80211_hwsim_data *data,
 				     const char *hwname,
 				     struct genl_info *info)
 {
+	struct mac80211_hwsim_data *other;
+	struct hwsim_link *link;
+
 	hwsim_mcast_del_radio(data->idx, hwname, info);
 	debugfs_remove_recursive(data->debugfs);
 	ieee80211_unregister_hw(data->hw);
+	tasklet_kill(&data->tx_tasklet);
+
+	/* make sure no transmitter still hands frames to the radio */
+	hwsim_rx_unlisten_all(data);
+	synchronize_rcu();
+	tasklet_hrtimer_cancel(&data->rx_delay_timer);
+	skb_queue_purge(&data->rx_delayed);
+	/*
+	 * A kick queued to the home CPU runs before that CPU can go down,
+	 * so only wait for it while the CPU is online and hold off hotplug
+	 * meanwhile.
+	 */
+	get_online_cpus();
+	while (test_bit(HWSIM_RX_KICK, &data->rx_state) &&
+	       cpu_online(data->rx_cpu))
+		cpu_relax();
+	put_online_cpus();
+	netif_napi_del(&data->rx_napi);
+	skb_queue_purge(&data->rx_queue);
+
+	/* the radio is off the list, drop its links in both directions */
+	spin_lock_bh(&hwsim_radio_lock);
+	hwsim_link_flush(data);
+	list_for_each_entry(other, &hwsim_radios, list) {
+		link = hwsim_link_find(other, data->idx);
+		if (link) {
+			hash_del_rcu(&link->node);
+			kfree_rcu(link, rcu_head);
+		}
+	}
+	spin_unlock_bh(&hwsim_radio_lock);
+
 	device_release_driver(data->dev);
 	device_unregister(data->dev);
 	ieee80211_free_hw(data->hw);
@@ -2661,6 +3943,7 @@ static void mac80211_hwsim_free(void)
 		spin_lock_bh(&hwsim_radio_lock);
 	}
 	spin_unlock_bh(&hwsim_radio_lock);
+	hwsim_medium_free();
 	class_destroy(hwsim_class);
 }
 
@@ -2842,7 +4125,7 @@ static int hwsim_cloned_frame_received_nl(struct sk_buff *skb_2,
 	memcpy(IEEE80211_SKB_RXCB(skb), &rx_status, sizeof(rx_status));
 	data2->rx_pkts++;
 	data2->rx_bytes += skb->len;
-	ieee80211_rx_irqsafe(data2->hw, skb);
+	mac80211_hwsim_rx(data2, skb);
 
 	return 0;
 err:
@@ -3028,6 +4311,139 @@ done:
 	return skb->len;
 }
 
+static int hwsim_link_parse_per(struct genl_info *info, u16 *per)
+{
+	const u16 *val;
+	int i, n;
+
+	if (!info->attrs[HWSIM_ATTR_LINK_PER])
+		return 0;
+
+	n = nla_len(info->attrs[HWSIM_ATTR_LINK_PER]) / sizeof(u16);
+	if (!n)
+		return -EINVAL;
+	val = nla_data(info->attrs[HWSIM_ATTR_LINK_PER]);
+
+	for (i = 0; i < HWSIM_LINK_MAX_RATES; i++) {
+		per[i] = val[min(i, n - 1)];
+		if (per[i] > HWSIM_LINK_PER_SCALE)
+			return -EINVAL;
+	}
+
+	return 1;
+}
+
+static int hwsim_set_link_nl(struct sk_buff *msg, struct genl_info *info)
+{
+	struct mac80211_hwsim_data *data = NULL, *tmp;
+	struct hwsim_link *link, *new_link;
+	u16 per[HWSIM_LINK_MAX_RATES];
+	bool rx_found = false;
+	u32 idx, rx_idx;
+	int has_per, res = -ENODEV;
+
+	if (!info->attrs[HWSIM_ATTR_RADIO_ID] ||
+	    !info->attrs[HWSIM_ATTR_LINK_RX_RADIO_ID])
+		return -EINVAL;
+	idx = nla_get_u32(info->attrs[HWSIM_ATTR_RADIO_ID]);
+	rx_idx = nla_get_u32(info->attrs[HWSIM_ATTR_LINK_RX_RADIO_ID]);
+	if (idx == rx_idx)
+		return -EINVAL;
+
+	has_per = hwsim_link_parse_per(info, per);
+	if (has_per < 0)
+		return has_per;
+
+	new_link = kzalloc(sizeof(*new_link), GFP_KERNEL);
+	if (!new_link)
+		return -ENOMEM;
+	new_link->rx_idx = rx_idx;
+
+	spin_lock_bh(&hwsim_radio_lock);
+	list_for_each_entry(tmp, &hwsim_radios, list) {
+		if (tmp->idx == idx)
+			data = tmp;
+		else if (tmp->idx == rx_idx)
+			rx_found = true;
+	}
+	if (!data || !rx_found)
+		goto out_unlock;
+
+	/*
+	 * The TX path reads links under RCU only, so never modify a
+	 * published link: build the updated one and swap it in.
+	 */
+	link = hwsim_link_find(data, rx_idx);
+	if (link) {
+		new_link->has_signal = link->has_signal;
+		new_link->signal = link->signal;
+		new_link->delay_us = link->delay_us;
+		memcpy(new_link->per, link->per, sizeof(new_link->per));
+	}
+
+	if (info->attrs[HWSIM_ATTR_SIGNAL]) {
+		new_link->signal = nla_get_u32(info->attrs[HWSIM_ATTR_SIGNAL]);
+		new_link->has_signal = true;
+	}
+	if (info->attrs[HWSIM_ATTR_LINK_DELAY])
+		new_link->delay_us =
+			nla_get_u32(info->attrs[HWSIM_ATTR_LINK_DELAY]);
+	if (has_per)
+		memcpy(new_link->per, per, sizeof(new_link->per));
+
+	if (link) {
+		hlist_replace_rcu(&link->node, &new_link->node);
+		kfree_rcu(link, rcu_head);
+	} else {
+		hash_add_rcu(data->links, &new_link->node, rx_idx);
+	}
+	new_link = NULL;
+	res = 0;
+
+out_unlock:
+	spin_unlock_bh(&hwsim_radio_lock);
+	kfree(new_link);
+
+	return res;
+}
+
+static int hwsim_del_link_nl(struct sk_buff *msg, struct genl_info *info)
+{
+	struct mac80211_hwsim_data *data;
+	struct hwsim_link *link;
+	int res = -ENODEV;
+	u32 idx;
+
+	if (!info->attrs[HWSIM_ATTR_RADIO_ID])
+		return -EINVAL;
+	idx = nla_get_u32(info->attrs[HWSIM_ATTR_RADIO_ID]);
+
+	spin_lock_bh(&hwsim_radio_lock);
+	list_for_each_entry(data, &hwsim_radios, list) {
+		if (data->idx != idx)
+			continue;
+
+		res = 0;
+		if (!info->attrs[HWSIM_ATTR_LINK_RX_RADIO_ID]) {
+			hwsim_link_flush(data);
+			break;
+		}
+
+		link = hwsim_link_find(data,
+			nla_get_u32(info->attrs[HWSIM_ATTR_LINK_RX_RADIO_ID]));
+		if (!link) {
+			res = -ENOENT;
+			break;
+		}
+		hash_del_rcu(&link->node);
+		kfree_rcu(link, rcu_head);
+		break;
+	}
+	spin_unlock_bh(&hwsim_radio_lock);
+
+	return res;
+}
+
 /* Generic Netlink operations array */
 static __genl_const struct genl_ops hwsim_ops[] = {
 	{
@@ -3064,6 +4480,18 @@ static __genl_const struct genl_ops hwsim_ops[] = {
 		.doit = hwsim_get_radio_nl,
 		.dumpit = hwsim_dump_radio_nl,
 	},
+	{
+		.cmd = HWSIM_CMD_SET_LINK,
+		.policy = hwsim_genl_policy,
+		.doit = hwsim_set_link_nl,
+		.flags = GENL_ADMIN_PERM,
+	},
+	{
+		.cmd = HWSIM_CMD_DEL_LINK,
+		.policy = hwsim_genl_policy,
+		.doit = hwsim_del_link_nl,
+		.flags = GENL_ADMIN_PERM,
+	},
 };
 
 static void destroy_radio(struct work_struct *work)
@@ -71,6 +71,14 @@ enum hwsim_tx_control_flags {
  * @HWSIM_CMD_DEL_RADIO: destroy a radio, reply is multicasted
  * @HWSIM_CMD_GET_RADIO: fetch information about existing radios, uses:
  *	%HWSIM_ATTR_RADIO_ID
+ * @HWSIM_CMD_SET_LINK: create or update the link from one radio to another
+ *	used when no wmediumd is registered, uses:
+ *	%HWSIM_ATTR_RADIO_ID (transmitter), %HWSIM_ATTR_LINK_RX_RADIO_ID,
+ *	%HWSIM_ATTR_SIGNAL, %HWSIM_ATTR_LINK_PER, %HWSIM_ATTR_LINK_DELAY
+ *	(all but the radio IDs are optional and keep their previous value)
+ * @HWSIM_CMD_DEL_LINK: remove the link between two radios, or all links
+ *	of the transmitter if %HWSIM_ATTR_LINK_RX_RADIO_ID is omitted, uses:
+ *	%HWSIM_ATTR_RADIO_ID, %HWSIM_ATTR_LINK_RX_RADIO_ID (optional)
  * @__HWSIM_CMD_MAX: enum limit
  */
 enum {
@@ -81,6 +89,8 @@ enum {
 	HWSIM_CMD_NEW_RADIO,
 	HWSIM_CMD_DEL_RADIO,
 	HWSIM_CMD_GET_RADIO,
+	HWSIM_CMD_SET_LINK,
+	HWSIM_CMD_DEL_LINK,
 	__HWSIM_CMD_MAX,
 };
 #define HWSIM_CMD_MAX (_HWSIM_CMD_MAX - 1)
@@ -123,6 +133,12 @@ enum {
  * @HWSIM_ATTR_RADIO_NAME: Name of radio, e.g. phy666
  * @HWSIM_ATTR_NO_VIF:  Do not create vif (wlanX) when creating radio.
  * @HWSIM_ATTR_FREQ: Frequency at which packet is transmitted or received.
+ * @HWSIM_ATTR_LINK_RX_RADIO_ID: u32 attribute giving the receiving radio
+ *	of a link, used with %HWSIM_CMD_SET_LINK and %HWSIM_CMD_DEL_LINK
+ * @HWSIM_ATTR_LINK_PER: packet error rate of a link per rate index, an
+ *	array of up to %HWSIM_LINK_MAX_RATES u16 values in units of
+ *	1/%HWSIM_LINK_PER_SCALE; the last value applies to higher indices
+ * @HWSIM_ATTR_LINK_DELAY: u32 extra delivery delay of a link in usecs
  * @__HWSIM_ATTR_MAX: enum limit
  */
 
@@ -148,6 +164,9 @@ enum {
 	HWSIM_ATTR_RADIO_NAME,
 	HWSIM_ATTR_NO_VIF,
 	HWSIM_ATTR_FREQ,
+	HWSIM_ATTR_LINK_RX_RADIO_ID,
+	HWSIM_ATTR_LINK_PER,
+	HWSIM_ATTR_LINK_DELAY,
 	__HWSIM_ATTR_MAX,
 };
 #define HWSIM_ATTR_MAX (__HWSIM_ATTR_MAX - 1)
@@ -170,4 +189,26 @@ struct hwsim_tx_rate {
 	u8 count;
 } __packed;
 
+/**
+ * DOC: In-kernel link model
+ *
+ * Without wmediumd, frames are delivered directly to every radio that
+ * shares a group and channel with the transmitter. A link configured
+ * with %HWSIM_CMD_SET_LINK changes how frames from one radio are seen by
+ * another: the receiver reports the link's signal, each transmission
+ * attempt is lost with the packet error rate of the rate index used and
+ * delivery can be held back by a fixed delay. Frames that need an ACK
+ * walk the retry chain towards their destination, the TX status reports
+ * the attempts actually made.
+ *
+ * Radio pairs without a link keep the perfect medium behaviour, unless
+ * the links_only module parameter is set, in which case they cannot
+ * hear each other at all.
+ */
+
+/* number of rate indices with their own packet error rate in a link */
+#define HWSIM_LINK_MAX_RATES	16
+/* packet error rate that means every attempt is lost */
+#define HWSIM_LINK_PER_SCALE	10000
+
 #endif /* __MAC80211_HWSIM_H */
@@ -1684,7 +1684,12 @@ void wlcore_set_pending_regdomain_ch(struct wl1271 *wl, u16 channel,
 
 	ch_bit_idx = wlcore_get_reg_conf_ch_idx(band, channel);
 
-	if (ch_bit_idx >= 0 && ch_bit_idx <= WL1271_MAX_CHANNELS)
+	/*
+	 * This is called for every beacon received, avoid the atomic
+	 * operation when the channel is already pending.
+	 */
+	if (ch_bit_idx >= 0 && ch_bit_idx <= WL1271_MAX_CHANNELS &&
+	    !test_bit(ch_bit_idx, (long *)wl->reg_ch_conf_pending))
 		set_bit(ch_bit_idx, (long *)wl->reg_ch_conf_pending);
 }
 
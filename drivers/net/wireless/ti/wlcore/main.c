@@ -498,15 +498,21 @@ static int wlcore_fw_status(struct wl1271 *wl, struct wl_fw_status *status)
 
 static void wl1271_flush_deferred_work(struct wl1271 *wl)
 {
+	struct sk_buff_head tx_done;
 	struct sk_buff *skb;
+	unsigned long flags;
 
 	/* Pass all received frames to the network stack */
 	while ((skb = skb_dequeue(&wl->deferred_rx_queue)))
 		ieee80211_rx_ni(wl->hw, skb);
 
-	/* Return sent skbs to the network stack */
-	while ((skb = skb_dequeue(&wl->deferred_tx_queue)))
-		ieee80211_tx_status_ni(wl->hw, skb);
+	/* Return sent skbs to the network stack in one batch */
+	__skb_queue_head_init(&tx_done);
+	spin_lock_irqsave(&wl->deferred_tx_queue.lock, flags);
+	skb_queue_splice_init(&wl->deferred_tx_queue, &tx_done);
+	spin_unlock_irqrestore(&wl->deferred_tx_queue.lock, flags);
+
+	ieee80211_tx_status_list_ni(wl->hw, &tx_done);
 }
 
 static void wl1271_netstack_work(struct work_struct *work)
@@ -3062,6 +3068,9 @@ static int wlcore_unset_assoc(struct wl1271 *wl, struct wl12xx_vif *wlvif)
 		/* use defaults when not associated */
 		wlvif->aid = 0;
 
+		/* the cached RSSI belongs to the old AP */
+		wlvif->avg_rssi_time = 0;
+
 		/* free probe-request template */
 		dev_kfree_skb(wlvif->probereq);
 		wlvif->probereq = NULL;
@@ -4377,6 +4386,7 @@ static int wlcore_clear_bssid(struct wl1271 *wl, struct wl12xx_vif *wlvif)
 	}
 
 	clear_bit(WLVIF_FLAG_IN_USE, &wlvif->flags);
+	wlvif->avg_rssi_time = 0;
 	return 0;
 }
 /* STA/IBSS mode changes */
@@ -4409,6 +4419,7 @@ static void wl1271_bss_info_changed_sta(struct wl1271 *wl,
 		} else {
 			wlcore_unset_assoc(wl, wlvif);
 			wl12xx_cmd_role_stop_sta(wl, wlvif);
+			wlvif->avg_rssi_time = 0;
 		}
 	}
 
@@ -5809,6 +5820,15 @@ static void wlcore_op_sta_statistics(struct ieee80211_hw *hw,
 
 	wl1271_debug(DEBUG_MAC80211, "mac80211 get_rssi");
 
+	/* avoid waking up the chip if a recent enough value is known */
+	if (sinfo->max_age && wlvif->avg_rssi_time &&
+	    time_before(jiffies, wlvif->avg_rssi_time +
+				 msecs_to_jiffies(sinfo->max_age))) {
+		sinfo->filled |= BIT(NL80211_STA_INFO_SIGNAL);
+		sinfo->signal = wlvif->avg_rssi;
+		return;
+	}
+
 	mutex_lock(&wl->mutex);
 
 	if (unlikely(wl->state != WLCORE_STATE_ON))
@@ -5822,6 +5842,9 @@ static void wlcore_op_sta_statistics(struct ieee80211_hw *hw,
 	if (ret < 0)
 		goto out_sleep;
 
+	wlvif->avg_rssi = rssi_dbm;
+	wlvif->avg_rssi_time = jiffies;
+
 	sinfo->filled |= BIT(NL80211_STA_INFO_SIGNAL);
 	sinfo->signal = rssi_dbm;
 
@@ -5850,23 +5873,18 @@ out:
 	return ret;
 }
 
-static int wlcore_op_mesh_get_mbps_estimation(struct ieee80211_hw *hw,
-			struct ieee80211_sta *sta,
-			int *rate)
+static u32 wlcore_op_get_expected_throughput(struct ieee80211_hw *hw,
+					     struct ieee80211_sta *sta)
 {
 	struct wl1271 *wl = hw->priv;
 	struct wl1271_station *wl_sta = (struct wl1271_station *)sta->drv_priv;
 	u8 hlid = wl_sta->hlid;
-	int ret = 1;
-
-	/* return in units of 100kbps */
-	*rate = (wl->links[hlid].fw_rate_mbps * 10);
 
-	/* if rate is 0 then we have no data for caller */
-	if (!*rate)
-		ret = -ENODATA;
+	if (hlid >= WLCORE_MAX_LINKS)
+		return 0;
 
-	return ret;
+	/* return in units of Kbps, 0 if the FW hasn't reported a rate yet */
+	return (u32)ACCESS_ONCE(wl->links[hlid].fw_rate_mbps) * 1000;
 }
 
 /* can't be const, mac80211 writes to this */
@@ -6051,7 +6069,7 @@ static const struct ieee80211_ops wl1271_ops = {
 	.switch_vif_chanctx = wlcore_op_switch_vif_chanctx,
 	.sta_rc_update = wlcore_op_sta_rc_update,
 	.sta_statistics = wlcore_op_sta_statistics,
-	.mesh_get_mbps_estimation = wlcore_op_mesh_get_mbps_estimation,
+	.get_expected_throughput = wlcore_op_get_expected_throughput,
 	CFG80211_TESTMODE_CMD(wl1271_tm_cmd)
 };
 
@@ -446,6 +446,10 @@ struct wl12xx_vif {
 	int rssi_thold;
 	int last_rssi_event;
 
+	/* last average RSSI read from the FW, and when (in jiffies) */
+	s8 avg_rssi;
+	unsigned long avg_rssi_time;
+
 	/* save the current encryption type for auto-arp config */
 	u8 encryption_type;
 	__be32 ip_addr;
@@ -25,12 +25,24 @@
 #ifndef __HCI_CORE_H
 #define __HCI_CORE_H
 
+#include <linux/hash.h>
+#include <linux/jhash.h>
+#include <linux/rculist_nulls.h>
+
 #include <net/bluetooth/hci.h>
 #include <net/bluetooth/hci_sock.h>
 
 /* HCI priority */
 #define HCI_PRIO_MAX	7
 
+/* TX scheduler ready lists, per link type sharing controller buffers */
+enum {
+	HCI_SCHED_ACL,
+	HCI_SCHED_LE,
+	HCI_SCHED_AMP,
+	HCI_SCHED_NUM,
+};
+
 /* HCI Core structures */
 struct inquiry_data {
 	bdaddr_t	bdaddr;
@@ -84,8 +96,43 @@ struct discovery_state {
 	unsigned long		scan_duration;
 };
 
+#define HCI_ADV_DEDUP_SIZE	128
+
+/* Last device found event sent for a LE device, used to drop repeated
+ * advertising reports carrying the same data.
+ */
+struct hci_adv_dedup_entry {
+	bdaddr_t		bdaddr;
+	u8			bdaddr_type;
+	s8			rssi;
+	u32			data_hash;
+	unsigned long		last_sent;
+};
+
+#define HCI_RPA_CACHE_SIZE	64
+
+/* Result of resolving an RPA against the IRK list. A NULL irk records
+ * that no stored IRK matched the address.
+ */
+struct hci_rpa_cache_entry {
+	bdaddr_t		rpa;
+	struct smp_irk		*irk;
+	unsigned long		expires;
+};
+
+#define HCI_CONN_HASH_BITS	5
+#define HCI_CONN_HASH_SIZE	(1 << HCI_CONN_HASH_BITS)
+
+/* Connections are on the list and, for lookups from the RX path, hashed
+ * by handle (once the controller assigned one) and by remote address.
+ * The nulls value of each chain is its slot, so that RCU readers can
+ * detect that the entry they were on moved to a different chain.
+ */
 struct hci_conn_hash {
 	struct list_head list;
+	spinlock_t       hash_lock;
+	struct hlist_nulls_head handle_hash[HCI_CONN_HASH_SIZE];
+	struct hlist_nulls_head ba_hash[HCI_CONN_HASH_SIZE];
 	unsigned int     acl_num;
 	unsigned int     amp_num;
 	unsigned int     sco_num;
@@ -248,6 +295,8 @@ struct hci_dev {
 	__u16		le_max_tx_time;
 	__u16		le_max_rx_len;
 	__u16		le_max_rx_time;
+	__u16		le_adv_dedup_interval;
+	__u8		le_adv_dedup_rssi;
 	__u16		discov_interleaved_timeout;
 	__u16		conn_info_min_age;
 	__u16		conn_info_max_age;
@@ -327,6 +376,15 @@ struct hci_dev {
 	struct work_struct	cmd_work;
 	struct work_struct	tx_work;
 
+	/* Channels with pending data by link type and by the priority of
+	 * their first frame, and the channels that sent since the last
+	 * priority recalculation.
+	 */
+	spinlock_t		tx_sched_lock;
+	struct list_head	tx_ready[HCI_SCHED_NUM][HCI_PRIO_MAX + 1];
+	unsigned long		tx_ready_mask[HCI_SCHED_NUM];
+	struct list_head	tx_sent[HCI_SCHED_NUM];
+
 	struct sk_buff_head	rx_q;
 	struct sk_buff_head	raw_q;
 	struct sk_buff_head	cmd_q;
@@ -358,6 +416,9 @@ struct hci_dev {
 	struct list_head	pend_le_conns;
 	struct list_head	pend_le_reports;
 
+	struct hci_adv_dedup_entry adv_dedup[HCI_ADV_DEDUP_SIZE];
+	__u32			adv_dedup_suppressed;
+
 	struct hci_dev_stats	stat;
 
 	atomic_t		promisc;
@@ -390,6 +451,13 @@ struct hci_dev {
 	struct delayed_work	rpa_expired;
 	bdaddr_t		rpa;
 
+	spinlock_t		rpa_cache_lock;
+	unsigned int		rpa_cache_gen;
+	struct hci_rpa_cache_entry rpa_cache[HCI_RPA_CACHE_SIZE];
+	unsigned long		rpa_cache_hits;
+	unsigned long		rpa_cache_misses;
+	unsigned long		rpa_aes_ops;
+
 	int (*open)(struct hci_dev *hdev);
 	int (*close)(struct hci_dev *hdev);
 	int (*flush)(struct hci_dev *hdev);
@@ -407,6 +475,8 @@ struct hci_dev {
 
 struct hci_conn {
 	struct list_head list;
+	struct hlist_nulls_node handle_node;
+	struct hlist_nulls_node ba_node;
 
 	atomic_t	refcnt;
 
@@ -495,6 +565,9 @@ struct hci_chan {
 	struct sk_buff_head data_q;
 	unsigned int	sent;
 	__u8		state;
+	struct list_head sched_list;
+	struct list_head sent_list;
+	__u8		sched_prio;
 };
 
 struct hci_conn_params {
@@ -661,10 +734,26 @@ static inline bool hci_conn_sc_enabled(struct hci_conn *conn)
 	       test_bit(HCI_CONN_SC_ENABLED, &conn->flags);
 }
 
+static inline u32 hci_conn_handle_slot(__u16 handle)
+{
+	return hash_32(handle, HCI_CONN_HASH_BITS);
+}
+
+static inline u32 hci_conn_ba_slot(const bdaddr_t *ba)
+{
+	return jhash(ba, sizeof(*ba), 0) & (HCI_CONN_HASH_SIZE - 1);
+}
+
 static inline void hci_conn_hash_add(struct hci_dev *hdev, struct hci_conn *c)
 {
 	struct hci_conn_hash *h = &hdev->conn_hash;
 	list_add_rcu(&c->list, &h->list);
+
+	spin_lock(&h->hash_lock);
+	hlist_nulls_add_head_rcu(&c->ba_node,
+				 &h->ba_hash[hci_conn_ba_slot(&c->dst)]);
+	spin_unlock(&h->hash_lock);
+
 	switch (c->type) {
 	case ACL_LINK:
 		h->acl_num++;
@@ -689,6 +778,12 @@ static inline void hci_conn_hash_del(struct hci_dev *hdev, struct hci_conn *c)
 	struct hci_conn_hash *h = &hdev->conn_hash;
 
 	list_del_rcu(&c->list);
+
+	spin_lock(&h->hash_lock);
+	hlist_nulls_del_init_rcu(&c->handle_node);
+	hlist_nulls_del_init_rcu(&c->ba_node);
+	spin_unlock(&h->hash_lock);
+
 	synchronize_rcu();
 
 	switch (c->type) {
@@ -735,20 +830,37 @@ static inline unsigned int hci_conn_count(struct hci_dev *hdev)
 	return c->acl_num + c->amp_num + c->sco_num + c->le_num;
 }
 
+/* Must be called with rcu_read_lock held */
+static inline struct hci_conn *__hci_conn_hash_lookup_handle(
+					struct hci_conn_hash *h, __u16 handle)
+{
+	u32 slot = hci_conn_handle_slot(handle);
+	struct hlist_nulls_node *n;
+	struct hci_conn *c;
+
+begin:
+	hlist_nulls_for_each_entry_rcu(c, n, &h->handle_hash[slot],
+				       handle_node) {
+		if (c->handle == handle)
+			return c;
+	}
+
+	if (get_nulls_value(n) != slot)
+		goto begin;
+
+	return NULL;
+}
+
 static inline __u8 hci_conn_lookup_type(struct hci_dev *hdev, __u16 handle)
 {
-	struct hci_conn_hash *h = &hdev->conn_hash;
 	struct hci_conn *c;
 	__u8 type = INVALID_LINK;
 
 	rcu_read_lock();
 
-	list_for_each_entry_rcu(c, &h->list, list) {
-		if (c->handle == handle) {
-			type = c->type;
-			break;
-		}
-	}
+	c = __hci_conn_hash_lookup_handle(&hdev->conn_hash, handle);
+	if (c)
+		type = c->type;
 
 	rcu_read_unlock();
 
@@ -758,37 +870,36 @@ static inline __u8 hci_conn_lookup_type(struct hci_dev *hdev, __u16 handle)
 static inline struct hci_conn *hci_conn_hash_lookup_handle(struct hci_dev *hdev,
 								__u16 handle)
 {
-	struct hci_conn_hash *h = &hdev->conn_hash;
 	struct hci_conn  *c;
 
 	rcu_read_lock();
-
-	list_for_each_entry_rcu(c, &h->list, list) {
-		if (c->handle == handle) {
-			rcu_read_unlock();
-			return c;
-		}
-	}
+	c = __hci_conn_hash_lookup_handle(&hdev->conn_hash, handle);
 	rcu_read_unlock();
 
-	return NULL;
+	return c;
 }
 
 static inline struct hci_conn *hci_conn_hash_lookup_ba(struct hci_dev *hdev,
 							__u8 type, bdaddr_t *ba)
 {
 	struct hci_conn_hash *h = &hdev->conn_hash;
+	u32 slot = hci_conn_ba_slot(ba);
+	struct hlist_nulls_node *n;
 	struct hci_conn  *c;
 
 	rcu_read_lock();
 
-	list_for_each_entry_rcu(c, &h->list, list) {
+begin:
+	hlist_nulls_for_each_entry_rcu(c, n, &h->ba_hash[slot], ba_node) {
 		if (c->type == type && !bacmp(&c->dst, ba)) {
 			rcu_read_unlock();
 			return c;
 		}
 	}
 
+	if (get_nulls_value(n) != slot)
+		goto begin;
+
 	rcu_read_unlock();
 
 	return NULL;
@@ -799,11 +910,14 @@ static inline struct hci_conn *hci_conn_hash_lookup_le(struct hci_dev *hdev,
 						       __u8 ba_type)
 {
 	struct hci_conn_hash *h = &hdev->conn_hash;
+	u32 slot = hci_conn_ba_slot(ba);
+	struct hlist_nulls_node *n;
 	struct hci_conn  *c;
 
 	rcu_read_lock();
 
-	list_for_each_entry_rcu(c, &h->list, list) {
+begin:
+	hlist_nulls_for_each_entry_rcu(c, n, &h->ba_hash[slot], ba_node) {
 		if (c->type != LE_LINK)
 		       continue;
 
@@ -813,6 +927,9 @@ static inline struct hci_conn *hci_conn_hash_lookup_le(struct hci_dev *hdev,
 		}
 	}
 
+	if (get_nulls_value(n) != slot)
+		goto begin;
+
 	rcu_read_unlock();
 
 	return NULL;
@@ -865,12 +982,17 @@ void hci_sco_setup(struct hci_conn *conn, __u8 status);
 struct hci_conn *hci_conn_add(struct hci_dev *hdev, int type, bdaddr_t *dst,
 			      u8 role);
 int hci_conn_del(struct hci_conn *conn);
+void hci_conn_hash_init(struct hci_dev *hdev);
+void hci_conn_hash_set_handle(struct hci_conn *conn, __u16 handle);
+void hci_conn_hash_set_dst(struct hci_conn *conn, bdaddr_t *dst);
 void hci_conn_hash_flush(struct hci_dev *hdev);
 void hci_conn_check_pending(struct hci_dev *hdev);
 
 struct hci_chan *hci_chan_create(struct hci_conn *conn);
 void hci_chan_del(struct hci_chan *chan);
 void hci_chan_list_flush(struct hci_conn *conn);
+void hci_chan_sched_update(struct hci_chan *chan);
+void hci_chan_sched_del(struct hci_chan *chan);
 struct hci_chan *hci_chan_lookup_handle(struct hci_dev *hdev, __u16 handle);
 
 struct hci_conn *hci_connect_le_scan(struct hci_dev *hdev, bdaddr_t *dst,
@@ -1066,6 +1188,7 @@ struct smp_irk *hci_add_irk(struct hci_dev *hdev, bdaddr_t *bdaddr,
 			    u8 addr_type, u8 val[16], bdaddr_t *rpa);
 void hci_remove_irk(struct hci_dev *hdev, bdaddr_t *bdaddr, u8 addr_type);
 void hci_smp_irks_clear(struct hci_dev *hdev);
+void hci_rpa_cache_flush(struct hci_dev *hdev);
 
 bool hci_bdaddr_is_paired(struct hci_dev *hdev, bdaddr_t *bdaddr, u8 type);
 
@@ -1062,6 +1062,10 @@ struct cfg80211_tid_stats {
  *	from this peer
  * @pertid: per-TID statistics, see &struct cfg80211_tid_stats, using the last
  *	(IEEE80211_NUM_TIDS) index for MSDUs not encapsulated in QoS-MPDUs.
+ * @max_age: set by cfg80211 before calling dump_station(), not filled by
+ *	the driver; if non-zero, values that would have to be queried from the
+ *	device synchronously may instead be reported from a cache as long as
+ *	they are at most this many milliseconds old.
  */
 struct station_info {
 	u32 filled;
@@ -1105,6 +1109,8 @@ struct station_info {
 	u64 rx_beacon;
 	u8 rx_beacon_signal_avg;
 	struct cfg80211_tid_stats pertid[IEEE80211_NUM_TIDS + 1];
+
+	u32 max_age;
 };
 
 /**
@@ -1132,6 +1138,8 @@ int cfg80211_get_station(struct net_device *dev, const u8 *mac_addr,
  * @MONITOR_FLAG_OTHER_BSS: disable BSSID filtering
  * @MONITOR_FLAG_COOK_FRAMES: report frames after processing
  * @MONITOR_FLAG_ACTIVE: active monitor, ACKs frames on its MAC address
+ * @MONITOR_FLAG_BOUND_ONLY: skip frame delivery while nothing is bound to
+ *	the interface
  */
 enum monitor_flags {
 	MONITOR_FLAG_FCSFAIL		= 1<<NL80211_MNTR_FLAG_FCSFAIL,
@@ -1140,6 +1148,7 @@ enum monitor_flags {
 	MONITOR_FLAG_OTHER_BSS		= 1<<NL80211_MNTR_FLAG_OTHER_BSS,
 	MONITOR_FLAG_COOK_FRAMES	= 1<<NL80211_MNTR_FLAG_COOK_FRAMES,
 	MONITOR_FLAG_ACTIVE		= 1<<NL80211_MNTR_FLAG_ACTIVE,
+	MONITOR_FLAG_BOUND_ONLY		= 1<<NL80211_MNTR_FLAG_BOUND_ONLY,
 };
 
 /**
@@ -1615,9 +1624,11 @@ struct cfg80211_inform_bss {
 
 /**
  * struct cfg80211_bss_ie_data - BSS entry IE data
- * @tsf: TSF contained in the frame that carried these IEs
+ * @tsf: TSF contained in the frame that carried these IEs; may be updated
+ *	in place while the IEs are published, so read it with ACCESS_ONCE()
  * @rcu_head: internal use, for freeing
  * @len: length of the IEs
+ * @hash: hash of the IE data, used to detect unchanged IEs quickly
  * @from_beacon: these IEs are known to come from a beacon
  * @data: IE data
  */
@@ -1625,6 +1636,7 @@ struct cfg80211_bss_ies {
 	u64 tsf;
 	struct rcu_head rcu_head;
 	int len;
+	u32 hash;
 	bool from_beacon;
 	u8 data[];
 };
@@ -3803,7 +3815,9 @@ int ieee80211_data_from_8023(struct sk_buff *skb, const u8 *addr,
  *
  * Decode an IEEE 802.11n A-MSDU frame and convert it to a list of
  * 802.3 frames. The @list will be empty if the decode fails. The
- * @skb is consumed after the function returns.
+ * @skb is consumed after the function returns. It must be linear; if its
+ * head is a page fragment, the subframes reference their payload in it
+ * instead of copying it.
  *
  * @skb: The input IEEE 802.11n A-MSDU frame.
  * @list: The output list of 802.3 frames. It must be allocated and
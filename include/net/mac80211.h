@@ -108,6 +108,18 @@
  * ieee80211_tx_dequeue(). Whenever mac80211 adds a new frame to a queue, it
  * calls the .wake_tx_queue driver op.
  *
+ * Within each queue, frames are hashed into flows that are served fairly and
+ * kept short with CoDel, so frames may be dropped (or ECN marked) on dequeue
+ * when they have been waiting too long.
+ *
+ * Which queue to serve next may be left to mac80211: queues with frames are
+ * kept on a list per AC, and ieee80211_next_txq() picks the next one by
+ * deficit round robin over the airtime each station has used, so that slow
+ * stations cannot take most of the medium time. The airtime is taken from
+ * the TX status (&ieee80211_tx_info.status.tx_time if the driver sets it,
+ * an estimate from the expected throughput otherwise) or can be reported by
+ * the driver with ieee80211_sta_register_airtime().
+ *
  * For AP powersave TIM handling, the driver only needs to indicate if it has
  * buffered packets in the driver specific data structures by calling
  * ieee80211_sta_set_buffered(). For frames buffered in the ieee80211_txq
@@ -873,7 +885,7 @@ struct ieee80211_tx_info {
 			struct ieee80211_vif *vif;
 			struct ieee80211_key_conf *hw_key;
 			u32 flags;
-			/* 4 bytes free */
+			u32 enqueue_time;
 		} control;
 		struct {
 			u64 cookie;
@@ -2989,6 +3001,8 @@ enum ieee80211_reconfig_type {
  *	the values (indicating which by setting the filled bitmap), but not
  *	all of them make sense - see the source for which ones are possible.
  *	Statistics that the driver doesn't fill will be filled by mac80211.
+ *	If @sinfo->max_age is set, values cached by the driver that are not
+ *	older than that may be reported without waking up the device.
  *	The callback can sleep.
  *
  * @conf_tx: Configure TX queue parameters (EDCF (aifs, cw_min, cw_max),
@@ -3240,7 +3254,11 @@ enum ieee80211_reconfig_type {
  *
  * @get_expected_throughput: extract the expected throughput towards the
  *	specified station. The returned value is expressed in Kbps. It returns 0
- *	if the RC algorithm does not have proper data to provide.
+ *	if the RC algorithm does not have proper data to provide. This is only
+ *	used by drivers doing rate control in hardware or firmware; mac80211
+ *	uses it wherever the rate control algorithm's estimate would otherwise
+ *	be used (station info, the mesh airtime metric, ...), so it must be
+ *	atomic and cheap.
  *
  * @get_txpower: get current maximum tx power (in dBm) based on configuration
  *	and hardware limits.
@@ -3401,9 +3419,6 @@ struct ieee80211_ops {
 	void (*channel_switch)(struct ieee80211_hw *hw,
 			       struct ieee80211_vif *vif,
 			       struct ieee80211_channel_switch *ch_switch);
-	int (*mesh_get_mbps_estimation)(struct ieee80211_hw *hw,
-							struct ieee80211_sta *sta,
-							int *rate);
 	int (*set_antenna)(struct ieee80211_hw *hw, u32 tx_ant, u32 rx_ant);
 	int (*get_antenna)(struct ieee80211_hw *hw, u32 *tx_ant, u32 *rx_ant);
 
@@ -3487,7 +3502,8 @@ struct ieee80211_ops {
 
 	int (*join_ibss)(struct ieee80211_hw *hw, struct ieee80211_vif *vif);
 	void (*leave_ibss)(struct ieee80211_hw *hw, struct ieee80211_vif *vif);
-	u32 (*get_expected_throughput)(struct ieee80211_sta *sta);
+	u32 (*get_expected_throughput)(struct ieee80211_hw *hw,
+				       struct ieee80211_sta *sta);
 	int (*get_txpower)(struct ieee80211_hw *hw, struct ieee80211_vif *vif,
 			   int *dbm);
 
@@ -3984,6 +4000,44 @@ static inline void ieee80211_tx_status_ni(struct ieee80211_hw *hw,
 	local_bh_enable();
 }
 
+/**
+ * ieee80211_tx_status_list - transmit status callback for a list of frames
+ *
+ * Like ieee80211_tx_status() but reports the status of several frames at
+ * once. Consecutive frames with the same transmitter and receiver address
+ * are handled together, so the station is looked up only once for them and
+ * rate control is updated for all of them in one go. Drivers completing
+ * frames in bursts should keep frames for the same station adjacent.
+ *
+ * This function and ieee80211_tx_status() (or their _ni variants) may be
+ * used side by side, a single frame is just a list of one. As for
+ * ieee80211_tx_status(), calls for a single hardware must be synchronized
+ * against each other, e.g. by making them from the same work or tasklet,
+ * and may not be mixed with ieee80211_tx_status_irqsafe().
+ *
+ * @hw: the hardware the frames were transmitted by
+ * @skbs: the frames that were transmitted, owned by mac80211 after this
+ *	call; the list is empty on return
+ */
+void ieee80211_tx_status_list(struct ieee80211_hw *hw,
+			      struct sk_buff_head *skbs);
+
+/**
+ * ieee80211_tx_status_list_ni - list status callback (in process context)
+ *
+ * Like ieee80211_tx_status_list() but can be called in process context.
+ *
+ * @hw: the hardware the frames were transmitted by
+ * @skbs: the frames that were transmitted, owned by mac80211 after this call
+ */
+static inline void ieee80211_tx_status_list_ni(struct ieee80211_hw *hw,
+					       struct sk_buff_head *skbs)
+{
+	local_bh_disable();
+	ieee80211_tx_status_list(hw, skbs);
+	local_bh_enable();
+}
+
 /**
  * ieee80211_tx_status_irqsafe - IRQ-safe transmit status callback
  *
@@ -5491,4 +5545,57 @@ void ieee80211_unreserve_tid(struct ieee80211_sta *sta, u8 tid);
  */
 struct sk_buff *ieee80211_tx_dequeue(struct ieee80211_hw *hw,
 				     struct ieee80211_txq *txq);
+
+/**
+ * ieee80211_txq_schedule_start - start a scheduling round for an AC
+ *
+ * Each queue is returned at most once by ieee80211_next_txq() per round, so
+ * that a driver looping until it gets %NULL always terminates.
+ *
+ * @hw: pointer as obtained from ieee80211_alloc_hw()
+ * @ac: AC number to start the round for
+ */
+void ieee80211_txq_schedule_start(struct ieee80211_hw *hw, u8 ac);
+
+/**
+ * ieee80211_next_txq - get the next queue to pull frames from
+ *
+ * Returns the next queue with frames for the given AC, by deficit round
+ * robin over the airtime used by the stations. The queue is taken off the
+ * schedule until the driver gives it back with ieee80211_return_txq().
+ *
+ * @hw: pointer as obtained from ieee80211_alloc_hw()
+ * @ac: AC number to return queues for
+ *
+ * Returns the queue, or %NULL if there is none left in this round.
+ */
+struct ieee80211_txq *ieee80211_next_txq(struct ieee80211_hw *hw, u8 ac);
+
+/**
+ * ieee80211_return_txq - return a queue obtained from ieee80211_next_txq()
+ *
+ * The queue is put back on the schedule if it still has frames, including
+ * frames queued while the driver held it. Each queue returned by
+ * ieee80211_next_txq() must be given back, or it is never scheduled again.
+ *
+ * @hw: pointer as obtained from ieee80211_alloc_hw()
+ * @txq: the queue to return
+ */
+void ieee80211_return_txq(struct ieee80211_hw *hw, struct ieee80211_txq *txq);
+
+/**
+ * ieee80211_sta_register_airtime - report airtime used by a station
+ *
+ * Charges the airtime to the station for the scheduling done by
+ * ieee80211_next_txq(). Drivers that know the airtime of transmissions or
+ * receptions more accurately than what mac80211 gets from the TX status
+ * (e.g. for aggregates) can report it here.
+ *
+ * @pubsta: the station
+ * @tid: the TID the airtime was used for
+ * @tx_airtime: TX airtime in usecs
+ * @rx_airtime: RX airtime in usecs
+ */
+void ieee80211_sta_register_airtime(struct ieee80211_sta *pubsta, u8 tid,
+				    u32 tx_airtime, u32 rx_airtime);
 #endif /* MAC80211_H */
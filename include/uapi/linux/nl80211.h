@@ -1790,6 +1790,14 @@ enum nl80211_commands {
  *	between scans. The scan plans are executed sequentially.
  *	Each scan plan is a nested attribute of &enum nl80211_sched_scan_plan.
  *
+ * @NL80211_ATTR_STA_INFO_FILTER: bitmap (u32) of %BIT(NL80211_STA_INFO_*)
+ *	values, used with %NL80211_CMD_GET_STATION dumps to only report those
+ *	attributes in %NL80211_ATTR_STA_INFO. Zero means no filtering.
+ * @NL80211_ATTR_STA_INFO_MAX_AGE: maximum age (u32, in milliseconds) of
+ *	cached driver statistics that may be reported in a
+ *	%NL80211_CMD_GET_STATION dump instead of querying the device for each
+ *	station. If absent or zero, the device is queried as before.
+ *
  * @NUM_NL80211_ATTR: total number of nl80211_attrs available
  * @NL80211_ATTR_MAX: highest attribute number currently defined
  * @__NL80211_ATTR_AFTER_LAST: internal use
@@ -2164,6 +2172,9 @@ enum nl80211_attrs {
 	NL80211_ATTR_MAX_SCAN_PLAN_ITERATIONS,
 	NL80211_ATTR_SCHED_SCAN_PLANS,
 
+	NL80211_ATTR_STA_INFO_FILTER,
+	NL80211_ATTR_STA_INFO_MAX_AGE,
+
 	/* add attributes here, update the policy in nl80211.c */
 
 	__NL80211_ATTR_AFTER_LAST,
@@ -3004,6 +3015,9 @@ enum nl80211_survey_info {
  *	overrides all other flags.
  * @NL80211_MNTR_FLAG_ACTIVE: use the configured MAC address
  *	and ACK incoming unicast packets.
+ * @NL80211_MNTR_FLAG_BOUND_ONLY: only prepare and deliver frames while
+ *	a packet socket is bound to the interface or another device is
+ *	stacked on it; captures on all interfaces don't see its frames.
  *
  * @__NL80211_MNTR_FLAG_AFTER_LAST: internal use
  * @NL80211_MNTR_FLAG_MAX: highest possible monitor flag
@@ -3016,6 +3030,7 @@ enum nl80211_mntr_flags {
 	NL80211_MNTR_FLAG_OTHER_BSS,
 	NL80211_MNTR_FLAG_COOK_FRAMES,
 	NL80211_MNTR_FLAG_ACTIVE,
+	NL80211_MNTR_FLAG_BOUND_ONLY,
 
 	/* keep last */
 	__NL80211_MNTR_FLAG_AFTER_LAST,
@@ -844,7 +844,7 @@ struct hci_conn *hci_connect_le(struct hci_dev *hdev, bdaddr_t *dst,
 
 	if (conn_unfinished) {
 		conn = conn_unfinished;
-		bacpy(&conn->dst, dst);
+		hci_conn_hash_set_dst(conn, dst);
 	} else {
 		conn = hci_conn_add(hdev, LE_LINK, dst, role);
 	}
@@ -1351,6 +1351,47 @@ timer:
 				   msecs_to_jiffies(hdev->idle_timeout));
 }
 
+void hci_conn_hash_init(struct hci_dev *hdev)
+{
+	struct hci_conn_hash *h = &hdev->conn_hash;
+	int i;
+
+	INIT_LIST_HEAD(&h->list);
+	spin_lock_init(&h->hash_lock);
+
+	for (i = 0; i < HCI_CONN_HASH_SIZE; i++) {
+		INIT_HLIST_NULLS_HEAD(&h->handle_hash[i], i);
+		INIT_HLIST_NULLS_HEAD(&h->ba_hash[i], i);
+	}
+}
+
+/* The handle is only known once the controller reported the connection
+ * as complete, the connection isn't found by handle before that.
+ */
+void hci_conn_hash_set_handle(struct hci_conn *conn, __u16 handle)
+{
+	struct hci_conn_hash *h = &conn->hdev->conn_hash;
+
+	spin_lock(&h->hash_lock);
+	hlist_nulls_del_init_rcu(&conn->handle_node);
+	conn->handle = handle;
+	hlist_nulls_add_head_rcu(&conn->handle_node,
+				 &h->handle_hash[hci_conn_handle_slot(handle)]);
+	spin_unlock(&h->hash_lock);
+}
+
+void hci_conn_hash_set_dst(struct hci_conn *conn, bdaddr_t *dst)
+{
+	struct hci_conn_hash *h = &conn->hdev->conn_hash;
+
+	spin_lock(&h->hash_lock);
+	hlist_nulls_del_init_rcu(&conn->ba_node);
+	bacpy(&conn->dst, dst);
+	hlist_nulls_add_head_rcu(&conn->ba_node,
+				 &h->ba_hash[hci_conn_ba_slot(dst)]);
+	spin_unlock(&h->hash_lock);
+}
+
 /* Drop all connection on the device */
 void hci_conn_hash_flush(struct hci_dev *hdev)
 {
@@ -1525,6 +1566,8 @@ struct hci_chan *hci_chan_create(struct hci_conn *conn)
 	chan->conn = hci_conn_get(conn);
 	skb_queue_head_init(&chan->data_q);
 	chan->state = BT_CONNECTED;
+	INIT_LIST_HEAD(&chan->sched_list);
+	INIT_LIST_HEAD(&chan->sent_list);
 
 	list_add_rcu(&chan->list, &conn->chan_list);
 
@@ -1539,6 +1582,7 @@ void hci_chan_del(struct hci_chan *chan)
 	BT_DBG("%s hcon %p chan %p", hdev->name, conn, chan);
 
 	list_del_rcu(&chan->list);
+	hci_chan_sched_del(chan);
 
 	synchronize_rcu();
 
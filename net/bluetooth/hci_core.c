@@ -1102,6 +1102,8 @@ void hci_discovery_set_state(struct hci_dev *hdev, int state)
 	case DISCOVERY_STARTING:
 		break;
 	case DISCOVERY_FINDING:
+		/* Every discovery session reports each device afresh */
+		memset(hdev->adv_dedup, 0, sizeof(hdev->adv_dedup));
 		mgmt_discovering(hdev, 1);
 		break;
 	case DISCOVERY_RESOLVING:
@@ -2292,6 +2294,8 @@ void hci_smp_irks_clear(struct hci_dev *hdev)
 		list_del_rcu(&k->list);
 		kfree_rcu(k, rcu);
 	}
+
+	hci_rpa_cache_flush(hdev);
 }
 
 struct link_key *hci_find_link_key(struct hci_dev *hdev, bdaddr_t *bdaddr)
@@ -2378,28 +2382,99 @@ struct smp_ltk *hci_find_ltk(struct hci_dev *hdev, bdaddr_t *bdaddr,
 	return NULL;
 }
 
+/* Every change to the IRK list must flush the RPA cache, otherwise a
+ * stale negative entry would hide a newly added key and a positive one
+ * could point at a freed key. Bumping the generation keeps a lookup that
+ * raced with the flush from inserting its (possibly stale) result.
+ */
+void hci_rpa_cache_flush(struct hci_dev *hdev)
+{
+	spin_lock_bh(&hdev->rpa_cache_lock);
+	memset(hdev->rpa_cache, 0, sizeof(hdev->rpa_cache));
+	hdev->rpa_cache_gen++;
+	spin_unlock_bh(&hdev->rpa_cache_lock);
+}
+
+static inline u32 hci_rpa_cache_slot(bdaddr_t *rpa)
+{
+	return jhash(rpa, sizeof(*rpa), 0) & (HCI_RPA_CACHE_SIZE - 1);
+}
+
+static bool hci_rpa_cache_lookup(struct hci_dev *hdev, bdaddr_t *rpa,
+				 struct smp_irk **irk, unsigned int *gen)
+{
+	struct hci_rpa_cache_entry *e;
+	bool found = false;
+
+	e = &hdev->rpa_cache[hci_rpa_cache_slot(rpa)];
+
+	spin_lock_bh(&hdev->rpa_cache_lock);
+	if (!bacmp(&e->rpa, rpa) && time_before(jiffies, e->expires)) {
+		*irk = e->irk;
+		found = true;
+		hdev->rpa_cache_hits++;
+	} else {
+		hdev->rpa_cache_misses++;
+	}
+	*gen = hdev->rpa_cache_gen;
+	spin_unlock_bh(&hdev->rpa_cache_lock);
+
+	return found;
+}
+
+static void hci_rpa_cache_insert(struct hci_dev *hdev, bdaddr_t *rpa,
+				 struct smp_irk *irk, unsigned int gen,
+				 unsigned int aes_ops)
+{
+	struct hci_rpa_cache_entry *e;
+
+	e = &hdev->rpa_cache[hci_rpa_cache_slot(rpa)];
+
+	spin_lock_bh(&hdev->rpa_cache_lock);
+	hdev->rpa_aes_ops += aes_ops;
+	if (gen == hdev->rpa_cache_gen) {
+		/* A device keeps its RPA for at most one rotation
+		 * interval, so neither a match nor a miss can be trusted
+		 * for longer than that.
+		 */
+		bacpy(&e->rpa, rpa);
+		e->irk = irk;
+		e->expires = jiffies + msecs_to_jiffies(hdev->rpa_timeout *
+							1000);
+	}
+	spin_unlock_bh(&hdev->rpa_cache_lock);
+}
+
 struct smp_irk *hci_find_irk_by_rpa(struct hci_dev *hdev, bdaddr_t *rpa)
 {
 	struct smp_irk *irk;
+	unsigned int gen, aes_ops = 0;
 
 	rcu_read_lock();
+	if (hci_rpa_cache_lookup(hdev, rpa, &irk, &gen)) {
+		rcu_read_unlock();
+		return irk;
+	}
+
 	list_for_each_entry_rcu(irk, &hdev->identity_resolving_keys, list) {
-		if (!bacmp(&irk->rpa, rpa)) {
-			rcu_read_unlock();
-			return irk;
-		}
+		if (!bacmp(&irk->rpa, rpa))
+			goto done;
 	}
 
 	list_for_each_entry_rcu(irk, &hdev->identity_resolving_keys, list) {
+		aes_ops++;
 		if (smp_irk_matches(hdev, irk->val, rpa)) {
 			bacpy(&irk->rpa, rpa);
-			rcu_read_unlock();
-			return irk;
+			goto done;
 		}
 	}
+	irk = NULL;
+
+done:
+	hci_rpa_cache_insert(hdev, rpa, irk, gen, aes_ops);
 	rcu_read_unlock();
 
-	return NULL;
+	return irk;
 }
 
 struct smp_irk *hci_find_irk_by_addr(struct hci_dev *hdev, bdaddr_t *bdaddr,
@@ -2520,6 +2595,8 @@ struct smp_irk *hci_add_irk(struct hci_dev *hdev, bdaddr_t *bdaddr,
 	memcpy(irk->val, val, 16);
 	bacpy(&irk->rpa, rpa);
 
+	hci_rpa_cache_flush(hdev);
+
 	return irk;
 }
 
@@ -2571,6 +2648,8 @@ void hci_remove_irk(struct hci_dev *hdev, bdaddr_t *bdaddr, u8 addr_type)
 		list_del_rcu(&k->list);
 		kfree_rcu(k, rcu);
 	}
+
+	hci_rpa_cache_flush(hdev);
 }
 
 bool hci_bdaddr_is_paired(struct hci_dev *hdev, bdaddr_t *bdaddr, u8 type)
@@ -3231,6 +3310,7 @@ void hci_copy_identity_address(struct hci_dev *hdev, bdaddr_t *bdaddr,
 struct hci_dev *hci_alloc_dev(void)
 {
 	struct hci_dev *hdev;
+	int i, j;
 
 	hdev = kzalloc(sizeof(*hdev), GFP_KERNEL);
 	if (!hdev)
@@ -3266,6 +3346,8 @@ struct hci_dev *hci_alloc_dev(void)
 	hdev->le_max_tx_time = 0x0148;
 	hdev->le_max_rx_len = 0x001b;
 	hdev->le_max_rx_time = 0x0148;
+	hdev->le_adv_dedup_interval = 0;
+	hdev->le_adv_dedup_rssi = 5;
 
 	hdev->rpa_timeout = HCI_DEFAULT_RPA_TIMEOUT;
 	hdev->discov_interleaved_timeout = DISCOV_INTERLEAVED_TIMEOUT;
@@ -3287,12 +3369,20 @@ struct hci_dev *hci_alloc_dev(void)
 	INIT_LIST_HEAD(&hdev->le_conn_params);
 	INIT_LIST_HEAD(&hdev->pend_le_conns);
 	INIT_LIST_HEAD(&hdev->pend_le_reports);
-	INIT_LIST_HEAD(&hdev->conn_hash.list);
+	hci_conn_hash_init(hdev);
 	INIT_LIST_HEAD(&hdev->adv_instances);
 
 	INIT_WORK(&hdev->rx_work, hci_rx_work);
 	INIT_WORK(&hdev->cmd_work, hci_cmd_work);
 	INIT_WORK(&hdev->tx_work, hci_tx_work);
+
+	spin_lock_init(&hdev->tx_sched_lock);
+	spin_lock_init(&hdev->rpa_cache_lock);
+	for (i = 0; i < HCI_SCHED_NUM; i++) {
+		for (j = 0; j <= HCI_PRIO_MAX; j++)
+			INIT_LIST_HEAD(&hdev->tx_ready[i][j]);
+		INIT_LIST_HEAD(&hdev->tx_sent[i]);
+	}
 	INIT_WORK(&hdev->power_on, hci_power_on);
 	INIT_WORK(&hdev->error_reset, hci_error_reset);
 
@@ -3775,6 +3865,7 @@ void hci_send_acl(struct hci_chan *chan, struct sk_buff *skb, __u16 flags)
 	BT_DBG("%s chan %p flags 0x%4.4x", hdev->name, chan, flags);
 
 	hci_queue_acl(chan, &chan->data_q, skb, flags);
+	hci_chan_sched_update(chan);
 
 	queue_work(hdev->workqueue, &hdev->tx_work);
 }
@@ -3884,46 +3975,110 @@ static void hci_link_tx_to(struct hci_dev *hdev, __u8 type)
 	rcu_read_unlock();
 }
 
+static int hci_sched_idx(__u8 type)
+{
+	switch (type) {
+	case LE_LINK:
+		return HCI_SCHED_LE;
+	case AMP_LINK:
+		return HCI_SCHED_AMP;
+	default:
+		return HCI_SCHED_ACL;
+	}
+}
+
+/* Must be called with hdev->tx_sched_lock held */
+static void __hci_chan_sched_unlink(struct hci_dev *hdev,
+				    struct hci_chan *chan, int idx)
+{
+	if (list_empty(&chan->sched_list))
+		return;
+
+	list_del_init(&chan->sched_list);
+	if (list_empty(&hdev->tx_ready[idx][chan->sched_prio]))
+		__clear_bit(chan->sched_prio, &hdev->tx_ready_mask[idx]);
+}
+
+/* Put the channel on the ready list for the priority of its first frame,
+ * or take it off if nothing is pending, and remember that it sent data
+ * since the last priority recalculation. Must be called after every
+ * change to chan->data_q or chan->sent.
+ */
+void hci_chan_sched_update(struct hci_chan *chan)
+{
+	struct hci_dev *hdev = chan->conn->hdev;
+	int idx = hci_sched_idx(chan->conn->type);
+	struct sk_buff *skb;
+	u8 prio;
+
+	spin_lock_bh(&hdev->tx_sched_lock);
+
+	spin_lock(&chan->data_q.lock);
+	skb = skb_peek(&chan->data_q);
+	prio = skb ? min_t(u32, skb->priority, HCI_PRIO_MAX) : 0;
+	spin_unlock(&chan->data_q.lock);
+
+	if (!skb) {
+		__hci_chan_sched_unlink(hdev, chan, idx);
+	} else if (list_empty(&chan->sched_list) || chan->sched_prio != prio) {
+		__hci_chan_sched_unlink(hdev, chan, idx);
+		list_add_tail(&chan->sched_list, &hdev->tx_ready[idx][prio]);
+		__set_bit(prio, &hdev->tx_ready_mask[idx]);
+		chan->sched_prio = prio;
+	}
+
+	if (chan->sent && list_empty(&chan->sent_list))
+		list_add_tail(&chan->sent_list, &hdev->tx_sent[idx]);
+
+	spin_unlock_bh(&hdev->tx_sched_lock);
+}
+
+void hci_chan_sched_del(struct hci_chan *chan)
+{
+	struct hci_dev *hdev = chan->conn->hdev;
+
+	spin_lock_bh(&hdev->tx_sched_lock);
+	__hci_chan_sched_unlink(hdev, chan, hci_sched_idx(chan->conn->type));
+	list_del_init(&chan->sent_list);
+	spin_unlock_bh(&hdev->tx_sched_lock);
+}
+
+/* Pick the channel with the highest priority data whose connection sent
+ * the least, looking only at the channels that have data of that
+ * priority pending.
+ */
 static struct hci_chan *hci_chan_sent(struct hci_dev *hdev, __u8 type,
 				      int *quote)
 {
-	struct hci_conn_hash *h = &hdev->conn_hash;
-	struct hci_chan *chan = NULL;
-	unsigned int num = 0, min = ~0, cur_prio = 0;
-	struct hci_conn *conn;
-	int cnt, q, conn_num = 0;
+	int idx = hci_sched_idx(type);
+	struct hci_chan *chan = NULL, *tmp;
+	unsigned int num = 0, min = ~0;
+	unsigned long mask;
+	int cnt, q, prio;
 
 	BT_DBG("%s", hdev->name);
 
-	rcu_read_lock();
+	spin_lock_bh(&hdev->tx_sched_lock);
 
-	list_for_each_entry_rcu(conn, &h->list, list) {
-		struct hci_chan *tmp;
+	mask = hdev->tx_ready_mask[idx];
+	while (mask && !chan) {
+		prio = __fls(mask);
+		mask &= ~BIT(prio);
 
-		if (conn->type != type)
-			continue;
+		num = 0;
+		min = ~0;
 
-		if (conn->state != BT_CONNECTED && conn->state != BT_CONFIG)
-			continue;
-
-		conn_num++;
-
-		list_for_each_entry_rcu(tmp, &conn->chan_list, list) {
-			struct sk_buff *skb;
+		list_for_each_entry(tmp, &hdev->tx_ready[idx][prio],
+				    sched_list) {
+			struct hci_conn *conn = tmp->conn;
 
-			if (skb_queue_empty(&tmp->data_q))
+			if (conn->type != type)
 				continue;
 
-			skb = skb_peek(&tmp->data_q);
-			if (skb->priority < cur_prio)
+			if (conn->state != BT_CONNECTED &&
+			    conn->state != BT_CONFIG)
 				continue;
 
-			if (skb->priority > cur_prio) {
-				num = 0;
-				min = ~0;
-				cur_prio = skb->priority;
-			}
-
 			num++;
 
 			if (conn->sent < min) {
@@ -3931,12 +4086,9 @@ static struct hci_chan *hci_chan_sent(struct hci_dev *hdev, __u8 type,
 				chan = tmp;
 			}
 		}
-
-		if (hci_conn_num(hdev, type) == conn_num)
-			break;
 	}
 
-	rcu_read_unlock();
+	spin_unlock_bh(&hdev->tx_sched_lock);
 
 	if (!chan)
 		return NULL;
@@ -3966,54 +4118,58 @@ static struct hci_chan *hci_chan_sent(struct hci_dev *hdev, __u8 type,
 	return chan;
 }
 
+/* Promote the first frame of every channel that has data pending but
+ * didn't get to send since the last recalculation, so that it can't be
+ * starved by higher priority traffic.
+ */
 static void hci_prio_recalculate(struct hci_dev *hdev, __u8 type)
 {
-	struct hci_conn_hash *h = &hdev->conn_hash;
-	struct hci_conn *conn;
-	int num = 0;
+	int idx = hci_sched_idx(type);
+	struct hci_chan *chan, *tmp;
+	int prio;
 
 	BT_DBG("%s", hdev->name);
 
-	rcu_read_lock();
-
-	list_for_each_entry_rcu(conn, &h->list, list) {
-		struct hci_chan *chan;
-
-		if (conn->type != type)
-			continue;
-
-		if (conn->state != BT_CONNECTED && conn->state != BT_CONFIG)
-			continue;
-
-		num++;
+	spin_lock_bh(&hdev->tx_sched_lock);
 
-		list_for_each_entry_rcu(chan, &conn->chan_list, list) {
+	for (prio = 0; prio < HCI_PRIO_MAX - 1; prio++) {
+		list_for_each_entry_safe(chan, tmp, &hdev->tx_ready[idx][prio],
+					 sched_list) {
 			struct sk_buff *skb;
 
-			if (chan->sent) {
-				chan->sent = 0;
+			if (chan->sent || chan->conn->type != type)
 				continue;
-			}
 
-			if (skb_queue_empty(&chan->data_q))
+			if (chan->conn->state != BT_CONNECTED &&
+			    chan->conn->state != BT_CONFIG)
 				continue;
 
 			skb = skb_peek(&chan->data_q);
-			if (skb->priority >= HCI_PRIO_MAX - 1)
+			if (!skb)
 				continue;
 
 			skb->priority = HCI_PRIO_MAX - 1;
 
+			__hci_chan_sched_unlink(hdev, chan, idx);
+			list_add_tail(&chan->sched_list,
+				      &hdev->tx_ready[idx][HCI_PRIO_MAX - 1]);
+			__set_bit(HCI_PRIO_MAX - 1, &hdev->tx_ready_mask[idx]);
+			chan->sched_prio = HCI_PRIO_MAX - 1;
+
 			BT_DBG("chan %p skb %p promoted to %d", chan, skb,
 			       skb->priority);
 		}
-
-		if (hci_conn_num(hdev, type) == num)
-			break;
 	}
 
-	rcu_read_unlock();
+	list_for_each_entry_safe(chan, tmp, &hdev->tx_sent[idx], sent_list) {
+		if (chan->conn->type != type)
+			continue;
 
+		chan->sent = 0;
+		list_del_init(&chan->sent_list);
+	}
+
+	spin_unlock_bh(&hdev->tx_sched_lock);
 }
 
 static inline int __get_blocks(struct hci_dev *hdev, struct sk_buff *skb)
@@ -4064,6 +4220,8 @@ static void hci_sched_acl_pkt(struct hci_dev *hdev)
 			hdev->acl_cnt--;
 			chan->sent++;
 			chan->conn->sent++;
+
+			hci_chan_sched_update(chan);
 		}
 	}
 
@@ -4104,8 +4262,10 @@ static void hci_sched_acl_blk(struct hci_dev *hdev)
 			skb = skb_dequeue(&chan->data_q);
 
 			blocks = __get_blocks(hdev, skb);
-			if (blocks > hdev->block_cnt)
+			if (blocks > hdev->block_cnt) {
+				hci_chan_sched_update(chan);
 				return;
+			}
 
 			hci_conn_enter_active_mode(chan->conn,
 						   bt_cb(skb)->force_active);
@@ -4118,6 +4278,8 @@ static void hci_sched_acl_blk(struct hci_dev *hdev)
 
 			chan->sent += blocks;
 			chan->conn->sent += blocks;
+
+			hci_chan_sched_update(chan);
 		}
 	}
 
@@ -4235,6 +4397,8 @@ static void hci_sched_le(struct hci_dev *hdev)
 			cnt--;
 			chan->sent++;
 			chan->conn->sent++;
+
+			hci_chan_sched_update(chan);
 		}
 	}
 
@@ -847,6 +847,31 @@ static const struct file_operations identity_resolving_keys_fops = {
 	.release	= single_release,
 };
 
+static int rpa_cache_show(struct seq_file *f, void *ptr)
+{
+	struct hci_dev *hdev = f->private;
+
+	spin_lock_bh(&hdev->rpa_cache_lock);
+	seq_printf(f, "hits %lu\n", hdev->rpa_cache_hits);
+	seq_printf(f, "misses %lu\n", hdev->rpa_cache_misses);
+	seq_printf(f, "aes_ops %lu\n", hdev->rpa_aes_ops);
+	spin_unlock_bh(&hdev->rpa_cache_lock);
+
+	return 0;
+}
+
+static int rpa_cache_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, rpa_cache_show, inode->i_private);
+}
+
+static const struct file_operations rpa_cache_fops = {
+	.open		= rpa_cache_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static int long_term_keys_show(struct seq_file *f, void *ptr)
 {
 	struct hci_dev *hdev = f->private;
@@ -1071,6 +1096,62 @@ static int adv_max_interval_get(void *data, u64 *val)
 DEFINE_SIMPLE_ATTRIBUTE(adv_max_interval_fops, adv_max_interval_get,
 			adv_max_interval_set, "%llu\n");
 
+static int adv_dedup_interval_set(void *data, u64 val)
+{
+	struct hci_dev *hdev = data;
+
+	if (val > 0xffff)
+		return -EINVAL;
+
+	hci_dev_lock(hdev);
+	hdev->le_adv_dedup_interval = val;
+	hci_dev_unlock(hdev);
+
+	return 0;
+}
+
+static int adv_dedup_interval_get(void *data, u64 *val)
+{
+	struct hci_dev *hdev = data;
+
+	hci_dev_lock(hdev);
+	*val = hdev->le_adv_dedup_interval;
+	hci_dev_unlock(hdev);
+
+	return 0;
+}
+
+DEFINE_SIMPLE_ATTRIBUTE(adv_dedup_interval_fops, adv_dedup_interval_get,
+			adv_dedup_interval_set, "%llu\n");
+
+static int adv_dedup_rssi_set(void *data, u64 val)
+{
+	struct hci_dev *hdev = data;
+
+	if (val > 127)
+		return -EINVAL;
+
+	hci_dev_lock(hdev);
+	hdev->le_adv_dedup_rssi = val;
+	hci_dev_unlock(hdev);
+
+	return 0;
+}
+
+static int adv_dedup_rssi_get(void *data, u64 *val)
+{
+	struct hci_dev *hdev = data;
+
+	hci_dev_lock(hdev);
+	*val = hdev->le_adv_dedup_rssi;
+	hci_dev_unlock(hdev);
+
+	return 0;
+}
+
+DEFINE_SIMPLE_ATTRIBUTE(adv_dedup_rssi_fops, adv_dedup_rssi_get,
+			adv_dedup_rssi_set, "%llu\n");
+
 DEFINE_QUIRK_ATTRIBUTE(quirk_strict_duplicate_filter,
 		       HCI_QUIRK_STRICT_DUPLICATE_FILTER);
 DEFINE_QUIRK_ATTRIBUTE(quirk_simultaneous_discovery,
@@ -1102,6 +1183,8 @@ void hci_debugfs_create_le(struct hci_dev *hdev)
 			    &white_list_fops);
 	debugfs_create_file("identity_resolving_keys", 0400, hdev->debugfs,
 			    hdev, &identity_resolving_keys_fops);
+	debugfs_create_file("rpa_cache", 0444, hdev->debugfs, hdev,
+			    &rpa_cache_fops);
 	debugfs_create_file("long_term_keys", 0400, hdev->debugfs, hdev,
 			    &long_term_keys_fops);
 	debugfs_create_file("conn_min_interval", 0644, hdev->debugfs, hdev,
@@ -1118,6 +1201,12 @@ void hci_debugfs_create_le(struct hci_dev *hdev)
 			    &adv_min_interval_fops);
 	debugfs_create_file("adv_max_interval", 0644, hdev->debugfs, hdev,
 			    &adv_max_interval_fops);
+	debugfs_create_file("adv_dedup_interval", 0644, hdev->debugfs, hdev,
+			    &adv_dedup_interval_fops);
+	debugfs_create_file("adv_dedup_rssi", 0644, hdev->debugfs, hdev,
+			    &adv_dedup_rssi_fops);
+	debugfs_create_u32("adv_dedup_suppressed", 0444, hdev->debugfs,
+			   &hdev->adv_dedup_suppressed);
 	debugfs_create_u16("discov_interleaved_timeout", 0644, hdev->debugfs,
 			   &hdev->discov_interleaved_timeout);
 
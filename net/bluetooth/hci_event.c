@@ -2146,7 +2146,7 @@ static void hci_conn_complete_evt(struct hci_dev *hdev, struct sk_buff *skb)
 	}
 
 	if (!ev->status) {
-		conn->handle = __le16_to_cpu(ev->handle);
+		hci_conn_hash_set_handle(conn, __le16_to_cpu(ev->handle));
 
 		if (conn->type == ACL_LINK) {
 			conn->state = BT_CONFIG;
@@ -3748,7 +3748,7 @@ static void hci_sync_conn_complete_evt(struct hci_dev *hdev,
 
 	switch (ev->status) {
 	case 0x00:
-		conn->handle = __le16_to_cpu(ev->handle);
+		hci_conn_hash_set_handle(conn, __le16_to_cpu(ev->handle));
 		conn->state  = BT_CONNECTED;
 		conn->type   = ev->link_type;
 
@@ -4345,7 +4345,7 @@ static void hci_phy_link_complete_evt(struct hci_dev *hdev,
 	bredr_hcon = hcon->amp_mgr->l2cap_conn->hcon;
 
 	hcon->state = BT_CONNECTED;
-	bacpy(&hcon->dst, &bredr_hcon->dst);
+	hci_conn_hash_set_dst(hcon, &bredr_hcon->dst);
 
 	hci_conn_hold(hcon);
 	hcon->disc_timeout = HCI_DISCONN_TIMEOUT;
@@ -4528,7 +4528,7 @@ static void hci_le_conn_complete_evt(struct hci_dev *hdev, struct sk_buff *skb)
 	 */
 	irk = hci_get_irk(hdev, &conn->dst, conn->dst_type);
 	if (irk) {
-		bacpy(&conn->dst, &irk->bdaddr);
+		hci_conn_hash_set_dst(conn, &irk->bdaddr);
 		conn->dst_type = irk->addr_type;
 	}
 
@@ -4552,7 +4552,7 @@ static void hci_le_conn_complete_evt(struct hci_dev *hdev, struct sk_buff *skb)
 		mgmt_device_connected(hdev, conn, 0, NULL, 0);
 
 	conn->sec_level = BT_SECURITY_LOW;
-	conn->handle = __le16_to_cpu(ev->handle);
+	hci_conn_hash_set_handle(conn, __le16_to_cpu(ev->handle));
 	conn->state = BT_CONFIG;
 
 	conn->le_conn_interval = le16_to_cpu(ev->interval);
@@ -4716,6 +4716,57 @@ static struct hci_conn *check_pending_le_conn(struct hci_dev *hdev,
 	return NULL;
 }
 
+/* Drop a report if the same device was reported with the same data
+ * within le_adv_dedup_interval milliseconds and its RSSI has not moved
+ * by more than le_adv_dedup_rssi dBm since. Devices that keep
+ * advertising would otherwise wake up userspace for every report.
+ */
+static bool le_adv_is_duplicate(struct hci_dev *hdev, bdaddr_t *bdaddr,
+				u8 bdaddr_type, s8 rssi, u32 flags,
+				u8 *data, u8 len, u8 *scan_rsp,
+				u8 scan_rsp_len)
+{
+	struct hci_adv_dedup_entry *e;
+	unsigned long interval;
+	u32 hash;
+
+	if (!hdev->le_adv_dedup_interval)
+		return false;
+
+	interval = msecs_to_jiffies(hdev->le_adv_dedup_interval);
+	hash = jhash(scan_rsp, scan_rsp_len, jhash(data, len, flags));
+	e = &hdev->adv_dedup[jhash(bdaddr, sizeof(*bdaddr), bdaddr_type) &
+			     (HCI_ADV_DEDUP_SIZE - 1)];
+
+	if (!bacmp(&e->bdaddr, bdaddr) && e->bdaddr_type == bdaddr_type &&
+	    e->data_hash == hash &&
+	    abs(rssi - e->rssi) <= hdev->le_adv_dedup_rssi &&
+	    time_before(jiffies, e->last_sent + interval)) {
+		hdev->adv_dedup_suppressed++;
+		return true;
+	}
+
+	bacpy(&e->bdaddr, bdaddr);
+	e->bdaddr_type = bdaddr_type;
+	e->rssi = rssi;
+	e->data_hash = hash;
+	e->last_sent = jiffies;
+
+	return false;
+}
+
+static void le_device_found(struct hci_dev *hdev, bdaddr_t *bdaddr,
+			    u8 bdaddr_type, s8 rssi, u32 flags, u8 *data,
+			    u8 len, u8 *scan_rsp, u8 scan_rsp_len)
+{
+	if (le_adv_is_duplicate(hdev, bdaddr, bdaddr_type, rssi, flags,
+				data, len, scan_rsp, scan_rsp_len))
+		return;
+
+	mgmt_device_found(hdev, bdaddr, LE_LINK, bdaddr_type, NULL, rssi,
+			  flags, data, len, scan_rsp, scan_rsp_len);
+}
+
 static void process_adv_report(struct hci_dev *hdev, u8 type, bdaddr_t *bdaddr,
 			       u8 bdaddr_type, bdaddr_t *direct_addr,
 			       u8 direct_addr_type, s8 rssi, u8 *data, u8 len)
@@ -4806,8 +4857,8 @@ static void process_adv_report(struct hci_dev *hdev, u8 type, bdaddr_t *bdaddr,
 			flags = MGMT_DEV_FOUND_NOT_CONNECTABLE;
 		else
 			flags = 0;
-		mgmt_device_found(hdev, bdaddr, LE_LINK, bdaddr_type, NULL,
-				  rssi, flags, data, len, NULL, 0);
+		le_device_found(hdev, bdaddr, bdaddr_type, rssi, flags,
+				data, len, NULL, 0);
 		return;
 	}
 
@@ -4846,8 +4897,8 @@ static void process_adv_report(struct hci_dev *hdev, u8 type, bdaddr_t *bdaddr,
 			return;
 		}
 
-		mgmt_device_found(hdev, bdaddr, LE_LINK, bdaddr_type, NULL,
-				  rssi, flags, data, len, NULL, 0);
+		le_device_found(hdev, bdaddr, bdaddr_type, rssi, flags,
+				data, len, NULL, 0);
 		return;
 	}
 
@@ -4862,11 +4913,11 @@ static void process_adv_report(struct hci_dev *hdev, u8 type, bdaddr_t *bdaddr,
 	if (type != LE_ADV_SCAN_RSP || !match) {
 		/* Send out whatever is in the cache, but skip duplicates */
 		if (!match)
-			mgmt_device_found(hdev, &d->last_adv_addr, LE_LINK,
-					  d->last_adv_addr_type, NULL,
-					  d->last_adv_rssi, d->last_adv_flags,
-					  d->last_adv_data,
-					  d->last_adv_data_len, NULL, 0);
+			le_device_found(hdev, &d->last_adv_addr,
+					d->last_adv_addr_type,
+					d->last_adv_rssi, d->last_adv_flags,
+					d->last_adv_data,
+					d->last_adv_data_len, NULL, 0);
 
 		/* If the new report will trigger a SCAN_REQ store it for
 		 * later merging.
@@ -4881,8 +4932,8 @@ static void process_adv_report(struct hci_dev *hdev, u8 type, bdaddr_t *bdaddr,
 		 * the pending report and send out a device found event.
 		 */
 		clear_pending_adv_report(hdev);
-		mgmt_device_found(hdev, bdaddr, LE_LINK, bdaddr_type, NULL,
-				  rssi, flags, data, len, NULL, 0);
+		le_device_found(hdev, bdaddr, bdaddr_type, rssi, flags,
+				data, len, NULL, 0);
 		return;
 	}
 
@@ -4890,9 +4941,9 @@ static void process_adv_report(struct hci_dev *hdev, u8 type, bdaddr_t *bdaddr,
 	 * the new event is a SCAN_RSP. We can therefore proceed with
 	 * sending a merged device found event.
 	 */
-	mgmt_device_found(hdev, &d->last_adv_addr, LE_LINK,
-			  d->last_adv_addr_type, NULL, rssi, d->last_adv_flags,
-			  d->last_adv_data, d->last_adv_data_len, data, len);
+	le_device_found(hdev, &d->last_adv_addr, d->last_adv_addr_type,
+			rssi, d->last_adv_flags, d->last_adv_data,
+			d->last_adv_data_len, data, len);
 	clear_pending_adv_report(hdev);
 }
 
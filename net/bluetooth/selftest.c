@@ -225,6 +225,157 @@ static inline int test_ecdh(void)
 
 #endif
 
+#if IS_ENABLED(CPTCFG_BT_SELFTEST_CONN_HASH)
+
+#define TEST_CONN_MAX		64
+#define TEST_CONN_ROUNDS	1000
+
+static char test_conn_hash_buffer[128];
+
+static ssize_t test_conn_hash_read(struct file *file, char __user *user_buf,
+				   size_t count, loff_t *ppos)
+{
+	return simple_read_from_buffer(user_buf, count, ppos,
+				       test_conn_hash_buffer,
+				       strlen(test_conn_hash_buffer));
+}
+
+static const struct file_operations test_conn_hash_fops = {
+	.open		= simple_open,
+	.read		= test_conn_hash_read,
+	.llseek		= default_llseek,
+};
+
+/* Look up each of the first n connections by handle and by address, and
+ * return the average cost of a lookup in nanoseconds.
+ */
+static int __init test_conn_hash_lookup(struct hci_dev *hdev,
+					struct hci_conn *conns, int n,
+					unsigned long long *ns)
+{
+	ktime_t calltime, delta;
+	int i, round;
+
+	calltime = ktime_get();
+
+	for (round = 0; round < TEST_CONN_ROUNDS; round++) {
+		for (i = 0; i < n; i++) {
+			struct hci_conn *c = &conns[i];
+
+			if (hci_conn_hash_lookup_handle(hdev, c->handle) != c)
+				return -EINVAL;
+
+			if (hci_conn_hash_lookup_le(hdev, &c->dst,
+						    c->dst_type) != c)
+				return -EINVAL;
+		}
+	}
+
+	delta = ktime_sub(ktime_get(), calltime);
+	*ns = div_u64(ktime_to_ns(delta), TEST_CONN_ROUNDS * n * 2);
+
+	return 0;
+}
+
+static int __init test_conn_hash(void)
+{
+	static const int counts[] __initconst = { 1, 8, 32, TEST_CONN_MAX };
+	unsigned long long ns[ARRAY_SIZE(counts)] = { 0 };
+	struct hci_conn *conns;
+	struct hci_dev *hdev;
+	bdaddr_t ba;
+	int i, n = 0, err = -ENOMEM;
+
+	hdev = hci_alloc_dev();
+	if (!hdev)
+		goto done;
+
+	conns = kcalloc(TEST_CONN_MAX, sizeof(*conns), GFP_KERNEL);
+	if (!conns) {
+		hci_free_dev(hdev);
+		goto done;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(counts); i++) {
+		for (; n < counts[i]; n++) {
+			struct hci_conn *c = &conns[n];
+
+			c->hdev = hdev;
+			c->type = LE_LINK;
+			c->dst_type = ADDR_LE_DEV_RANDOM;
+			c->dst.b[0] = n;
+			c->dst.b[5] = 0xc0;
+			hci_conn_hash_add(hdev, c);
+			hci_conn_hash_set_handle(c, 0x0040 + n);
+		}
+
+		err = test_conn_hash_lookup(hdev, conns, n, &ns[i]);
+		if (err) {
+			BT_ERR("Connection lookup with %d connections failed",
+			       n);
+			goto out;
+		}
+	}
+
+	err = -EINVAL;
+
+	if (hci_conn_hash_lookup_handle(hdev, 0x0040 + n)) {
+		BT_ERR("Lookup of unknown handle succeeded");
+		goto out;
+	}
+
+	/* the address changes when an RPA gets resolved */
+	bacpy(&ba, &conns[0].dst);
+	ba.b[4] = 0xff;
+	hci_conn_hash_set_dst(&conns[0], &ba);
+	if (hci_conn_hash_lookup_le(hdev, &ba, ADDR_LE_DEV_RANDOM) !=
+	    &conns[0]) {
+		BT_ERR("Lookup of changed address failed");
+		goto out;
+	}
+
+	hci_conn_hash_del(hdev, &conns[1]);
+	if (hci_conn_hash_lookup_handle(hdev, conns[1].handle) ||
+	    hci_conn_hash_lookup_le(hdev, &conns[1].dst, ADDR_LE_DEV_RANDOM)) {
+		BT_ERR("Lookup of removed connection succeeded");
+		goto out;
+	}
+
+	err = 0;
+
+	BT_INFO("Connection hash test passed (%llu/%llu/%llu/%llu ns for "
+		"%d/%d/%d/%d connections)", ns[0], ns[1], ns[2], ns[3],
+		counts[0], counts[1], counts[2], counts[3]);
+
+out:
+	/* nothing else can see the connections, skip hci_conn_hash_del */
+	kfree(conns);
+	hci_free_dev(hdev);
+
+done:
+	if (!err)
+		snprintf(test_conn_hash_buffer, sizeof(test_conn_hash_buffer),
+			 "PASS (%llu/%llu/%llu/%llu ns)\n",
+			 ns[0], ns[1], ns[2], ns[3]);
+	else
+		snprintf(test_conn_hash_buffer, sizeof(test_conn_hash_buffer),
+			 "FAIL\n");
+
+	debugfs_create_file("selftest_conn_hash", 0444, bt_debugfs, NULL,
+			    &test_conn_hash_fops);
+
+	return err;
+}
+
+#else
+
+static inline int test_conn_hash(void)
+{
+	return 0;
+}
+
+#endif
+
 static int __init run_selftest(void)
 {
 	int err;
@@ -235,6 +386,10 @@ static int __init run_selftest(void)
 	if (err)
 		goto done;
 
+	err = test_conn_hash();
+	if (err)
+		goto done;
+
 	err = bt_selftest_smp();
 
 done:
@@ -799,6 +799,7 @@ static void smp_chan_destroy(struct l2cap_conn *conn)
 		if (smp->remote_irk) {
 			list_del_rcu(&smp->remote_irk->list);
 			kfree_rcu(smp->remote_irk, rcu);
+			hci_rpa_cache_flush(hcon->hdev);
 		}
 	}
 
@@ -1073,7 +1074,7 @@ static void smp_notify_keys(struct l2cap_conn *conn)
 		 * from now on (assuming this is an LE link).
 		 */
 		if (hcon->type == LE_LINK) {
-			bacpy(&hcon->dst, &smp->remote_irk->bdaddr);
+			hci_conn_hash_set_dst(hcon, &smp->remote_irk->bdaddr);
 			hcon->dst_type = smp->remote_irk->addr_type;
 			queue_work(hdev->workqueue, &conn->id_addr_update_work);
 		}
@@ -201,9 +201,9 @@ ieee80211_agg_stop_txq(struct sta_info *sta, int tid)
 	txqi = to_txq_info(txq);
 
 	/* Lock here to protect against further seqno updates on dequeue */
-	spin_lock_bh(&txqi->queue.lock);
+	spin_lock_bh(&sta->local->txq_lock);
 	set_bit(IEEE80211_TXQ_STOP, &txqi->flags);
-	spin_unlock_bh(&txqi->queue.lock);
+	spin_unlock_bh(&sta->local->txq_lock);
 }
 
 static void
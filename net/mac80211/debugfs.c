@@ -64,7 +64,9 @@ DEBUGFS_READONLY_FILE(user_power, "%d",
 DEBUGFS_READONLY_FILE(power, "%d",
 		      local->hw.conf.power_level);
 DEBUGFS_READONLY_FILE(total_ps_buffered, "%d",
-		      local->total_ps_buffered);
+		      atomic_read(&local->total_ps_buffered));
+DEBUGFS_READONLY_FILE(total_ps_buf_bytes, "%u",
+		      local->total_ps_buf_bytes);
 DEBUGFS_READONLY_FILE(wep_iv, "%#08x",
 		      local->wep_iv & 0xffffff);
 DEBUGFS_READONLY_FILE(rate_ctrl_alg, "%s",
@@ -181,6 +183,80 @@ static ssize_t queues_read(struct file *file, char __user *user_buf,
 DEBUGFS_READONLY_FILE_OPS(hwflags);
 DEBUGFS_READONLY_FILE_OPS(queues);
 
+static ssize_t aqm_read(struct file *file, char __user *user_buf,
+			size_t count, loff_t *ppos)
+{
+	struct ieee80211_local *local = file->private_data;
+	char buf[300];
+	int len;
+
+	spin_lock_bh(&local->txq_lock);
+	len = scnprintf(buf, sizeof(buf),
+			"target %u\ninterval %u\necn %d\nlimit %u\n"
+			"quantum %u\nflows %u\nbacklog %u\ndrops %u\n"
+			"marks %u\noverlimit %u\ncollisions %u\n",
+			ieee80211_codel_time_to_us(local->txq_cparams.target),
+			ieee80211_codel_time_to_us(local->txq_cparams.interval),
+			local->txq_cparams.ecn, local->txq_limit,
+			local->txq_quantum, local->txq_flows_cnt,
+			local->txq_backlog, local->txq_codel_drops,
+			local->txq_ecn_marks, local->txq_overlimit,
+			local->txq_collisions);
+	spin_unlock_bh(&local->txq_lock);
+
+	return simple_read_from_buffer(user_buf, count, ppos, buf, len);
+}
+
+/* set one parameter, "target" and "interval" are in usecs */
+static ssize_t aqm_write(struct file *file, const char __user *user_buf,
+			 size_t count, loff_t *ppos)
+{
+	struct ieee80211_local *local = file->private_data;
+	char buf[32], *val;
+	unsigned int v;
+	int ret;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+
+	if (copy_from_user(buf, user_buf, count))
+		return -EFAULT;
+
+	buf[count] = '\0';
+	val = strchr(buf, ' ');
+	if (!val)
+		return -EINVAL;
+	*val++ = '\0';
+
+	ret = kstrtouint(val, 0, &v);
+	if (ret)
+		return ret;
+
+	spin_lock_bh(&local->txq_lock);
+	if (!strcmp(buf, "target") && v)
+		local->txq_cparams.target = ieee80211_codel_us_to_time(v);
+	else if (!strcmp(buf, "interval") && v)
+		local->txq_cparams.interval = ieee80211_codel_us_to_time(v);
+	else if (!strcmp(buf, "ecn"))
+		local->txq_cparams.ecn = !!v;
+	else if (!strcmp(buf, "limit") && v)
+		local->txq_limit = v;
+	else if (!strcmp(buf, "quantum") && v)
+		local->txq_quantum = v;
+	else
+		ret = -EINVAL;
+	spin_unlock_bh(&local->txq_lock);
+
+	return ret ?: count;
+}
+
+static const struct file_operations aqm_ops = {
+	.read = aqm_read,
+	.write = aqm_write,
+	.open = simple_open,
+	.llseek = default_llseek,
+};
+
 /* statistics stuff */
 
 static ssize_t format_devstat_counter(struct ieee80211_local *local,
@@ -246,12 +322,15 @@ void debugfs_hw_add(struct ieee80211_local *local)
 	local->debugfs.keys = debugfs_create_dir("keys", phyd);
 
 	DEBUGFS_ADD(total_ps_buffered);
+	DEBUGFS_ADD(total_ps_buf_bytes);
 	DEBUGFS_ADD(wep_iv);
 	DEBUGFS_ADD(queues);
 #ifdef CONFIG_PM
 	DEBUGFS_ADD_MODE(reset, 0200);
 #endif
 	DEBUGFS_ADD(hwflags);
+	if (local->ops->wake_tx_queue)
+		DEBUGFS_ADD_MODE(aqm, 0600);
 	DEBUGFS_ADD(user_power);
 	DEBUGFS_ADD(power);
 
@@ -280,9 +359,10 @@ void debugfs_hw_add(struct ieee80211_local *local)
 	DEBUGFS_STATS_ADD(rx_handlers_queued);
 	DEBUGFS_STATS_ADD(rx_handlers_drop_nullfunc);
 	DEBUGFS_STATS_ADD(rx_handlers_drop_defrag);
+	DEBUGFS_STATS_ADD(rx_handlers_defrag_evicted);
+	DEBUGFS_STATS_ADD(rx_handlers_defrag_timeout);
 	DEBUGFS_STATS_ADD(tx_expand_skb_head);
 	DEBUGFS_STATS_ADD(tx_expand_skb_head_cloned);
-	DEBUGFS_STATS_ADD(rx_expand_skb_head_defrag);
 	DEBUGFS_STATS_ADD(rx_handlers_fragments);
 	DEBUGFS_STATS_ADD(tx_status_drop);
 #endif
@@ -240,6 +240,7 @@ IEEE80211_IF_FILE_R(hw_queues);
 IEEE80211_IF_FILE(bssid, u.mgd.bssid, MAC);
 IEEE80211_IF_FILE(aid, u.mgd.aid, DEC);
 IEEE80211_IF_FILE(beacon_timeout, u.mgd.beacon_timeout, JIFFIES_TO_MS);
+IEEE80211_IF_FILE(beacons_unchanged, u.mgd.beacons_unchanged, DEC);
 
 static int ieee80211_set_smps(struct ieee80211_sub_if_data *sdata,
 			      enum ieee80211_smps_mode smps_mode)
@@ -542,6 +543,30 @@ IEEE80211_IF_FILE_RW(tsf);
 /* WDS attributes */
 IEEE80211_IF_FILE(peer, u.wds.remote_addr, MAC);
 
+/* monitor attributes */
+static ssize_t ieee80211_if_fmt_sample_rate(
+	const struct ieee80211_sub_if_data *sdata, char *buf, int buflen)
+{
+	return snprintf(buf, buflen, "%u\n", sdata->u.mntr.sample_rate);
+}
+
+static ssize_t ieee80211_if_parse_sample_rate(
+	struct ieee80211_sub_if_data *sdata, const char *buf, int buflen)
+{
+	unsigned int val;
+	int ret;
+
+	ret = kstrtouint(buf, 0, &val);
+	if (ret)
+		return -EINVAL;
+
+	sdata->u.mntr.sample_rate = val;
+	sdata->u.mntr.sample_cnt = 0;
+
+	return buflen;
+}
+IEEE80211_IF_FILE_RW(sample_rate);
+
 #ifdef CPTCFG_MAC80211_MESH
 IEEE80211_IF_FILE(estab_plinks, u.mesh.estab_plinks, ATOMIC);
 
@@ -552,6 +577,8 @@ IEEE80211_IF_FILE(fwded_frames, u.mesh.mshstats.fwded_frames, DEC);
 IEEE80211_IF_FILE(dropped_frames_ttl, u.mesh.mshstats.dropped_frames_ttl, DEC);
 IEEE80211_IF_FILE(dropped_frames_congestion,
 		  u.mesh.mshstats.dropped_frames_congestion, DEC);
+IEEE80211_IF_FILE(mesh_beacons_unchanged, u.mesh.mshstats.beacons_unchanged,
+		  DEC);
 IEEE80211_IF_FILE(dropped_frames_no_route,
 		  u.mesh.mshstats.dropped_frames_no_route, DEC);
 
@@ -625,6 +652,7 @@ static void add_sta_files(struct ieee80211_sub_if_data *sdata)
 	DEBUGFS_ADD(bssid);
 	DEBUGFS_ADD(aid);
 	DEBUGFS_ADD(beacon_timeout);
+	DEBUGFS_ADD(beacons_unchanged);
 	DEBUGFS_ADD_MODE(smps, 0600);
 	DEBUGFS_ADD_MODE(tkip_mic_test, 0200);
 	DEBUGFS_ADD_MODE(beacon_loss, 0200);
@@ -653,6 +681,11 @@ static void add_wds_files(struct ieee80211_sub_if_data *sdata)
 	DEBUGFS_ADD(peer);
 }
 
+static void add_monitor_files(struct ieee80211_sub_if_data *sdata)
+{
+	DEBUGFS_ADD_MODE(sample_rate, 0600);
+}
+
 #ifdef CPTCFG_MAC80211_MESH
 
 static void add_mesh_files(struct ieee80211_sub_if_data *sdata)
@@ -674,6 +707,8 @@ static void add_mesh_stats(struct ieee80211_sub_if_data *sdata)
 	MESHSTATS_ADD(dropped_frames_ttl);
 	MESHSTATS_ADD(dropped_frames_no_route);
 	MESHSTATS_ADD(dropped_frames_congestion);
+	debugfs_create_file("beacons_unchanged", 0400, dir, sdata,
+			    &mesh_beacons_unchanged_ops);
 #undef MESHSTATS_ADD
 }
 
@@ -749,6 +784,9 @@ static void add_files(struct ieee80211_sub_if_data *sdata)
 	case NL80211_IFTYPE_WDS:
 		add_wds_files(sdata);
 		break;
+	case NL80211_IFTYPE_MONITOR:
+		add_monitor_files(sdata);
+		break;
 	default:
 		break;
 	}
@@ -207,6 +207,90 @@ static ssize_t sta_agg_status_write(struct file *file, const char __user *userbu
 }
 STA_OPS_RW(agg_status);
 
+static ssize_t sta_agg_reorder_read(struct file *file, char __user *userbuf,
+				    size_t count, loff_t *ppos)
+{
+	char buf[32 + IEEE80211_NUM_TIDS * 48], *p = buf;
+	int i;
+	struct sta_info *sta = file->private_data;
+	struct tid_ampdu_rx *tid_rx;
+
+	p += scnprintf(p, sizeof(buf) + buf - p,
+		       "TID\tstored\tholes\ttimeouts\tdrops\n");
+
+	rcu_read_lock();
+	for (i = 0; i < IEEE80211_NUM_TIDS; i++) {
+		tid_rx = rcu_dereference(sta->ampdu_mlme.tid_rx[i]);
+		if (!tid_rx)
+			continue;
+
+		p += scnprintf(p, sizeof(buf) + buf - p,
+			       "%02d\t%u\t%u\t%u\t\t%u\n", i,
+			       tid_rx->stored_mpdu_num, tid_rx->reorder_holes,
+			       tid_rx->reorder_timeouts, tid_rx->reorder_drops);
+	}
+	rcu_read_unlock();
+
+	return simple_read_from_buffer(userbuf, count, ppos, buf, p - buf);
+}
+STA_OPS(agg_reorder);
+
+static ssize_t sta_aqm_read(struct file *file, char __user *userbuf,
+			    size_t count, loff_t *ppos)
+{
+	char buf[64 + IEEE80211_NUM_TIDS * 64], *p = buf;
+	struct sta_info *sta = file->private_data;
+	struct ieee80211_local *local = sta->local;
+	int i;
+
+	if (!sta->sta.txq[0])
+		return 0;
+
+	p += scnprintf(p, sizeof(buf) + buf - p,
+		       "TID\tbytes\tpackets\tdrops\tmarks\toverlimit\t"
+		       "collisions\n");
+
+	spin_lock_bh(&local->txq_lock);
+	for (i = 0; i < IEEE80211_NUM_TIDS; i++) {
+		struct txq_info *txqi = to_txq_info(sta->sta.txq[i]);
+
+		p += scnprintf(p, sizeof(buf) + buf - p,
+			       "%02d\t%u\t%u\t%u\t%u\t%u\t\t%u\n", i,
+			       txqi->backlog_bytes, txqi->backlog_packets,
+			       txqi->codel_drops, txqi->ecn_marks,
+			       txqi->overlimit, txqi->collisions);
+	}
+	spin_unlock_bh(&local->txq_lock);
+
+	return simple_read_from_buffer(userbuf, count, ppos, buf, p - buf);
+}
+STA_OPS(aqm);
+
+static ssize_t sta_airtime_read(struct file *file, char __user *userbuf,
+				size_t count, loff_t *ppos)
+{
+	char buf[64 + IEEE80211_NUM_ACS * 64], *p = buf;
+	struct sta_info *sta = file->private_data;
+	struct ieee80211_local *local = sta->local;
+	int ac;
+
+	p += scnprintf(p, sizeof(buf) + buf - p,
+		       "AC\tRX airtime\tTX airtime\tdeficit\n");
+
+	for (ac = 0; ac < IEEE80211_NUM_ACS; ac++) {
+		spin_lock_bh(&local->active_txq_lock[ac]);
+		p += scnprintf(p, sizeof(buf) + buf - p,
+			       "%d\t%llu\t%llu\t%lld\n", ac,
+			       sta->airtime[ac].rx_airtime,
+			       sta->airtime[ac].tx_airtime,
+			       sta->airtime[ac].deficit);
+		spin_unlock_bh(&local->active_txq_lock[ac]);
+	}
+
+	return simple_read_from_buffer(userbuf, count, ppos, buf, p - buf);
+}
+STA_OPS(airtime);
+
 static ssize_t sta_ht_capa_read(struct file *file, char __user *userbuf,
 				size_t count, loff_t *ppos)
 {
@@ -363,11 +447,18 @@ void ieee80211_sta_debugfs_add(struct sta_info *sta)
 	DEBUGFS_ADD(num_ps_buf_frames);
 	DEBUGFS_ADD(last_seq_ctrl);
 	DEBUGFS_ADD(agg_status);
+	DEBUGFS_ADD(agg_reorder);
+	if (local->ops->wake_tx_queue) {
+		DEBUGFS_ADD(aqm);
+		DEBUGFS_ADD(airtime);
+	}
 	DEBUGFS_ADD(ht_capa);
 	DEBUGFS_ADD(vht_capa);
 
 	DEBUGFS_ADD_COUNTER(rx_duplicates, rx_stats.num_duplicates);
 	DEBUGFS_ADD_COUNTER(rx_fragments, rx_stats.fragments);
+	DEBUGFS_ADD_COUNTER(rx_frag_evicted, rx_stats.frag_evicted);
+	DEBUGFS_ADD_COUNTER(rx_frag_timeouts, rx_stats.frag_timeouts);
 	DEBUGFS_ADD_COUNTER(tx_filtered, status_stats.filtered);
 
 	if (sizeof(sta->driver_buffered_tids) == sizeof(u32))
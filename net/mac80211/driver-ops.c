@@ -62,7 +62,7 @@ int drv_add_interface(struct ieee80211_local *local,
 	if (WARN_ON(sdata->vif.type == NL80211_IFTYPE_AP_VLAN ||
 		    (sdata->vif.type == NL80211_IFTYPE_MONITOR &&
 		     !ieee80211_hw_check(&local->hw, WANT_MONITOR_VIF) &&
-		     !(sdata->u.mntr_flags & MONITOR_FLAG_ACTIVE))))
+		     !(sdata->u.mntr.flags & MONITOR_FLAG_ACTIVE))))
 		return -EINVAL;
 
 	trace_drv_add_interface(local, sdata);
@@ -308,15 +308,3 @@ int drv_ampdu_action(struct ieee80211_local *local,
 	return ret;
 }
 
-int drv_mesh_get_mbps_estimation(struct ieee80211_local *local,
-	       struct ieee80211_sta *sta,
-		   int *rate)
-{
-	int ret = -EOPNOTSUPP;
-
-	if (local->ops->mesh_get_mbps_estimation)
-		ret = local->ops->mesh_get_mbps_estimation(&local->hw, sta, rate);
-
-	return ret;
-}
-
@@ -468,7 +468,7 @@ static void ieee80211_sta_join_ibss(struct ieee80211_sub_if_data *sdata,
 
 	rcu_read_lock();
 	ies = rcu_dereference(cbss->ies);
-	tsf = ies->tsf;
+	tsf = ACCESS_ONCE(ies->tsf);
 	rcu_read_unlock();
 
 	__ieee80211_sta_join_ibss(sdata, cbss->bssid,
@@ -507,7 +507,7 @@ int ieee80211_ibss_csa_beacon(struct ieee80211_sub_if_data *sdata,
 
 	rcu_read_lock();
 	ies = rcu_dereference(cbss->ies);
-	tsf = ies->tsf;
+	tsf = ACCESS_ONCE(ies->tsf);
 	rcu_read_unlock();
 	cfg80211_put_bss(sdata->local->hw.wiphy, cbss);
 
@@ -42,21 +42,14 @@ struct ieee80211_local;
  * associated stations are using power saving. */
 #define AP_MAX_BC_BUFFER 128
 
-/* Maximum number of frames buffered to all STAs, including multicast frames.
- * Note: increasing this limit increases the potential memory requirement. Each
- * frame can be up to about 2 kB long. */
-#define TOTAL_MAX_TX_BUFFER 512
+/* Maximum memory used for frames buffered to all power saving STAs, the
+ * broadcast/multicast buffers are bounded by AP_MAX_BC_BUFFER instead. */
+#define TOTAL_MAX_PS_BUF_BYTES (1024 * 1024)
 
 /* Required encryption head and tailroom */
 #define IEEE80211_ENCRYPT_HEADROOM 8
 #define IEEE80211_ENCRYPT_TAILROOM 18
 
-/* IEEE 802.11 (Ch. 9.5 Defragmentation) requires support for concurrent
- * reception of at least three fragmented frames. This limit can be increased
- * by changing this define, at the cost of slower frame reassembly and
- * increased memory use (about 2 kB of RAM per entry). */
-#define IEEE80211_FRAGMENT_MAX 4
-
 /* power level hasn't been configured (or set to automatic) */
 #define IEEE80211_UNSET_POWER_LEVEL	INT_MIN
 
@@ -85,18 +78,6 @@ struct ieee80211_local;
 
 #define IEEE80211_DEAUTH_FRAME_LEN	(24 /* hdr */ + 2 /* reason */)
 
-struct ieee80211_fragment_entry {
-	struct sk_buff_head skb_list;
-	unsigned long first_frag_time;
-	u16 seq;
-	u16 extra_len;
-	u16 last_frag;
-	u8 rx_queue;
-	bool check_sequential_pn; /* needed for CCMP/GCMP */
-	u8 last_pn[6]; /* PN of the last fragment if CCMP was used */
-};
-
-
 struct ieee80211_bss {
 	u32 device_ts_beacon, device_ts_presp;
 
@@ -313,6 +294,7 @@ struct mesh_stats {
 	__u32 dropped_frames_ttl;	/* Not transmitted since mesh_ttl == 0*/
 	__u32 dropped_frames_no_route;	/* Not transmitted, no route found */
 	__u32 dropped_frames_congestion;/* Not forwarded due to congestion */
+	__u32 beacons_unchanged;	/* Beacons processed without parsing */
 };
 
 #define PREQ_Q_F_START		0x1
@@ -463,6 +445,8 @@ struct ieee80211_if_managed {
 
 	bool beacon_crc_valid;
 	u32 beacon_crc;
+	u32 beacon_raw_crc;
+	unsigned int beacons_unchanged;
 
 	bool status_acked;
 	bool status_received;
@@ -602,6 +586,19 @@ struct ieee80211_if_ocb {
 	bool joined;
 };
 
+/**
+ * struct ieee80211_if_mntr - monitor interface data
+ *
+ * @flags: monitor flags, see &enum monitor_flags
+ * @sample_rate: deliver only one in this many frames, 0 or 1 for all
+ * @sample_cnt: frames skipped since the last delivered one
+ */
+struct ieee80211_if_mntr {
+	u32 flags;
+	unsigned int sample_rate;
+	unsigned int sample_cnt;
+};
+
 /**
  * struct ieee80211_mesh_sync_ops - Extensible synchronization framework interface
  *
@@ -803,16 +800,87 @@ struct mac80211_qos_map {
 enum txq_info_flags {
 	IEEE80211_TXQ_STOP,
 	IEEE80211_TXQ_AMPDU,
+	IEEE80211_TXQ_SCHED_HELD,
 };
 
-struct txq_info {
+/*
+ * CoDel state of a flow, times are in units of 1024 ns (see txq.c)
+ */
+struct ieee80211_codel_vars {
+	u32 count;
+	u32 lastcount;
+	bool dropping;
+	u16 rec_inv_sqrt;
+	u32 first_above_time;
+	u32 drop_next;
+};
+
+struct ieee80211_codel_params {
+	u32 target;
+	u32 interval;
+	bool ecn;
+};
+
+/*
+ * A flow of an intermediate TX queue. The flows live in a table shared by
+ * all queues of a device (plus one default flow per queue), and a flow is
+ * owned by one queue (@txqi) while it has frames; protected by
+ * local->txq_lock.
+ */
+struct txq_flow {
+	struct txq_info *txqi;
+	struct list_head flowchain;
 	struct sk_buff_head queue;
+	struct ieee80211_codel_vars cvars;
+	int deficit;
+	u32 backlog;
+};
+
+struct txq_info {
+	struct txq_flow def_flow;
+	struct list_head new_flows;
+	struct list_head old_flows;
+	u32 backlog_bytes;
+	u32 backlog_packets;
+	u32 codel_drops;
+	u32 ecn_marks;
+	u32 overlimit;
+	u32 collisions;
+	struct list_head schedule_order;
+	u16 schedule_round;
 	unsigned long flags;
 
 	/* keep last! */
 	struct ieee80211_txq txq;
 };
 
+/*
+ * Per-CPU cache of the station last found for a received data frame, used
+ * to skip the station hash lookup for bursts from the same transmitter. An
+ * entry is only valid while @gen matches local->rx_sta_cache_gen, which is
+ * bumped whenever a station is added to or removed from the hash table.
+ */
+struct ieee80211_rx_sta_cache {
+	struct sta_info *sta;
+	unsigned int gen;
+	u8 addr[ETH_ALEN];
+};
+
+/*
+ * Per hardware queue drain of local->pending[]. The tasklet moves the
+ * queue onto @drain in one go and transmits from there without holding
+ * queue_stop_reason_lock; @draining (protected by that lock) tells the
+ * TX path that frames are still outstanding even if the pending queue
+ * itself looks empty. @drain is only touched by the tasklet.
+ */
+struct ieee80211_pending_queue {
+	struct tasklet_struct tasklet;
+	struct sk_buff_head drain;
+	struct ieee80211_local *local;
+	u8 queue;
+	bool draining;
+};
+
 struct ieee80211_sub_if_data {
 	struct list_head list;
 
@@ -835,9 +903,12 @@ struct ieee80211_sub_if_data {
 
 	char name[IFNAMSIZ];
 
-	/* Fragment table for host-based reassembly */
-	struct ieee80211_fragment_entry	fragments[IEEE80211_FRAGMENT_MAX];
-	unsigned int fragment_next;
+	/* Fragment table for frames from transmitters without a station */
+	struct ieee80211_fragment_cache frags;
+
+	/* last station returned by index for dumps, under local->sta_mtx */
+	struct sta_info *dump_sta;
+	int dump_sta_idx, dump_sta_gen;
 
 	/* TID bitmap for NoAck policy */
 	u16 noack_map;
@@ -911,7 +982,7 @@ struct ieee80211_sub_if_data {
 		struct ieee80211_if_ibss ibss;
 		struct ieee80211_if_mesh mesh;
 		struct ieee80211_if_ocb ocb;
-		u32 mntr_flags;
+		struct ieee80211_if_mntr mntr;
 	} u;
 
 #ifdef CPTCFG_MAC80211_DEBUGFS
@@ -1195,12 +1266,32 @@ struct ieee80211_local {
 	struct rhashtable sta_hash;
 	struct timer_list sta_cleanup;
 	int sta_generation;
+	struct ieee80211_rx_sta_cache __percpu *rx_sta_cache;
+	unsigned int rx_sta_cache_gen;
 
 	struct sk_buff_head pending[IEEE80211_MAX_QUEUES];
-	struct tasklet_struct tx_pending_tasklet;
+	struct ieee80211_pending_queue tx_pending[IEEE80211_MAX_QUEUES];
 
 	atomic_t agg_queue_stop[IEEE80211_MAX_QUEUES];
 
+	/* FQ-CoDel state of the intermediate TX queues, see txq.c */
+	spinlock_t txq_lock;
+	struct txq_flow *txq_flows;
+	u32 txq_flows_cnt;
+	u32 txq_backlog;
+	u32 txq_limit;
+	u32 txq_quantum;
+	struct ieee80211_codel_params txq_cparams;
+	u32 txq_codel_drops;
+	u32 txq_ecn_marks;
+	u32 txq_overlimit;
+	u32 txq_collisions;
+
+	/* queues with frames, in airtime DRR order, see ieee80211_next_txq() */
+	spinlock_t active_txq_lock[IEEE80211_NUM_ACS];
+	struct list_head active_txqs[IEEE80211_NUM_ACS];
+	u16 schedule_round[IEEE80211_NUM_ACS];
+
 	/* number of interfaces with allmulti RX */
 	atomic_t iff_allmultis;
 
@@ -1286,9 +1377,10 @@ struct ieee80211_local {
 	unsigned int rx_handlers_queued;
 	unsigned int rx_handlers_drop_nullfunc;
 	unsigned int rx_handlers_drop_defrag;
+	unsigned int rx_handlers_defrag_evicted;
+	unsigned int rx_handlers_defrag_timeout;
 	unsigned int tx_expand_skb_head;
 	unsigned int tx_expand_skb_head_cloned;
-	unsigned int rx_expand_skb_head_defrag;
 	unsigned int rx_handlers_fragments;
 	unsigned int tx_status_drop;
 #define I802_DEBUG_INC(c) (c)++
@@ -1297,9 +1389,22 @@ struct ieee80211_local {
 #endif /* CPTCFG_MAC80211_DEBUG_COUNTERS */
 
 
-	int total_ps_buffered; /* total number of all buffered unicast and
-				* multicast packets for power saving stations
-				*/
+	/*
+	 * Total number of all buffered unicast and multicast packets for
+	 * power saving stations. Atomic since the unicast buffers are
+	 * accounted under ps_buf_lock and the multicast ones under the
+	 * bc_buf queue locks or not at all.
+	 */
+	atomic_t total_ps_buffered;
+
+	/*
+	 * Unicast powersave buffering: memory used by all stations and the
+	 * stations with frames buffered, in the order they started buffering
+	 * so the longest waiting one is evicted from first.
+	 */
+	spinlock_t ps_buf_lock;
+	unsigned int total_ps_buf_bytes;
+	struct list_head ps_buf_stations;
 
 	bool pspolling;
 	bool offchannel_ps_enabled;
@@ -1626,8 +1731,57 @@ static inline bool ieee80211_sdata_running(struct ieee80211_sub_if_data *sdata)
 	return test_bit(SDATA_STATE_RUNNING, &sdata->state);
 }
 
+/*
+ * Packet sockets bound to the monitor interface (ETH_P_ALL ones on
+ * ptype_all, protocol specific ones on ptype_specific) and rx_handlers
+ * (bridge, macvlan, ...) are visible here, taps on all interfaces are not.
+ */
+static inline bool
+ieee80211_mntr_has_listeners(struct ieee80211_sub_if_data *sdata)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,0,0)
+	return !list_empty(&sdata->dev->ptype_all) ||
+	       !list_empty(&sdata->dev->ptype_specific) ||
+	       rcu_access_pointer(sdata->dev->rx_handler);
+#else
+	return true;
+#endif
+}
+
+/*
+ * Whether a frame is to be delivered to this interface as a monitor
+ * frame, checked before radiotap is built or the frame copied for it.
+ * Advances the sampling counter, so call it only once per frame; races
+ * between RX and TX status on the counter only skew the sampling.
+ */
+static inline bool
+ieee80211_mntr_wants_frame(struct ieee80211_sub_if_data *sdata, bool cooked)
+{
+	struct ieee80211_if_mntr *mntr = &sdata->u.mntr;
+
+	if (sdata->vif.type != NL80211_IFTYPE_MONITOR ||
+	    !ieee80211_sdata_running(sdata))
+		return false;
+
+	if (mntr->flags & MONITOR_FLAG_COOK_FRAMES)
+		return cooked;
+
+	if (mntr->flags & MONITOR_FLAG_BOUND_ONLY &&
+	    !ieee80211_mntr_has_listeners(sdata))
+		return false;
+
+	if (mntr->sample_rate > 1) {
+		if (++mntr->sample_cnt < mntr->sample_rate)
+			return false;
+		mntr->sample_cnt = 0;
+	}
+
+	return true;
+}
+
 /* tx handling */
 void ieee80211_clear_tx_pending(struct ieee80211_local *local);
+void ieee80211_kill_tx_pending(struct ieee80211_local *local);
 void ieee80211_tx_pending(unsigned long data);
 netdev_tx_t ieee80211_monitor_start_xmit(struct sk_buff *skb,
 					 struct net_device *dev);
@@ -1699,6 +1853,8 @@ void ieee80211_stop_tx_ba_cb(struct ieee80211_vif *vif, u8 *ra, u8 tid);
 void ieee80211_ba_session_work(struct work_struct *work);
 void ieee80211_tx_ba_session_handle_start(struct sta_info *sta, int tid);
 void ieee80211_release_reorder_timeout(struct sta_info *sta, int tid);
+void ieee80211_init_frag_cache(struct ieee80211_fragment_cache *cache);
+void ieee80211_destroy_frag_cache(struct ieee80211_fragment_cache *cache);
 
 u8 ieee80211_mcs_to_chains(const struct ieee80211_mcs_info *mcs);
 
@@ -1825,21 +1981,8 @@ static inline void ieee802_11_parse_elems(const u8 *start, size_t len,
 {
 	ieee802_11_parse_elems_crc(start, len, action, elems, 0, 0);
 }
-
-static inline bool ieee80211_rx_reorder_ready(struct sk_buff_head *frames)
-{
-	struct sk_buff *tail = skb_peek_tail(frames);
-	struct ieee80211_rx_status *status;
-
-	if (!tail)
-		return false;
-
-	status = IEEE80211_SKB_RXCB(tail);
-	if (status->flag & RX_FLAG_AMSDU_MORE)
-		return false;
-
-	return true;
-}
+u32 ieee802_11_beacon_crc(const u8 *start, size_t len,
+			  struct ieee802_11_elems *elems, u32 crc);
 
 extern const int ieee802_1d_to_ac[8];
 
@@ -1923,6 +2066,23 @@ static inline bool ieee80211_can_run_worker(struct ieee80211_local *local)
 void ieee80211_init_tx_queue(struct ieee80211_sub_if_data *sdata,
 			     struct sta_info *sta,
 			     struct txq_info *txq, int tid);
+
+/* FQ-CoDel intermediate queues */
+u32 ieee80211_codel_us_to_time(u32 us);
+u32 ieee80211_codel_time_to_us(u32 time);
+int ieee80211_txq_setup_flows(struct ieee80211_local *local);
+void ieee80211_txq_teardown_flows(struct ieee80211_local *local);
+void ieee80211_txq_flow_init(struct txq_flow *flow);
+void ieee80211_txq_enqueue(struct ieee80211_local *local,
+			   struct txq_info *txqi, struct sk_buff *skb);
+struct sk_buff *ieee80211_txq_dequeue(struct ieee80211_local *local,
+				      struct txq_info *txqi);
+void ieee80211_txq_purge(struct ieee80211_local *local,
+			 struct txq_info *txqi);
+void ieee80211_schedule_txq(struct ieee80211_local *local,
+			    struct txq_info *txqi);
+void ieee80211_unschedule_txq(struct ieee80211_local *local,
+			      struct txq_info *txqi);
 void ieee80211_send_auth(struct ieee80211_sub_if_data *sdata,
 			 u16 transaction, u16 auth_alg, u16 status,
 			 const u8 *extra, size_t extra_len, const u8 *bssid,
@@ -609,6 +609,13 @@ struct ieee80211_hw *ieee80211_alloc_hw_nm(size_t priv_data_len,
 	spin_lock_init(&local->filter_lock);
 	spin_lock_init(&local->rx_path_lock);
 	spin_lock_init(&local->queue_stop_reason_lock);
+	spin_lock_init(&local->txq_lock);
+	spin_lock_init(&local->ps_buf_lock);
+	INIT_LIST_HEAD(&local->ps_buf_stations);
+	for (i = 0; i < IEEE80211_NUM_ACS; i++) {
+		spin_lock_init(&local->active_txq_lock[i]);
+		INIT_LIST_HEAD(&local->active_txqs[i]);
+	}
 
 	INIT_LIST_HEAD(&local->chanctx_list);
 	mutex_init(&local->chanctx_mtx);
@@ -639,11 +646,17 @@ struct ieee80211_hw *ieee80211_alloc_hw_nm(size_t priv_data_len,
 	idr_init(&local->ack_status_frames);
 
 	for (i = 0; i < IEEE80211_MAX_QUEUES; i++) {
+		struct ieee80211_pending_queue *pq = &local->tx_pending[i];
+
 		skb_queue_head_init(&local->pending[i]);
 		atomic_set(&local->agg_queue_stop[i], 0);
+
+		__skb_queue_head_init(&pq->drain);
+		pq->local = local;
+		pq->queue = i;
+		tasklet_init(&pq->tasklet, ieee80211_tx_pending,
+			     (unsigned long)pq);
 	}
-	tasklet_init(&local->tx_pending_tasklet, ieee80211_tx_pending,
-		     (unsigned long)local);
 
 	tasklet_init(&local->tasklet,
 		     ieee80211_tasklet_handler,
@@ -1000,6 +1013,10 @@ int ieee80211_register_hw(struct ieee80211_hw *hw)
 	if (result < 0)
 		goto fail_wiphy_register;
 
+	result = ieee80211_txq_setup_flows(local);
+	if (result < 0)
+		goto fail_wiphy_register;
+
 	if (!local->ops->remain_on_channel)
 		local->hw.wiphy->max_remain_on_channel_duration = 5000;
 
@@ -1125,6 +1142,7 @@ int ieee80211_register_hw(struct ieee80211_hw *hw)
 	if (local->wiphy_ciphers_allocated)
 		kfree(local->hw.wiphy->cipher_suites);
 	kfree(local->int_scan_req);
+	ieee80211_txq_teardown_flows(local);
 	return result;
 }
 EXPORT_SYMBOL(ieee80211_register_hw);
@@ -1133,7 +1151,7 @@ void ieee80211_unregister_hw(struct ieee80211_hw *hw)
 {
 	struct ieee80211_local *local = hw_to_local(hw);
 
-	tasklet_kill(&local->tx_pending_tasklet);
+	ieee80211_kill_tx_pending(local);
 	tasklet_kill(&local->tasklet);
 
 #ifdef CONFIG_INET
@@ -1174,6 +1192,7 @@ void ieee80211_unregister_hw(struct ieee80211_hw *hw)
 	ieee80211_wep_free(local);
 	ieee80211_led_exit(local);
 	kfree(local->int_scan_req);
+	ieee80211_txq_teardown_flows(local);
 }
 EXPORT_SYMBOL(ieee80211_unregister_hw);
 
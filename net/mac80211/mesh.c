@@ -9,6 +9,7 @@
  */
 
 #include <linux/slab.h>
+#include <linux/crc32.h>
 #include <asm/unaligned.h>
 #include "ieee80211_i.h"
 #include "mesh.h"
@@ -939,7 +940,8 @@ void ieee80211_stop_mesh(struct ieee80211_sub_if_data *sdata)
 	kfree_rcu(bcn, rcu_head);
 
 	/* free all potentially still buffered group-addressed frames */
-	local->total_ps_buffered -= skb_queue_len(&ifmsh->ps.bc_buf);
+	atomic_sub(skb_queue_len(&ifmsh->ps.bc_buf),
+		   &local->total_ps_buffered);
 	skb_queue_purge(&ifmsh->ps.bc_buf);
 
 	del_timer_sync(&sdata->u.mesh.housekeeping_timer);
@@ -1120,6 +1122,60 @@ out:
 	rcu_read_unlock();
 }
 
+/*
+ * Established peers keep sending the same beacon. Once one has been fully
+ * processed, identical ones only need the per-beacon updates (signal, TIM
+ * and awake window, TSF sync) and skip the parse and neighbour handling.
+ * Beacons from anyone else go straight to the full parse without a CRC
+ * pass; @have_crc tells whether @crc was computed. Returns true if the
+ * beacon was handled here.
+ */
+static bool
+ieee80211_mesh_rx_bcn_unchanged(struct ieee80211_sub_if_data *sdata,
+				struct ieee80211_mgmt *mgmt, size_t len,
+				u32 *crc, bool *have_crc,
+				struct ieee80211_rx_status *rx_status)
+{
+	struct ieee80211_if_mesh *ifmsh = &sdata->u.mesh;
+	size_t baselen = mgmt->u.beacon.variable - (u8 *)mgmt;
+	struct ieee802_11_elems elems;
+	struct sta_info *sta;
+
+	*have_crc = false;
+
+	rcu_read_lock();
+	sta = sta_info_get(sdata, mgmt->sa);
+	if (!sta || sta->mesh->plink_state != NL80211_PLINK_ESTAB) {
+		rcu_read_unlock();
+		return false;
+	}
+
+	*crc = crc32_be(0, (void *)&mgmt->u.beacon.beacon_int, 4);
+	*crc = ieee802_11_beacon_crc(mgmt->u.beacon.variable, len - baselen,
+				     &elems, *crc);
+	*have_crc = true;
+
+	if (elems.parse_error || !elems.mesh_config || elems.ch_switch_ie ||
+	    elems.ext_chansw_ie || elems.mesh_chansw_params_ie ||
+	    !sta->mesh->beacon_crc_valid || sta->mesh->beacon_crc != *crc) {
+		rcu_read_unlock();
+		return false;
+	}
+
+	sta->rx_stats.last_rx = jiffies;
+	sta->mesh->signal = rx_status->signal;
+	ieee80211_mps_frame_release(sta, &elems);
+	rcu_read_unlock();
+
+	ifmsh->mshstats.beacons_unchanged++;
+
+	if (ifmsh->sync_ops)
+		ifmsh->sync_ops->rx_bcn_presp(sdata, IEEE80211_STYPE_BEACON,
+					      mgmt, &elems, rx_status);
+
+	return true;
+}
+
 static void ieee80211_mesh_rx_bcn_presp(struct ieee80211_sub_if_data *sdata,
 					u16 stype,
 					struct ieee80211_mgmt *mgmt,
@@ -1133,6 +1189,8 @@ static void ieee80211_mesh_rx_bcn_presp(struct ieee80211_sub_if_data *sdata,
 	size_t baselen;
 	int freq;
 	enum ieee80211_band band = rx_status->band;
+	bool have_crc = false;
+	u32 crc;
 
 	/* ignore ProbeResp to foreign address */
 	if (stype == IEEE80211_STYPE_PROBE_RESP &&
@@ -1143,6 +1201,11 @@ static void ieee80211_mesh_rx_bcn_presp(struct ieee80211_sub_if_data *sdata,
 	if (baselen > len)
 		return;
 
+	if (stype == IEEE80211_STYPE_BEACON &&
+	    ieee80211_mesh_rx_bcn_unchanged(sdata, mgmt, len, &crc, &have_crc,
+					    rx_status))
+		return;
+
 	ieee802_11_parse_elems(mgmt->u.probe_resp.variable, len - baselen,
 			       false, &elems);
 
@@ -1164,7 +1227,8 @@ static void ieee80211_mesh_rx_bcn_presp(struct ieee80211_sub_if_data *sdata,
 
 	if (mesh_matches_local(sdata, &elems))
 		mesh_neighbour_update(sdata, mgmt->sa, &elems,
-				      rx_status->signal);
+				      rx_status->signal,
+				      have_crc ? &crc : NULL);
 
 	if (ifmsh->sync_ops)
 		ifmsh->sync_ops->rx_bcn_presp(sdata,
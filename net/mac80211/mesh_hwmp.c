@@ -346,22 +346,19 @@ static u32 airtime_link_metric_get(struct ieee80211_local *local,
 	int device_constant = 1 << ARITH_SHIFT;
 	int test_frame_len = TEST_FRAME_LEN << ARITH_SHIFT;
 	int s_unit = 1 << ARITH_SHIFT;
-	int rate, err, ret;
+	int rate, err;
 	u32 tx_time, estimated_retx;
 	u64 result;
 
 	if (sta->mesh->fail_avg >= 100)
 		return MAX_METRIC;
 
-	sta_set_rate_info_tx(sta, &sta->tx_stats.last_rate, &rinfo);
-
-
-	ret = drv_mesh_get_mbps_estimation(local, &sta->sta, &rate);
-	/* if driver has no data for us or has no function
-	 * for this op, use original implementation
-	 */
-	if (ret < 0)
+	/* expected throughput is in Kbps, the metric wants 100 Kbps units */
+	rate = DIV_ROUND_UP(sta_get_expected_throughput(sta), 100);
+	if (!rate) {
+		sta_set_rate_info_tx(sta, &sta->tx_stats.last_rate, &rinfo);
 		rate = cfg80211_calculate_bitrate(&rinfo);
+	}
 
 	if (WARN_ON(!rate))
 		return MAX_METRIC;
@@ -550,13 +550,15 @@ mesh_sta_info_get(struct ieee80211_sub_if_data *sdata,
  * @sdata: local meshif
  * @addr: peer's address
  * @elems: IEs from beacon or mesh peering frame
+ * @signal: signal strength of the frame
+ * @beacon_crc: CRC of the beacon's elements, %NULL if it wasn't computed
  *
  * Initiates peering if appropriate.
  */
 void mesh_neighbour_update(struct ieee80211_sub_if_data *sdata,
 			   u8 *hw_addr,
 			   struct ieee802_11_elems *elems,
-			   s8 signal)
+			   s8 signal, const u32 *beacon_crc)
 {
 	struct sta_info *sta;
 	u32 changed = 0;
@@ -565,6 +567,14 @@ void mesh_neighbour_update(struct ieee80211_sub_if_data *sdata,
 	if (!sta)
 		goto out;
 
+	/* without a CRC the last fully processed beacon is unknown */
+	if (beacon_crc) {
+		sta->mesh->beacon_crc = *beacon_crc;
+		sta->mesh->beacon_crc_valid = true;
+	} else {
+		sta->mesh->beacon_crc_valid = false;
+	}
+
 	/* Update neighbour signal level*/
 	sta->mesh->signal = signal;
 	sta->mesh->num_of_peers =
@@ -3298,7 +3298,8 @@ static void ieee80211_rx_mgmt_beacon(struct ieee80211_sub_if_data *sdata,
 	u32 changed = 0;
 	bool erp_valid;
 	u8 erp_value = 0;
-	u32 ncrc;
+	u32 ncrc, raw_crc;
+	bool unchanged;
 	u8 *bssid;
 	u8 deauth_buf[IEEE80211_DEAUTH_FRAME_LEN];
 
@@ -3434,10 +3435,26 @@ static void ieee80211_rx_mgmt_beacon(struct ieee80211_sub_if_data *sdata,
 	 */
 	ieee80211_sta_reset_beacon_monitor(sdata);
 
-	ncrc = crc32_be(0, (void *)&mgmt->u.beacon.beacon_int, 4);
-	ncrc = ieee802_11_parse_elems_crc(mgmt->u.beacon.variable,
-					  len - baselen, false, &elems,
-					  care_about_ies, ncrc);
+	/*
+	 * If the beacon is byte-for-byte the same as the last one we fully
+	 * processed (apart from the TIM), it would also have the same CRC
+	 * over the elements we care about, so don't parse it again.
+	 */
+	raw_crc = crc32_be(0, (void *)&mgmt->u.beacon.beacon_int, 4);
+	raw_crc = ieee802_11_beacon_crc(mgmt->u.beacon.variable,
+					len - baselen, &elems, raw_crc);
+	unchanged = ifmgd->beacon_crc_valid && !elems.parse_error &&
+		    raw_crc == ifmgd->beacon_raw_crc;
+	if (unchanged) {
+		ifmgd->beacons_unchanged++;
+		ncrc = ifmgd->beacon_crc;
+	} else {
+		ncrc = crc32_be(0, (void *)&mgmt->u.beacon.beacon_int, 4);
+		ncrc = ieee802_11_parse_elems_crc(mgmt->u.beacon.variable,
+						  len - baselen, false, &elems,
+						  care_about_ies, ncrc);
+		ifmgd->beacon_raw_crc = raw_crc;
+	}
 
 	if (ieee80211_hw_check(&local->hw, PS_NULLFUNC_STACK) &&
 	    ieee80211_check_tim(elems.tim, elems.tim_len, ifmgd->aid)) {
@@ -3463,7 +3480,8 @@ static void ieee80211_rx_mgmt_beacon(struct ieee80211_sub_if_data *sdata,
 		}
 	}
 
-	if (sdata->vif.p2p) {
+	/* an unchanged beacon also carries the same NoA attribute */
+	if (sdata->vif.p2p && !unchanged) {
 		struct ieee80211_p2p_noa_attr noa = {};
 		int ret;
 
@@ -4403,7 +4421,7 @@ static int ieee80211_prep_connection(struct ieee80211_sub_if_data *sdata,
 		if (ies) {
 			const u8 *tim_ie;
 
-			sdata->vif.bss_conf.sync_tsf = ies->tsf;
+			sdata->vif.bss_conf.sync_tsf = ACCESS_ONCE(ies->tsf);
 			sdata->vif.bss_conf.sync_device_ts =
 				bss->device_ts_beacon;
 			tim_ie = cfg80211_find_ie(WLAN_EID_TIM,
@@ -4416,7 +4434,7 @@ static int ieee80211_prep_connection(struct ieee80211_sub_if_data *sdata,
 					       TIMING_BEACON_ONLY)) {
 			ies = rcu_dereference(cbss->proberesp_ies);
 			/* must be non-NULL since beacon IEs were NULL */
-			sdata->vif.bss_conf.sync_tsf = ies->tsf;
+			sdata->vif.bss_conf.sync_tsf = ACCESS_ONCE(ies->tsf);
 			sdata->vif.bss_conf.sync_device_ts =
 				bss->device_ts_presp;
 			sdata->vif.bss_conf.sync_dtim_count = 0;
@@ -4829,7 +4847,8 @@ int ieee80211_mgd_assoc(struct ieee80211_sub_if_data *sdata,
 		assoc_data->timeout_started = true;
 
 		if (ieee80211_hw_check(&local->hw, TIMING_BEACON_ONLY)) {
-			sdata->vif.bss_conf.sync_tsf = beacon_ies->tsf;
+			sdata->vif.bss_conf.sync_tsf =
+				ACCESS_ONCE(beacon_ies->tsf);
 			sdata->vif.bss_conf.sync_device_ts =
 				bss->device_ts_beacon;
 			sdata->vif.bss_conf.sync_dtim_count = dtim_count;
@@ -30,23 +30,32 @@ void rate_control_get_rate(struct ieee80211_sub_if_data *sdata,
 			   struct ieee80211_tx_rate_control *txrc);
 
 static inline void rate_control_tx_status(struct ieee80211_local *local,
-					  struct ieee80211_supported_band *sband,
 					  struct sta_info *sta,
-					  struct sk_buff *skb)
+					  struct sk_buff_head *skbs)
 {
 	struct rate_control_ref *ref = local->rate_ctrl;
 	struct ieee80211_sta *ista = &sta->sta;
 	void *priv_sta = sta->rate_ctrl_priv;
-	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+	struct ieee80211_supported_band *sband;
+	struct ieee80211_tx_info *info;
+	struct sk_buff *skb;
 
-	if (!ref || !test_sta_flag(sta, WLAN_STA_RATE_CONTROL))
+	if (!ref || !test_sta_flag(sta, WLAN_STA_RATE_CONTROL) ||
+	    skb_queue_empty(skbs))
 		return;
 
 	spin_lock_bh(&sta->rate_ctrl_lock);
-	if (ref->ops->tx_status)
-		ref->ops->tx_status(ref->priv, sband, ista, priv_sta, skb);
-	else
-		ref->ops->tx_status_noskb(ref->priv, sband, ista, priv_sta, info);
+	skb_queue_walk(skbs, skb) {
+		info = IEEE80211_SKB_CB(skb);
+		sband = local->hw.wiphy->bands[info->band];
+
+		if (ref->ops->tx_status)
+			ref->ops->tx_status(ref->priv, sband, ista, priv_sta,
+					    skb);
+		else
+			ref->ops->tx_status_noskb(ref->priv, sband, ista,
+						  priv_sta, info);
+	}
 	spin_unlock_bh(&sta->rate_ctrl_lock);
 }
 
@@ -304,6 +304,10 @@ minstrel_ht_get_stats(struct minstrel_priv *mp, struct minstrel_ht_sta *mi,
 		if (!(mi->groups[group].supported & BIT(idx)))
 			idx += 4;
 	}
+
+	/* the caller is about to account attempts on this group */
+	__set_bit(group, mi->active_groups);
+
 	return &mi->groups[group].rates[idx];
 }
 
@@ -328,7 +332,7 @@ minstrel_ht_get_tp_avg(struct minstrel_ht_sta *mi, int group, int rate,
 		return 0;
 
 	if (group != MINSTREL_CCK_GROUP)
-		nsecs = 1000 * mi->overhead / MINSTREL_TRUNC(mi->avg_ampdu_len);
+		nsecs = mi->ampdu_overhead;
 
 	nsecs += minstrel_mcs_groups[group].duration[rate];
 
@@ -344,6 +348,17 @@ minstrel_ht_get_tp_avg(struct minstrel_ht_sta *mi, int group, int rate,
 		return MINSTREL_TRUNC(100000 * ((prob_ewma * 1000) / nsecs));
 }
 
+/*
+ * Return the throughput cached for a rate index by the last statistics update
+ */
+static inline int
+minstrel_ht_get_tp_cached(struct minstrel_ht_sta *mi, u16 index)
+{
+	int group = index / MCS_GROUP_RATES;
+
+	return mi->groups[group].tp_avg[index % MCS_GROUP_RATES];
+}
+
 /*
  * Find & sort topmost throughput rates
  *
@@ -362,14 +377,13 @@ minstrel_ht_sort_best_tp_rates(struct minstrel_ht_sta *mi, u16 index,
 	cur_group = index / MCS_GROUP_RATES;
 	cur_idx = index  % MCS_GROUP_RATES;
 	cur_prob = mi->groups[cur_group].rates[cur_idx].prob_ewma;
-	cur_tp_avg = minstrel_ht_get_tp_avg(mi, cur_group, cur_idx, cur_prob);
+	cur_tp_avg = mi->groups[cur_group].tp_avg[cur_idx];
 
 	do {
 		tmp_group = tp_list[j - 1] / MCS_GROUP_RATES;
 		tmp_idx = tp_list[j - 1] % MCS_GROUP_RATES;
 		tmp_prob = mi->groups[tmp_group].rates[tmp_idx].prob_ewma;
-		tmp_tp_avg = minstrel_ht_get_tp_avg(mi, tmp_group, tmp_idx,
-						    tmp_prob);
+		tmp_tp_avg = mi->groups[tmp_group].tp_avg[tmp_idx];
 		if (cur_tp_avg < tmp_tp_avg ||
 		    (cur_tp_avg == tmp_tp_avg && cur_prob <= tmp_prob))
 			break;
@@ -394,8 +408,7 @@ minstrel_ht_set_best_prob_rate(struct minstrel_ht_sta *mi, u16 index)
 	struct minstrel_rate_stats *mrs;
 	int tmp_group, tmp_idx, tmp_tp_avg, tmp_prob;
 	int max_tp_group, cur_tp_avg, cur_group, cur_idx;
-	int max_gpr_group, max_gpr_idx;
-	int max_gpr_tp_avg, max_gpr_prob;
+	int max_gpr_tp_avg;
 
 	cur_group = index / MCS_GROUP_RATES;
 	cur_idx = index % MCS_GROUP_RATES;
@@ -405,7 +418,7 @@ minstrel_ht_set_best_prob_rate(struct minstrel_ht_sta *mi, u16 index)
 	tmp_group = mi->max_prob_rate / MCS_GROUP_RATES;
 	tmp_idx = mi->max_prob_rate % MCS_GROUP_RATES;
 	tmp_prob = mi->groups[tmp_group].rates[tmp_idx].prob_ewma;
-	tmp_tp_avg = minstrel_ht_get_tp_avg(mi, tmp_group, tmp_idx, tmp_prob);
+	tmp_tp_avg = mi->groups[tmp_group].tp_avg[tmp_idx];
 
 	/* if max_tp_rate[0] is from MCS_GROUP max_prob_rate get selected from
 	 * MCS_GROUP as well as CCK_GROUP rates do not allow aggregation */
@@ -415,17 +428,12 @@ minstrel_ht_set_best_prob_rate(struct minstrel_ht_sta *mi, u16 index)
 		return;
 
 	if (mrs->prob_ewma > MINSTREL_FRAC(75, 100)) {
-		cur_tp_avg = minstrel_ht_get_tp_avg(mi, cur_group, cur_idx,
-						    mrs->prob_ewma);
+		cur_tp_avg = mg->tp_avg[cur_idx];
 		if (cur_tp_avg > tmp_tp_avg)
 			mi->max_prob_rate = index;
 
-		max_gpr_group = mg->max_group_prob_rate / MCS_GROUP_RATES;
-		max_gpr_idx = mg->max_group_prob_rate %	MCS_GROUP_RATES;
-		max_gpr_prob = mi->groups[max_gpr_group].rates[max_gpr_idx].prob_ewma;
-		max_gpr_tp_avg = minstrel_ht_get_tp_avg(mi, max_gpr_group,
-							max_gpr_idx,
-							max_gpr_prob);
+		max_gpr_tp_avg = minstrel_ht_get_tp_cached(mi,
+						mg->max_group_prob_rate);
 		if (cur_tp_avg > max_gpr_tp_avg)
 			mg->max_group_prob_rate = index;
 	} else {
@@ -448,18 +456,11 @@ minstrel_ht_assign_best_tp_rates(struct minstrel_ht_sta *mi,
 				 u16 tmp_mcs_tp_rate[MAX_THR_RATES],
 				 u16 tmp_cck_tp_rate[MAX_THR_RATES])
 {
-	unsigned int tmp_group, tmp_idx, tmp_cck_tp, tmp_mcs_tp, tmp_prob;
+	unsigned int tmp_cck_tp, tmp_mcs_tp;
 	int i;
 
-	tmp_group = tmp_cck_tp_rate[0] / MCS_GROUP_RATES;
-	tmp_idx = tmp_cck_tp_rate[0] % MCS_GROUP_RATES;
-	tmp_prob = mi->groups[tmp_group].rates[tmp_idx].prob_ewma;
-	tmp_cck_tp = minstrel_ht_get_tp_avg(mi, tmp_group, tmp_idx, tmp_prob);
-
-	tmp_group = tmp_mcs_tp_rate[0] / MCS_GROUP_RATES;
-	tmp_idx = tmp_mcs_tp_rate[0] % MCS_GROUP_RATES;
-	tmp_prob = mi->groups[tmp_group].rates[tmp_idx].prob_ewma;
-	tmp_mcs_tp = minstrel_ht_get_tp_avg(mi, tmp_group, tmp_idx, tmp_prob);
+	tmp_cck_tp = minstrel_ht_get_tp_cached(mi, tmp_cck_tp_rate[0]);
+	tmp_mcs_tp = minstrel_ht_get_tp_cached(mi, tmp_mcs_tp_rate[0]);
 
 	if (tmp_cck_tp > tmp_mcs_tp) {
 		for(i = 0; i < MAX_THR_RATES; i++) {
@@ -478,7 +479,7 @@ static inline void
 minstrel_ht_prob_rate_reduce_streams(struct minstrel_ht_sta *mi)
 {
 	struct minstrel_mcs_group_data *mg;
-	int tmp_max_streams, group, tmp_idx, tmp_prob;
+	int tmp_max_streams, group, tmp_idx, cur_tp;
 	int tmp_tp = 0;
 
 	tmp_max_streams = minstrel_mcs_groups[mi->max_tp_rate[0] /
@@ -489,14 +490,12 @@ minstrel_ht_prob_rate_reduce_streams(struct minstrel_ht_sta *mi)
 			continue;
 
 		tmp_idx = mg->max_group_prob_rate % MCS_GROUP_RATES;
-		tmp_prob = mi->groups[group].rates[tmp_idx].prob_ewma;
+		cur_tp = mg->tp_avg[tmp_idx];
 
-		if (tmp_tp < minstrel_ht_get_tp_avg(mi, group, tmp_idx, tmp_prob) &&
+		if (tmp_tp < cur_tp &&
 		   (minstrel_mcs_groups[group].streams < tmp_max_streams)) {
 				mi->max_prob_rate = mg->max_group_prob_rate;
-				tmp_tp = minstrel_ht_get_tp_avg(mi, group,
-								tmp_idx,
-								tmp_prob);
+				tmp_tp = cur_tp;
 		}
 	}
 }
@@ -515,9 +514,11 @@ minstrel_ht_update_stats(struct minstrel_priv *mp, struct minstrel_ht_sta *mi)
 {
 	struct minstrel_mcs_group_data *mg;
 	struct minstrel_rate_stats *mrs;
-	int group, i, j, cur_prob;
+	int group, i, j;
 	u16 tmp_mcs_tp_rate[MAX_THR_RATES], tmp_group_tp_rate[MAX_THR_RATES];
 	u16 tmp_cck_tp_rate[MAX_THR_RATES], index;
+	unsigned int ampdu_overhead;
+	bool overhead_changed, refresh;
 
 	if (mi->ampdu_packets > 0) {
 		mi->avg_ampdu_len = minstrel_ewma(mi->avg_ampdu_len,
@@ -526,6 +527,41 @@ minstrel_ht_update_stats(struct minstrel_priv *mp, struct minstrel_ht_sta *mi)
 		mi->ampdu_packets = 0;
 	}
 
+	ampdu_overhead = 1000 * mi->overhead /
+			 MINSTREL_TRUNC(mi->avg_ampdu_len);
+	overhead_changed = ampdu_overhead != mi->ampdu_overhead;
+	mi->ampdu_overhead = ampdu_overhead;
+
+	/*
+	 * Update the rate statistics and refresh the cached throughput.
+	 * Probabilities only change for groups that saw tx attempts, and the
+	 * throughput of the other groups only depends on the A-MPDU overhead
+	 * (which doesn't apply to CCK), so most groups can keep their values.
+	 */
+	for (group = 0; group < ARRAY_SIZE(minstrel_mcs_groups); group++) {
+		mg = &mi->groups[group];
+		if (!mg->supported)
+			continue;
+
+		refresh = test_bit(group, mi->active_groups) ||
+			  (group != MINSTREL_CCK_GROUP && overhead_changed);
+
+		for (i = 0; i < MCS_GROUP_RATES; i++) {
+			mrs = &mg->rates[i];
+
+			if (mg->supported & BIT(i)) {
+				mrs->retry_updated = false;
+				minstrel_calc_rate_stats(mrs);
+			}
+
+			if (refresh)
+				mg->tp_avg[i] = minstrel_ht_get_tp_avg(mi,
+						group, i, mrs->prob_ewma);
+		}
+	}
+
+	bitmap_zero(mi->active_groups, MINSTREL_GROUPS_NB);
+
 	mi->sample_slow = 0;
 	mi->sample_count = 0;
 
@@ -554,12 +590,7 @@ minstrel_ht_update_stats(struct minstrel_priv *mp, struct minstrel_ht_sta *mi)
 
 			index = MCS_GROUP_RATES * group + i;
 
-			mrs = &mg->rates[i];
-			mrs->retry_updated = false;
-			minstrel_calc_rate_stats(mrs);
-			cur_prob = mrs->prob_ewma;
-
-			if (minstrel_ht_get_tp_avg(mi, group, i, cur_prob) == 0)
+			if (mg->tp_avg[i] == 0)
 				continue;
 
 			/* Find max throughput rate set */
@@ -1136,6 +1167,9 @@ minstrel_ht_update_caps(void *priv, struct ieee80211_supported_band *sband,
 
 	mi->avg_ampdu_len = MINSTREL_FRAC(1, 1);
 
+	/* compute the throughput of every group on the first update */
+	bitmap_fill(mi->active_groups, MINSTREL_GROUPS_NB);
+
 	/* When using MRR, sample more on the first attempt, without delay */
 	if (mp->has_mrr) {
 		mi->sample_count = 16;
@@ -1324,17 +1358,13 @@ static u32 minstrel_ht_get_expected_throughput(void *priv_sta)
 {
 	struct minstrel_ht_sta_priv *msp = priv_sta;
 	struct minstrel_ht_sta *mi = &msp->ht;
-	int i, j, prob, tp_avg;
+	int tp_avg;
 
 	if (!msp->is_ht)
 		return mac80211_minstrel.get_expected_throughput(priv_sta);
 
-	i = mi->max_tp_rate[0] / MCS_GROUP_RATES;
-	j = mi->max_tp_rate[0] % MCS_GROUP_RATES;
-	prob = mi->groups[i].rates[j].prob_ewma;
-
 	/* convert tp_avg from pkt per second in kbps */
-	tp_avg = minstrel_ht_get_tp_avg(mi, i, j, prob) * 10;
+	tp_avg = minstrel_ht_get_tp_cached(mi, mi->max_tp_rate[0]) * 10;
 	tp_avg = tp_avg * AVG_PKT_SIZE * 8 / 1024;
 
 	return tp_avg;
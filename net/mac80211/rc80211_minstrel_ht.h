@@ -61,6 +61,9 @@ struct minstrel_mcs_group_data {
 
 	/* MCS rate statistics */
 	struct minstrel_rate_stats rates[MCS_GROUP_RATES];
+
+	/* throughput per rate, refreshed on statistics updates */
+	int tp_avg[MCS_GROUP_RATES];
 };
 
 struct minstrel_ht_sta {
@@ -84,6 +87,12 @@ struct minstrel_ht_sta {
 	unsigned int overhead;
 	unsigned int overhead_rtscts;
 
+	/* overhead share in nsec of each frame in an average sized A-MPDU */
+	unsigned int ampdu_overhead;
+
+	/* MCS groups with tx attempts since the last statistics update */
+	DECLARE_BITMAP(active_groups, MINSTREL_GROUPS_NB);
+
 	unsigned int total_packets;
 	unsigned int sample_packets;
 
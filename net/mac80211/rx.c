@@ -466,6 +466,63 @@ ieee80211_add_rx_radiotap_header(struct ieee80211_local *local,
 	}
 }
 
+/*
+ * Build the radiotap frame handed to monitor interfaces, either in place
+ * (stealing *origskb) when the frame isn't going to be processed further,
+ * or in a copy.
+ */
+static struct sk_buff *
+ieee80211_make_monitor_skb(struct ieee80211_local *local,
+			   struct sk_buff **origskb,
+			   struct ieee80211_rate *rate,
+			   int rtap_vendor_space, bool use_origskb)
+{
+	struct ieee80211_rx_status *status = IEEE80211_SKB_RXCB(*origskb);
+	int rt_hdrlen, needed_headroom;
+	struct sk_buff *skb;
+
+	/* room for the radiotap header based on driver features */
+	rt_hdrlen = ieee80211_rx_radiotap_hdrlen(local, status, *origskb);
+	needed_headroom = rt_hdrlen - rtap_vendor_space;
+
+	if (use_origskb) {
+		/* only need to expand headroom if necessary */
+		skb = *origskb;
+		*origskb = NULL;
+
+		/*
+		 * This shouldn't trigger often because most devices have an
+		 * RX header they pull before we get here, and that should
+		 * be big enough for our radiotap information. We should
+		 * probably export the length to drivers so that we can have
+		 * them allocate enough headroom to start with.
+		 */
+		if (skb_headroom(skb) < needed_headroom &&
+		    pskb_expand_head(skb, needed_headroom, 0, GFP_ATOMIC)) {
+			dev_kfree_skb(skb);
+			return NULL;
+		}
+	} else {
+		/*
+		 * Need to make a copy, the radiotap header and FCS are
+		 * removed from the original by the caller.
+		 */
+		skb = skb_copy_expand(*origskb, needed_headroom, 0, GFP_ATOMIC);
+		if (!skb)
+			return NULL;
+	}
+
+	/* prepend radiotap information */
+	ieee80211_add_rx_radiotap_header(local, skb, rate, rt_hdrlen, true);
+
+	skb_reset_mac_header(skb);
+	skb->ip_summed = CHECKSUM_UNNECESSARY;
+	skb->pkt_type = PACKET_OTHERHOST;
+	skb->protocol = htons(ETH_P_802_2);
+
+	return skb;
+}
+
 /*
  * This function copies a received frame to all monitor interfaces and
  * returns a cleaned-up SKB that no longer includes the FCS nor the
@@ -477,11 +534,11 @@ ieee80211_rx_monitor(struct ieee80211_local *local, struct sk_buff *origskb,
 {
 	struct ieee80211_rx_status *status = IEEE80211_SKB_RXCB(origskb);
 	struct ieee80211_sub_if_data *sdata;
-	int rt_hdrlen, needed_headroom;
-	struct sk_buff *skb, *skb2;
+	struct sk_buff *monskb = NULL, *skb2;
 	struct net_device *prev_dev = NULL;
 	int present_fcs_len = 0;
 	unsigned int rtap_vendor_space = 0;
+	bool only_monitor;
 
 	if (unlikely(status->flag & RX_FLAG_RADIOTAP_VENDOR_DATA)) {
 		struct ieee80211_vendor_radiotap *rtap = (void *)origskb->data;
@@ -507,71 +564,31 @@ ieee80211_rx_monitor(struct ieee80211_local *local, struct sk_buff *origskb,
 		return NULL;
 	}
 
-	if (!local->monitors) {
-		if (should_drop_frame(origskb, present_fcs_len,
-				      rtap_vendor_space)) {
-			dev_kfree_skb(origskb);
-			return NULL;
-		}
-
-		return remove_monitor_info(local, origskb, rtap_vendor_space);
-	}
-
-	/* room for the radiotap header based on driver features */
-	rt_hdrlen = ieee80211_rx_radiotap_hdrlen(local, status, origskb);
-	needed_headroom = rt_hdrlen - rtap_vendor_space;
-
-	if (should_drop_frame(origskb, present_fcs_len, rtap_vendor_space)) {
-		/* only need to expand headroom if necessary */
-		skb = origskb;
-		origskb = NULL;
-
-		/*
-		 * This shouldn't trigger often because most devices have an
-		 * RX header they pull before we get here, and that should
-		 * be big enough for our radiotap information. We should
-		 * probably export the length to drivers so that we can have
-		 * them allocate enough headroom to start with.
-		 */
-		if (skb_headroom(skb) < needed_headroom &&
-		    pskb_expand_head(skb, needed_headroom, 0, GFP_ATOMIC)) {
-			dev_kfree_skb(skb);
-			return NULL;
-		}
-	} else {
-		/*
-		 * Need to make a copy and possibly remove radiotap header
-		 * and FCS from the original.
-		 */
-		skb = skb_copy_expand(origskb, needed_headroom, 0, GFP_ATOMIC);
+	only_monitor = should_drop_frame(origskb, present_fcs_len,
+					 rtap_vendor_space);
 
-		origskb = remove_monitor_info(local, origskb,
-					      rtap_vendor_space);
-
-		if (!skb)
-			return origskb;
-	}
-
-	/* prepend radiotap information */
-	ieee80211_add_rx_radiotap_header(local, skb, rate, rt_hdrlen, true);
-
-	skb_reset_mac_header(skb);
-	skb->ip_summed = CHECKSUM_UNNECESSARY;
-	skb->pkt_type = PACKET_OTHERHOST;
-	skb->protocol = htons(ETH_P_802_2);
+	if (!local->monitors)
+		goto out;
 
+	/*
+	 * The monitor frame is only built once some interface actually
+	 * wants it, so idle and sampling monitors don't cost a copy.
+	 */
 	list_for_each_entry_rcu(sdata, &local->interfaces, list) {
-		if (sdata->vif.type != NL80211_IFTYPE_MONITOR)
+		if (!ieee80211_mntr_wants_frame(sdata, false))
 			continue;
 
-		if (sdata->u.mntr_flags & MONITOR_FLAG_COOK_FRAMES)
-			continue;
-
-		if (!ieee80211_sdata_running(sdata))
-			continue;
+		if (!monskb) {
+			monskb = ieee80211_make_monitor_skb(local, &origskb,
+							    rate,
+							    rtap_vendor_space,
+							    only_monitor);
+			if (!monskb)
+				break;
+		}
 
 		if (prev_dev) {
-			skb2 = skb_clone(skb, GFP_ATOMIC);
+			skb2 = skb_clone(monskb, GFP_ATOMIC);
 			if (skb2) {
 				skb2->dev = prev_dev;
 				netif_receive_skb(skb2);
@@ -579,16 +596,24 @@ ieee80211_rx_monitor(struct ieee80211_local *local, struct sk_buff *origskb,
 		}
 
 		prev_dev = sdata->dev;
-		ieee80211_rx_stats(sdata->dev, skb->len);
+		ieee80211_rx_stats(sdata->dev, monskb->len);
 	}
 
 	if (prev_dev) {
-		skb->dev = prev_dev;
-		netif_receive_skb(skb);
-	} else
-		dev_kfree_skb(skb);
+		monskb->dev = prev_dev;
+		netif_receive_skb(monskb);
+	}
+
+ out:
+	if (!origskb)
+		return NULL;
+
+	if (only_monitor) {
+		dev_kfree_skb(origskb);
+		return NULL;
+	}
 
-	return origskb;
+	return remove_monitor_info(local, origskb, rtap_vendor_space);
 }
 
 static void ieee80211_parse_qos(struct ieee80211_rx_data *rx)
@@ -798,6 +823,15 @@ static ieee80211_rx_result ieee80211_rx_mesh_check(struct ieee80211_rx_data *rx)
 	return RX_CONTINUE;
 }
 
+static void ieee80211_purge_reorder_slot(struct tid_ampdu_rx *tid_agg_rx,
+					 int index)
+{
+	struct sk_buff_head *skb_list = &tid_agg_rx->reorder_buf[index];
+
+	tid_agg_rx->reorder_drops += skb_queue_len(skb_list);
+	__skb_queue_purge(skb_list);
+}
+
 static void ieee80211_release_reorder_frame(struct ieee80211_sub_if_data *sdata,
 					    struct tid_ampdu_rx *tid_agg_rx,
 					    int index,
@@ -809,21 +843,21 @@ static void ieee80211_release_reorder_frame(struct ieee80211_sub_if_data *sdata,
 
 	lockdep_assert_held(&tid_agg_rx->reorder_lock);
 
-	if (skb_queue_empty(skb_list))
-		goto no_frame;
-
-	if (!ieee80211_rx_reorder_ready(skb_list)) {
-		__skb_queue_purge(skb_list);
+	if (!test_bit(index, tid_agg_rx->reorder_ready)) {
+		/* don't leave incomplete A-MSDUs around */
+		if (!skb_queue_empty(skb_list))
+			ieee80211_purge_reorder_slot(tid_agg_rx, index);
 		goto no_frame;
 	}
 
 	/* release frames from the reorder ring buffer */
+	__clear_bit(index, tid_agg_rx->reorder_ready);
 	tid_agg_rx->stored_mpdu_num--;
-	while ((skb = __skb_dequeue(skb_list))) {
+	skb_queue_walk(skb_list, skb) {
 		status = IEEE80211_SKB_RXCB(skb);
 		status->rx_flags |= IEEE80211_RX_DEFERRED_RELEASE;
-		__skb_queue_tail(frames, skb);
 	}
+	skb_queue_splice_tail_init(skb_list, frames);
 
 no_frame:
 	tid_agg_rx->head_seq_num = ieee80211_sn_inc(tid_agg_rx->head_seq_num);
@@ -845,6 +879,27 @@ static void ieee80211_release_reorder_frames(struct ieee80211_sub_if_data *sdata
 	}
 }
 
+/*
+ * Find the first slot holding a complete MPDU, starting at @index and
+ * wrapping around the end of the ring. Returns -1 if nothing is stored.
+ */
+static int ieee80211_reorder_next_ready(struct tid_ampdu_rx *tid_agg_rx,
+					int index)
+{
+	int j;
+
+	j = find_next_bit(tid_agg_rx->reorder_ready, tid_agg_rx->buf_size,
+			  index);
+	if (j < tid_agg_rx->buf_size)
+		return j;
+
+	j = find_first_bit(tid_agg_rx->reorder_ready, index);
+	if (j < index)
+		return j;
+
+	return -1;
+}
+
 /*
  * Timeout (in jiffies) for skb's that are waiting in the RX reorder buffer. If
  * the skb was added to the buffer longer than this time ago, the earlier
@@ -860,65 +915,56 @@ static void ieee80211_sta_reorder_release(struct ieee80211_sub_if_data *sdata,
 					  struct tid_ampdu_rx *tid_agg_rx,
 					  struct sk_buff_head *frames)
 {
-	int index, i, j;
+	int buf_size = tid_agg_rx->buf_size;
+	int index, j, skipped;
+	u16 sn;
 
 	lockdep_assert_held(&tid_agg_rx->reorder_lock);
 
 	/* release the buffer until next missing frame */
-	index = tid_agg_rx->head_seq_num % tid_agg_rx->buf_size;
-	if (!ieee80211_rx_reorder_ready(&tid_agg_rx->reorder_buf[index]) &&
+	index = tid_agg_rx->head_seq_num % buf_size;
+	if (!test_bit(index, tid_agg_rx->reorder_ready) &&
 	    tid_agg_rx->stored_mpdu_num) {
 		/*
 		 * No buffers ready to be released, but check whether any
-		 * frames in the reorder buffer have timed out.
+		 * frames in the reorder buffer have timed out. Every slot
+		 * between the head and a ready frame is a hole.
 		 */
-		int skipped = 1;
-		for (j = (index + 1) % tid_agg_rx->buf_size; j != index;
-		     j = (j + 1) % tid_agg_rx->buf_size) {
-			if (!ieee80211_rx_reorder_ready(
-					&tid_agg_rx->reorder_buf[j])) {
-				skipped++;
-				continue;
-			}
+		while ((j = ieee80211_reorder_next_ready(tid_agg_rx,
+							 index)) >= 0) {
+			skipped = (j - index + buf_size) % buf_size;
 			if (skipped &&
 			    !time_after(jiffies, tid_agg_rx->reorder_time[j] +
 					HT_RX_REORDER_BUF_TIMEOUT))
 				goto set_release_timer;
 
-			/* don't leave incomplete A-MSDUs around */
-			for (i = (index + 1) % tid_agg_rx->buf_size; i != j;
-			     i = (i + 1) % tid_agg_rx->buf_size)
-				__skb_queue_purge(&tid_agg_rx->reorder_buf[i]);
-
-			ht_dbg_ratelimited(sdata,
-					   "release an RX reorder frame due to timeout on earlier frames\n");
-			ieee80211_release_reorder_frame(sdata, tid_agg_rx, j,
-							frames);
+			if (skipped) {
+				ht_dbg_ratelimited(sdata,
+						   "release an RX reorder frame due to timeout on earlier frames\n");
+				tid_agg_rx->reorder_timeouts++;
+				tid_agg_rx->reorder_holes += skipped;
+			}
 
 			/*
-			 * Increment the head seq# also for the skipped slots.
+			 * Skip the holes (dropping incomplete A-MSDUs) and
+			 * release the frame, which also moves the head on.
 			 */
-			tid_agg_rx->head_seq_num =
-				(tid_agg_rx->head_seq_num +
-				 skipped) & IEEE80211_SN_MASK;
-			skipped = 0;
+			sn = ieee80211_sn_add(tid_agg_rx->head_seq_num,
+					      skipped + 1);
+			ieee80211_release_reorder_frames(sdata, tid_agg_rx, sn,
+							 frames);
+			index = tid_agg_rx->head_seq_num % buf_size;
 		}
-	} else while (ieee80211_rx_reorder_ready(
-				&tid_agg_rx->reorder_buf[index])) {
+	} else while (test_bit(index, tid_agg_rx->reorder_ready)) {
 		ieee80211_release_reorder_frame(sdata, tid_agg_rx, index,
 						frames);
-		index =	tid_agg_rx->head_seq_num % tid_agg_rx->buf_size;
+		index =	tid_agg_rx->head_seq_num % buf_size;
 	}
 
 	if (tid_agg_rx->stored_mpdu_num) {
-		j = index = tid_agg_rx->head_seq_num % tid_agg_rx->buf_size;
-
-		for (; j != (index - 1) % tid_agg_rx->buf_size;
-		     j = (j + 1) % tid_agg_rx->buf_size) {
-			if (ieee80211_rx_reorder_ready(
-					&tid_agg_rx->reorder_buf[j]))
-				break;
-		}
+		j = ieee80211_reorder_next_ready(tid_agg_rx, index);
+		if (WARN_ON_ONCE(j < 0))
+			return;
 
  set_release_timer:
 
@@ -966,6 +1012,7 @@ static bool ieee80211_sta_manage_reorder_buf(struct ieee80211_sub_if_data *sdata
 
 	/* frame with out of date sequence number */
 	if (ieee80211_sn_less(mpdu_seq_num, head_seq_num)) {
+		tid_agg_rx->reorder_drops++;
 		dev_kfree_skb(skb);
 		goto out;
 	}
@@ -987,7 +1034,8 @@ static bool ieee80211_sta_manage_reorder_buf(struct ieee80211_sub_if_data *sdata
 	index = mpdu_seq_num % tid_agg_rx->buf_size;
 
 	/* check if we already stored this frame */
-	if (ieee80211_rx_reorder_ready(&tid_agg_rx->reorder_buf[index])) {
+	if (test_bit(index, tid_agg_rx->reorder_ready)) {
+		tid_agg_rx->reorder_drops++;
 		dev_kfree_skb(skb);
 		goto out;
 	}
@@ -1010,6 +1058,7 @@ static bool ieee80211_sta_manage_reorder_buf(struct ieee80211_sub_if_data *sdata
 	/* put the frame in the reordering buffer */
 	__skb_queue_tail(&tid_agg_rx->reorder_buf[index], skb);
 	if (!(status->flag & RX_FLAG_AMSDU_MORE)) {
+		__set_bit(index, tid_agg_rx->reorder_ready);
 		tid_agg_rx->reorder_time[index] = jiffies;
 		tid_agg_rx->stored_mpdu_num++;
 		ieee80211_sta_reorder_release(sdata, tid_agg_rx, frames);
@@ -1245,7 +1294,7 @@ static void sta_ps_start(struct sta_info *sta)
 	for (tid = 0; tid < ARRAY_SIZE(sta->sta.txq); tid++) {
 		struct txq_info *txqi = to_txq_info(sta->sta.txq[tid]);
 
-		if (!skb_queue_len(&txqi->queue))
+		if (!txqi->backlog_packets)
 			set_bit(tid, &sta->txq_buffered_tids);
 		else
 			clear_bit(tid, &sta->txq_buffered_tids);
@@ -1734,19 +1783,55 @@ ieee80211_rx_h_decrypt(struct ieee80211_rx_data *rx)
 	return result;
 }
 
+void ieee80211_init_frag_cache(struct ieee80211_fragment_cache *cache)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(cache->entries); i++)
+		skb_queue_head_init(&cache->entries[i].skb_list);
+}
+
+void ieee80211_destroy_frag_cache(struct ieee80211_fragment_cache *cache)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(cache->entries); i++)
+		__skb_queue_purge(&cache->entries[i].skb_list);
+	cache->next = 0;
+}
+
+/*
+ * Fragments from a known station are kept in that station's own cache, so
+ * that a lot of peers fragmenting at the same time don't evict each other's
+ * partial frames; only frames from unknown transmitters share the cache on
+ * the interface.
+ */
+static struct ieee80211_fragment_cache *
+ieee80211_rx_frag_cache(struct ieee80211_rx_data *rx)
+{
+	if (rx->sta)
+		return &rx->sta->frags;
+	return &rx->sdata->frags;
+}
+
 static inline struct ieee80211_fragment_entry *
-ieee80211_reassemble_add(struct ieee80211_sub_if_data *sdata,
+ieee80211_reassemble_add(struct ieee80211_rx_data *rx,
+			 struct ieee80211_fragment_cache *cache,
 			 unsigned int frag, unsigned int seq, int rx_queue,
 			 struct sk_buff **skb)
 {
 	struct ieee80211_fragment_entry *entry;
 
-	entry = &sdata->fragments[sdata->fragment_next++];
-	if (sdata->fragment_next >= IEEE80211_FRAGMENT_MAX)
-		sdata->fragment_next = 0;
+	entry = &cache->entries[cache->next++];
+	if (cache->next >= IEEE80211_FRAGMENT_MAX)
+		cache->next = 0;
 
-	if (!skb_queue_empty(&entry->skb_list))
+	if (!skb_queue_empty(&entry->skb_list)) {
+		I802_DEBUG_INC(rx->local->rx_handlers_defrag_evicted);
+		if (rx->sta)
+			rx->sta->rx_stats.frag_evicted++;
 		__skb_queue_purge(&entry->skb_list);
+	}
 
 	__skb_queue_tail(&entry->skb_list, *skb); /* no need for locking */
 	*skb = NULL;
@@ -1755,20 +1840,20 @@ ieee80211_reassemble_add(struct ieee80211_sub_if_data *sdata,
 	entry->rx_queue = rx_queue;
 	entry->last_frag = frag;
 	entry->check_sequential_pn = false;
-	entry->extra_len = 0;
 
 	return entry;
 }
 
 static inline struct ieee80211_fragment_entry *
-ieee80211_reassemble_find(struct ieee80211_sub_if_data *sdata,
+ieee80211_reassemble_find(struct ieee80211_rx_data *rx,
+			  struct ieee80211_fragment_cache *cache,
 			  unsigned int frag, unsigned int seq,
 			  int rx_queue, struct ieee80211_hdr *hdr)
 {
 	struct ieee80211_fragment_entry *entry;
 	int i, idx;
 
-	idx = sdata->fragment_next;
+	idx = cache->next;
 	for (i = 0; i < IEEE80211_FRAGMENT_MAX; i++) {
 		struct ieee80211_hdr *f_hdr;
 
@@ -1776,7 +1861,7 @@ ieee80211_reassemble_find(struct ieee80211_sub_if_data *sdata,
 		if (idx < 0)
 			idx = IEEE80211_FRAGMENT_MAX - 1;
 
-		entry = &sdata->fragments[idx];
+		entry = &cache->entries[idx];
 		if (skb_queue_empty(&entry->skb_list) || entry->seq != seq ||
 		    entry->rx_queue != rx_queue ||
 		    entry->last_frag + 1 != frag)
@@ -1794,6 +1879,9 @@ ieee80211_reassemble_find(struct ieee80211_sub_if_data *sdata,
 			continue;
 
 		if (time_after(jiffies, entry->first_frag_time + 2 * HZ)) {
+			I802_DEBUG_INC(rx->local->rx_handlers_defrag_timeout);
+			if (rx->sta)
+				rx->sta->rx_stats.frag_timeouts++;
 			__skb_queue_purge(&entry->skb_list);
 			continue;
 		}
@@ -1803,6 +1891,27 @@ ieee80211_reassemble_find(struct ieee80211_sub_if_data *sdata,
 	return NULL;
 }
 
+/*
+ * Chain the remaining fragments of an entry onto the frag_list of the
+ * first one instead of copying their payload; handlers that need the
+ * MSDU to be linear (TKIP MIC, A-MSDU) will linearize it themselves.
+ */
+static void ieee80211_reassemble_chain(struct sk_buff *head,
+				       struct sk_buff_head *list)
+{
+	struct sk_buff **next = &skb_shinfo(head)->frag_list;
+	struct sk_buff *skb;
+
+	while ((skb = __skb_dequeue(list))) {
+		*next = skb;
+		next = &skb->next;
+
+		head->len += skb->len;
+		head->data_len += skb->len;
+		head->truesize += skb->truesize;
+	}
+}
+
 static ieee80211_rx_result debug_noinline
 ieee80211_rx_h_defragment(struct ieee80211_rx_data *rx)
 {
@@ -1810,8 +1919,8 @@ ieee80211_rx_h_defragment(struct ieee80211_rx_data *rx)
 	u16 sc;
 	__le16 fc;
 	unsigned int frag, seq;
+	struct ieee80211_fragment_cache *cache;
 	struct ieee80211_fragment_entry *entry;
-	struct sk_buff *skb;
 	struct ieee80211_rx_status *status;
 
 	hdr = (struct ieee80211_hdr *)rx->skb->data;
@@ -1843,10 +1952,11 @@ ieee80211_rx_h_defragment(struct ieee80211_rx_data *rx)
 	 */
 	hdr = (struct ieee80211_hdr *)rx->skb->data;
 	seq = (sc & IEEE80211_SCTL_SEQ) >> 4;
+	cache = ieee80211_rx_frag_cache(rx);
 
 	if (frag == 0) {
 		/* This is the first fragment of a new frame. */
-		entry = ieee80211_reassemble_add(rx->sdata, frag, seq,
+		entry = ieee80211_reassemble_add(rx, cache, frag, seq,
 						 rx->seqno_idx, &(rx->skb));
 		if (rx->key &&
 		    (rx->key->conf.cipher == WLAN_CIPHER_SUITE_CCMP ||
@@ -1878,7 +1988,7 @@ ieee80211_rx_h_defragment(struct ieee80211_rx_data *rx)
 	/* This is a fragment for a frame that should already be pending in
 	 * fragment cache. Add this fragment to the end of the pending entry.
 	 */
-	entry = ieee80211_reassemble_find(rx->sdata, frag, seq,
+	entry = ieee80211_reassemble_find(rx, cache, frag, seq,
 					  rx->seqno_idx, hdr);
 	if (!entry) {
 		I802_DEBUG_INC(rx->local->rx_handlers_drop_defrag);
@@ -1917,25 +2027,18 @@ ieee80211_rx_h_defragment(struct ieee80211_rx_data *rx)
 	skb_pull(rx->skb, ieee80211_hdrlen(fc));
 	__skb_queue_tail(&entry->skb_list, rx->skb);
 	entry->last_frag = frag;
-	entry->extra_len += rx->skb->len;
 	if (ieee80211_has_morefrags(fc)) {
 		rx->skb = NULL;
 		return RX_QUEUED;
 	}
 
 	rx->skb = __skb_dequeue(&entry->skb_list);
-	if (skb_tailroom(rx->skb) < entry->extra_len) {
-		I802_DEBUG_INC(rx->local->rx_expand_skb_head_defrag);
-		if (unlikely(pskb_expand_head(rx->skb, 0, entry->extra_len,
-					      GFP_ATOMIC))) {
-			I802_DEBUG_INC(rx->local->rx_handlers_drop_defrag);
-			__skb_queue_purge(&entry->skb_list);
-			return RX_DROP_UNUSABLE;
-		}
-	}
-	while ((skb = __skb_dequeue(&entry->skb_list))) {
-		memcpy(skb_put(rx->skb, skb->len), skb->data, skb->len);
-		dev_kfree_skb(skb);
+	ieee80211_reassemble_chain(rx->skb, &entry->skb_list);
+
+	/* management frame handlers parse the body in place */
+	if (!ieee80211_is_data(fc) && skb_linearize(rx->skb)) {
+		I802_DEBUG_INC(rx->local->rx_handlers_drop_defrag);
+		return RX_DROP_UNUSABLE;
 	}
 
 	/* Complete frame has been reassembled - process it now */
@@ -3105,7 +3208,7 @@ static void ieee80211_rx_cooked_monitor(struct ieee80211_rx_data *rx,
 			continue;
 
 		if (sdata->vif.type != NL80211_IFTYPE_MONITOR ||
-		    !(sdata->u.mntr_flags & MONITOR_FLAG_COOK_FRAMES))
+		    !(sdata->u.mntr.flags & MONITOR_FLAG_COOK_FRAMES))
 			continue;
 
 		if (prev_dev) {
@@ -3444,6 +3547,41 @@ static bool ieee80211_prepare_and_rx_handle(struct ieee80211_rx_data *rx,
 	return true;
 }
 
+/*
+ * Look up the station that was last found for this transmitter address on
+ * this CPU. Only stations that were the sole match for their address are
+ * cached, so a hit can be handled exactly like a hash table lookup.
+ * Must be called under RCU with BHs disabled.
+ */
+static struct sta_info *
+ieee80211_rx_sta_cache_get(struct ieee80211_local *local, const u8 *addr)
+{
+	struct ieee80211_rx_sta_cache *cache;
+
+	cache = this_cpu_ptr(local->rx_sta_cache);
+	if (cache->gen != ACCESS_ONCE(local->rx_sta_cache_gen) ||
+	    !cache->sta || !ether_addr_equal(cache->addr, addr))
+		return NULL;
+
+	smp_rmb();
+	return cache->sta;
+}
+
+/*
+ * @gen must have been sampled before the lookup that found @sta, so a
+ * concurrent addition or removal leaves the entry invalid.
+ */
+static void ieee80211_rx_sta_cache_set(struct ieee80211_local *local,
+				       struct sta_info *sta, unsigned int gen)
+{
+	struct ieee80211_rx_sta_cache *cache;
+
+	cache = this_cpu_ptr(local->rx_sta_cache);
+	cache->sta = sta;
+	cache->gen = gen;
+	memcpy(cache->addr, sta->sta.addr, ETH_ALEN);
+}
+
 /*
  * This is the actual Rx frames handler. as it belongs to Rx path it must
  * be called with rcu_read_lock protection.
@@ -3496,8 +3634,15 @@ static void __ieee80211_rx_handle_packet(struct ieee80211_hw *hw,
 
 	if (ieee80211_is_data(fc)) {
 		const struct bucket_table *tbl;
+		unsigned int gen;
+		bool unique = true;
 
-		prev_sta = NULL;
+		prev_sta = ieee80211_rx_sta_cache_get(local, hdr->addr2);
+		if (prev_sta)
+			goto found_sta;
+
+		gen = ACCESS_ONCE(local->rx_sta_cache_gen);
+		smp_rmb();
 
 		tbl = rht_dereference_rcu(local->sta_hash.tbl, &local->sta_hash);
 
@@ -3512,8 +3657,13 @@ static void __ieee80211_rx_handle_packet(struct ieee80211_hw *hw,
 			ieee80211_prepare_and_rx_handle(&rx, skb, false);
 
 			prev_sta = sta;
+			unique = false;
 		}
 
+		if (prev_sta && unique)
+			ieee80211_rx_sta_cache_set(local, prev_sta, gen);
+
+ found_sta:
 		if (prev_sta) {
 			rx.sta = prev_sta;
 			rx.sdata = prev_sta->sdata;
@@ -74,12 +74,26 @@ static const struct rhashtable_params sta_rht_params = {
 	.max_size = CPTCFG_MAC80211_STA_HASH_MAX_SIZE,
 };
 
+/*
+ * Invalidate the RX path's per-CPU station caches; see
+ * ieee80211_rx_sta_cache_get(). Caller must hold local->sta_mtx.
+ */
+static void sta_info_rx_cache_flush(struct ieee80211_local *local)
+{
+	ACCESS_ONCE(local->rx_sta_cache_gen) = local->rx_sta_cache_gen + 1;
+	smp_wmb();
+}
+
 /* Caller must hold local->sta_mtx */
 static int sta_info_hash_del(struct ieee80211_local *local,
 			     struct sta_info *sta)
 {
-	return rhashtable_remove_fast(&local->sta_hash, &sta->hash_node,
-				      sta_rht_params);
+	int ret;
+
+	ret = rhashtable_remove_fast(&local->sta_hash, &sta->hash_node,
+				     sta_rht_params);
+	sta_info_rx_cache_flush(local);
+	return ret;
 }
 
 static void __cleanup_single_sta(struct sta_info *sta)
@@ -110,19 +124,14 @@ static void __cleanup_single_sta(struct sta_info *sta)
 
 	if (sta->sta.txq[0]) {
 		for (i = 0; i < ARRAY_SIZE(sta->sta.txq); i++) {
-			struct txq_info *txqi = to_txq_info(sta->sta.txq[i]);
-			int n = skb_queue_len(&txqi->queue);
-
-			ieee80211_purge_tx_queue(&local->hw, &txqi->queue);
-			atomic_sub(n, &sdata->txqs_len[txqi->txq.ac]);
+			ieee80211_txq_purge(local,
+					    to_txq_info(sta->sta.txq[i]));
 		}
 	}
 
-	for (ac = 0; ac < IEEE80211_NUM_ACS; ac++) {
-		local->total_ps_buffered -= skb_queue_len(&sta->ps_tx_buf[ac]);
-		ieee80211_purge_tx_queue(&local->hw, &sta->ps_tx_buf[ac]);
+	ieee80211_sta_ps_buf_purge(sta);
+	for (ac = 0; ac < IEEE80211_NUM_ACS; ac++)
 		ieee80211_purge_tx_queue(&local->hw, &sta->tx_filtered[ac]);
-	}
 
 	if (ieee80211_vif_is_mesh(&sdata->vif))
 		mesh_sta_cleanup(sta);
@@ -215,6 +224,29 @@ struct sta_info *sta_info_get_by_idx(struct ieee80211_sub_if_data *sdata,
 	struct sta_info *sta;
 	int i = 0;
 
+	lockdep_assert_held(&local->sta_mtx);
+
+	/*
+	 * Dumps ask for increasing indices, so rather than walking the
+	 * list from the start each time continue from the station that
+	 * was returned last, as long as no station was added or removed.
+	 */
+	sta = sdata->dump_sta;
+	if (sta && sdata->dump_sta_gen == local->sta_generation &&
+	    sta->sdata == sdata && idx >= sdata->dump_sta_idx) {
+		i = sdata->dump_sta_idx;
+		if (i == idx)
+			goto found;
+
+		list_for_each_entry_continue_rcu(sta, &local->sta_list, list) {
+			if (sdata != sta->sdata)
+				continue;
+			if (++i == idx)
+				goto found;
+		}
+		return NULL;
+	}
+
 	list_for_each_entry_rcu(sta, &local->sta_list, list) {
 		if (sdata != sta->sdata)
 			continue;
@@ -222,10 +254,15 @@ struct sta_info *sta_info_get_by_idx(struct ieee80211_sub_if_data *sdata,
 			++i;
 			continue;
 		}
-		return sta;
+		goto found;
 	}
 
 	return NULL;
+ found:
+	sdata->dump_sta = sta;
+	sdata->dump_sta_idx = idx;
+	sdata->dump_sta_gen = local->sta_generation;
+	return sta;
 }
 
 /**
@@ -246,6 +283,8 @@ void sta_info_free(struct ieee80211_local *local, struct sta_info *sta)
 
 	sta_dbg(sta->sdata, "Destroyed STA %pM\n", sta->sta.addr);
 
+	ieee80211_destroy_frag_cache(&sta->frags);
+
 	if (sta->sta.txq[0])
 		kfree(to_txq_info(sta->sta.txq[0]));
 	kfree(rcu_dereference_raw(sta->sta.rates));
@@ -259,8 +298,13 @@ void sta_info_free(struct ieee80211_local *local, struct sta_info *sta)
 static int sta_info_hash_add(struct ieee80211_local *local,
 			     struct sta_info *sta)
 {
-	return rhashtable_insert_fast(&local->sta_hash, &sta->hash_node,
-				      sta_rht_params);
+	int ret;
+
+	ret = rhashtable_insert_fast(&local->sta_hash, &sta->hash_node,
+				     sta_rht_params);
+	/* the cache only holds unambiguous lookups, this may add a match */
+	sta_info_rx_cache_flush(local);
+	return ret;
 }
 
 static void sta_deliver_ps_frames(struct work_struct *wk)
@@ -314,6 +358,9 @@ struct sta_info *sta_info_alloc(struct ieee80211_sub_if_data *sdata,
 	INIT_WORK(&sta->drv_deliver_wk, sta_deliver_ps_frames);
 	INIT_WORK(&sta->ampdu_mlme.work, ieee80211_ba_session_work);
 	mutex_init(&sta->ampdu_mlme.mtx);
+	ieee80211_init_frag_cache(&sta->frags);
+	for (i = 0; i < IEEE80211_NUM_ACS; i++)
+		sta->airtime[i].deficit = IEEE80211_AIRTIME_QUANTUM;
 #ifdef CPTCFG_MAC80211_MESH
 	if (ieee80211_vif_is_mesh(&sdata->vif)) {
 		sta->mesh = kzalloc(sizeof(*sta->mesh), gfp);
@@ -377,6 +424,7 @@ struct sta_info *sta_info_alloc(struct ieee80211_sub_if_data *sdata,
 		skb_queue_head_init(&sta->ps_tx_buf[i]);
 		skb_queue_head_init(&sta->tx_filtered[i]);
 	}
+	INIT_LIST_HEAD(&sta->ps_buf_list);
 
 	for (i = 0; i < IEEE80211_NUM_TIDS; i++)
 		sta->last_seq_ctrl[i] = cpu_to_le16(USHRT_MAX);
@@ -724,9 +772,23 @@ void sta_info_recalc_tim(struct sta_info *sta)
 	__sta_info_recalc_tim(sta, false);
 }
 
-static bool sta_info_buffer_expired(struct sta_info *sta, struct sk_buff *skb)
+/*
+ * Upper bound on the time a frame may stay buffered for a station in
+ * powersave, per AC. Late voice and video frames are of no use to the
+ * station anyway; zero leaves only the listen interval based expiry.
+ */
+static const unsigned int sta_ps_buf_max_age_ms[IEEE80211_NUM_ACS] = {
+	[IEEE80211_AC_VO] = 1000,
+	[IEEE80211_AC_VI] = 2000,
+	[IEEE80211_AC_BE] = 0,
+	[IEEE80211_AC_BK] = 0,
+};
+
+static bool sta_info_buffer_expired(struct sta_info *sta, int ac,
+				    struct sk_buff *skb)
 {
 	struct ieee80211_tx_info *info;
+	unsigned long max_age;
 	int timeout;
 
 	if (!skb)
@@ -740,13 +802,198 @@ static bool sta_info_buffer_expired(struct sta_info *sta, struct sk_buff *skb)
 		   32 / 15625) * HZ;
 	if (timeout < STA_TX_BUFFER_EXPIRE)
 		timeout = STA_TX_BUFFER_EXPIRE;
+
+	if (sta_ps_buf_max_age_ms[ac]) {
+		max_age = msecs_to_jiffies(sta_ps_buf_max_age_ms[ac]);
+		if (timeout > max_age)
+			timeout = max_age;
+	}
+
 	return time_after(jiffies, info->control.jiffies + timeout);
 }
 
+/*
+ * The PS buffers of all stations share local->ps_buf_lock, which protects
+ * the byte accounting and the list of buffering stations; the skb queue
+ * locks nest inside it.
+ */
+static struct sk_buff *__sta_ps_buf_dequeue(struct sta_info *sta, int ac)
+{
+	struct ieee80211_local *local = sta->local;
+	struct sk_buff *skb;
+
+	lockdep_assert_held(&local->ps_buf_lock);
+
+	skb = skb_dequeue(&sta->ps_tx_buf[ac]);
+	if (!skb)
+		return NULL;
+
+	sta->ps_buf_bytes -= skb->truesize;
+	local->total_ps_buf_bytes -= skb->truesize;
+	atomic_dec(&local->total_ps_buffered);
+	if (!sta->ps_buf_bytes)
+		list_del_init(&sta->ps_buf_list);
+
+	return skb;
+}
+
+static void __sta_ps_buf_expire(struct sta_info *sta, int ac,
+				struct sk_buff_head *dropped)
+{
+	while (sta_info_buffer_expired(sta, ac, skb_peek(&sta->ps_tx_buf[ac])))
+		__skb_queue_tail(dropped, __sta_ps_buf_dequeue(sta, ac));
+}
+
+/*
+ * Free up memory for the global budget: drop the oldest frame of the
+ * lowest priority AC of the station that has been buffering the longest,
+ * and put that station at the end of the line.
+ */
+static struct sk_buff *__sta_ps_buf_evict(struct ieee80211_local *local)
+{
+	struct sk_buff *skb = NULL;
+	struct sta_info *sta;
+	int ac;
+
+	sta = list_first_entry_or_null(&local->ps_buf_stations,
+				       struct sta_info, ps_buf_list);
+	if (!sta)
+		return NULL;
+
+	for (ac = IEEE80211_AC_BK; ac >= IEEE80211_AC_VO && !skb; ac--)
+		skb = __sta_ps_buf_dequeue(sta, ac);
+
+	if (sta->ps_buf_bytes)
+		list_move_tail(&sta->ps_buf_list, &local->ps_buf_stations);
+
+	return skb;
+}
+
+/**
+ * ieee80211_sta_ps_buf_add - buffer a frame for a station in powersave
+ * @sta: the station
+ * @ac: the AC the frame is for
+ * @skb: the frame, with info->control.jiffies set
+ *
+ * Makes room for the frame within the per-station and global memory
+ * budgets, dropping expired frames and then the oldest frames of the
+ * same or lower priority ACs. The frame is freed if it doesn't fit.
+ *
+ * Return: %true if the frame was buffered.
+ */
+bool ieee80211_sta_ps_buf_add(struct sta_info *sta, int ac,
+			      struct sk_buff *skb)
+{
+	struct ieee80211_local *local = sta->local;
+	struct sk_buff_head expired, dropped;
+	struct sk_buff *old;
+	unsigned long flags;
+	bool queued = true;
+	int drop_ac = IEEE80211_AC_BK;
+
+	skb_queue_head_init(&expired);
+	skb_queue_head_init(&dropped);
+
+	spin_lock_irqsave(&local->ps_buf_lock, flags);
+
+	/* the cleanup timer runs too rarely for the short per-AC ages */
+	__sta_ps_buf_expire(sta, ac, &expired);
+
+	while (sta->ps_buf_bytes + skb->truesize > STA_MAX_PS_BUF_BYTES &&
+	       drop_ac >= ac) {
+		old = __sta_ps_buf_dequeue(sta, drop_ac);
+		if (old)
+			__skb_queue_tail(&dropped, old);
+		else
+			drop_ac--;
+	}
+
+	if (sta->ps_buf_bytes + skb->truesize > STA_MAX_PS_BUF_BYTES) {
+		__skb_queue_tail(&dropped, skb);
+		queued = false;
+		goto out;
+	}
+
+	while (local->total_ps_buf_bytes + skb->truesize >
+	       TOTAL_MAX_PS_BUF_BYTES) {
+		old = __sta_ps_buf_evict(local);
+		if (!old)
+			break;
+		__skb_queue_tail(&dropped, old);
+	}
+
+	if (!sta->ps_buf_bytes)
+		list_add_tail(&sta->ps_buf_list, &local->ps_buf_stations);
+	sta->ps_buf_bytes += skb->truesize;
+	local->total_ps_buf_bytes += skb->truesize;
+	atomic_inc(&local->total_ps_buffered);
+	skb_queue_tail(&sta->ps_tx_buf[ac], skb);
+
+ out:
+	spin_unlock_irqrestore(&local->ps_buf_lock, flags);
+
+	if (!skb_queue_empty(&expired))
+		ps_dbg(sta->sdata,
+		       "STA %pM PS buffer for AC %d - %d frames expired\n",
+		       sta->sta.addr, ac, skb_queue_len(&expired));
+	if (!skb_queue_empty(&dropped))
+		ps_dbg(sta->sdata,
+		       "STA %pM PS buffer for AC %d full - dropped %d frames\n",
+		       sta->sta.addr, ac, skb_queue_len(&dropped));
+	ieee80211_purge_tx_queue(&local->hw, &expired);
+	ieee80211_purge_tx_queue(&local->hw, &dropped);
+
+	return queued;
+}
+
+struct sk_buff *ieee80211_sta_ps_buf_dequeue(struct sta_info *sta, int ac)
+{
+	struct ieee80211_local *local = sta->local;
+	struct sk_buff *skb;
+	unsigned long flags;
+
+	spin_lock_irqsave(&local->ps_buf_lock, flags);
+	skb = __sta_ps_buf_dequeue(sta, ac);
+	spin_unlock_irqrestore(&local->ps_buf_lock, flags);
+
+	return skb;
+}
+
+/* Move all buffered frames of an AC to the tail of @list */
+int ieee80211_sta_ps_buf_splice(struct sta_info *sta, int ac,
+				struct sk_buff_head *list)
+{
+	struct ieee80211_local *local = sta->local;
+	struct sk_buff *skb;
+	unsigned long flags;
+	int n = 0;
+
+	spin_lock_irqsave(&local->ps_buf_lock, flags);
+	while ((skb = __sta_ps_buf_dequeue(sta, ac))) {
+		__skb_queue_tail(list, skb);
+		n++;
+	}
+	spin_unlock_irqrestore(&local->ps_buf_lock, flags);
+
+	return n;
+}
+
+void ieee80211_sta_ps_buf_purge(struct sta_info *sta)
+{
+	struct sk_buff_head frames;
+	int ac;
+
+	skb_queue_head_init(&frames);
+	for (ac = 0; ac < IEEE80211_NUM_ACS; ac++)
+		ieee80211_sta_ps_buf_splice(sta, ac, &frames);
+	ieee80211_purge_tx_queue(&sta->local->hw, &frames);
+}
+
 
 static bool sta_info_cleanup_expire_buffered_ac(struct ieee80211_local *local,
 						struct sta_info *sta, int ac)
 {
+	struct sk_buff_head expired;
 	unsigned long flags;
 	struct sk_buff *skb;
 
@@ -760,7 +1007,7 @@ static bool sta_info_cleanup_expire_buffered_ac(struct ieee80211_local *local,
 	for (;;) {
 		spin_lock_irqsave(&sta->tx_filtered[ac].lock, flags);
 		skb = skb_peek(&sta->tx_filtered[ac]);
-		if (sta_info_buffer_expired(sta, skb))
+		if (sta_info_buffer_expired(sta, ac, skb))
 			skb = __skb_dequeue(&sta->tx_filtered[ac]);
 		else
 			skb = NULL;
@@ -783,28 +1030,16 @@ static bool sta_info_cleanup_expire_buffered_ac(struct ieee80211_local *local,
 	 * since the filtered frames are all before the normal PS
 	 * buffered frames.
 	 */
-	for (;;) {
-		spin_lock_irqsave(&sta->ps_tx_buf[ac].lock, flags);
-		skb = skb_peek(&sta->ps_tx_buf[ac]);
-		if (sta_info_buffer_expired(sta, skb))
-			skb = __skb_dequeue(&sta->ps_tx_buf[ac]);
-		else
-			skb = NULL;
-		spin_unlock_irqrestore(&sta->ps_tx_buf[ac].lock, flags);
+	skb_queue_head_init(&expired);
 
-		/*
-		 * frames are queued in order, so if this one
-		 * hasn't expired yet (or we reached the end of
-		 * the queue) we can stop testing
-		 */
-		if (!skb)
-			break;
+	spin_lock_irqsave(&local->ps_buf_lock, flags);
+	__sta_ps_buf_expire(sta, ac, &expired);
+	spin_unlock_irqrestore(&local->ps_buf_lock, flags);
 
-		local->total_ps_buffered--;
-		ps_dbg(sta->sdata, "Buffered frame expired (STA %pM)\n",
-		       sta->sta.addr);
-		ieee80211_free_txskb(&local->hw, skb);
-	}
+	if (!skb_queue_empty(&expired))
+		ps_dbg(sta->sdata, "%d buffered frames expired (STA %pM)\n",
+		       skb_queue_len(&expired), sta->sta.addr);
+	ieee80211_purge_tx_queue(&local->hw, &expired);
 
 	/*
 	 * Finally, recalculate the TIM bit for this station -- it might
@@ -1031,6 +1266,12 @@ int sta_info_init(struct ieee80211_local *local)
 	if (err)
 		return err;
 
+	local->rx_sta_cache = alloc_percpu(struct ieee80211_rx_sta_cache);
+	if (!local->rx_sta_cache) {
+		rhashtable_destroy(&local->sta_hash);
+		return -ENOMEM;
+	}
+
 	spin_lock_init(&local->tim_lock);
 	mutex_init(&local->sta_mtx);
 	INIT_LIST_HEAD(&local->sta_list);
@@ -1044,6 +1285,7 @@ void sta_info_stop(struct ieee80211_local *local)
 {
 	del_timer_sync(&local->sta_cleanup);
 	rhashtable_destroy(&local->sta_hash);
+	free_percpu(local->rx_sta_cache);
 }
 
 
@@ -1187,7 +1429,7 @@ void ieee80211_sta_ps_deliver_wakeup(struct sta_info *sta)
 		for (i = 0; i < ARRAY_SIZE(sta->sta.txq); i++) {
 			struct txq_info *txqi = to_txq_info(sta->sta.txq[i]);
 
-			if (!skb_queue_len(&txqi->queue))
+			if (!txqi->backlog_packets)
 				continue;
 
 			drv_wake_tx_queue(local, txqi);
@@ -1200,20 +1442,14 @@ void ieee80211_sta_ps_deliver_wakeup(struct sta_info *sta)
 	spin_lock(&sta->ps_lock);
 	/* Send all buffered frames to the station */
 	for (ac = 0; ac < IEEE80211_NUM_ACS; ac++) {
-		int count = skb_queue_len(&pending), tmp;
+		int count = skb_queue_len(&pending);
 
 		spin_lock_irqsave(&sta->tx_filtered[ac].lock, flags);
 		skb_queue_splice_tail_init(&sta->tx_filtered[ac], &pending);
 		spin_unlock_irqrestore(&sta->tx_filtered[ac].lock, flags);
-		tmp = skb_queue_len(&pending);
-		filtered += tmp - count;
-		count = tmp;
+		filtered += skb_queue_len(&pending) - count;
 
-		spin_lock_irqsave(&sta->ps_tx_buf[ac].lock, flags);
-		skb_queue_splice_tail_init(&sta->ps_tx_buf[ac], &pending);
-		spin_unlock_irqrestore(&sta->ps_tx_buf[ac].lock, flags);
-		tmp = skb_queue_len(&pending);
-		buffered += tmp - count;
+		buffered += ieee80211_sta_ps_buf_splice(sta, ac, &pending);
 	}
 
 	ieee80211_add_pending_skbs(local, &pending);
@@ -1244,8 +1480,6 @@ void ieee80211_sta_ps_deliver_wakeup(struct sta_info *sta)
 					   sdata->vif.bss_conf.bssid);
 	}
 
-	local->total_ps_buffered -= buffered;
-
 	sta_info_recalc_tim(sta);
 
 	ps_dbg(sdata,
@@ -1401,12 +1635,9 @@ ieee80211_sta_ps_deliver_response(struct sta_info *sta,
 
 			while (n_frames > 0) {
 				skb = skb_dequeue(&sta->tx_filtered[ac]);
-				if (!skb) {
-					skb = skb_dequeue(
-						&sta->ps_tx_buf[ac]);
-					if (skb)
-						local->total_ps_buffered--;
-				}
+				if (!skb)
+					skb = ieee80211_sta_ps_buf_dequeue(sta,
+									   ac);
 				if (!skb)
 					break;
 				n_frames--;
@@ -1583,7 +1814,7 @@ ieee80211_sta_ps_deliver_response(struct sta_info *sta,
 		for (tid = 0; tid < ARRAY_SIZE(sta->sta.txq); tid++) {
 			struct txq_info *txqi = to_txq_info(sta->sta.txq[tid]);
 
-			if (!(tids & BIT(tid)) || skb_queue_len(&txqi->queue))
+			if (!(tids & BIT(tid)) || txqi->backlog_packets)
 				continue;
 
 			sta_info_recalc_tim(sta);
@@ -1874,13 +2105,9 @@ void sta_set_sinfo(struct sta_info *sta, struct station_info *sinfo)
 {
 	struct ieee80211_sub_if_data *sdata = sta->sdata;
 	struct ieee80211_local *local = sdata->local;
-	struct rate_control_ref *ref = NULL;
 	u32 thr = 0;
 	int i, ac;
 
-	if (test_sta_flag(sta, WLAN_STA_RATE_CONTROL))
-		ref = local->rate_ctrl;
-
 	sinfo->generation = sdata->local->sta_generation;
 
 	/* do before driver, so beacon filtering drivers have a
@@ -2080,14 +2307,24 @@ void sta_set_sinfo(struct sta_info *sta, struct station_info *sinfo)
 	if (test_sta_flag(sta, WLAN_STA_TDLS_PEER))
 		sinfo->sta_flags.set |= BIT(NL80211_STA_FLAG_TDLS_PEER);
 
-	/* check if the driver has a SW RC implementation */
-	if (ref && ref->ops->get_expected_throughput)
-		thr = ref->ops->get_expected_throughput(sta->rate_ctrl_priv);
-	else
-		thr = drv_get_expected_throughput(local, &sta->sta);
-
+	thr = sta_get_expected_throughput(sta);
 	if (thr != 0) {
 		sinfo->filled |= BIT(NL80211_STA_INFO_EXPECTED_THROUGHPUT);
 		sinfo->expected_throughput = thr;
 	}
 }
+
+u32 sta_get_expected_throughput(struct sta_info *sta)
+{
+	struct ieee80211_local *local = sta->sdata->local;
+	struct rate_control_ref *ref = NULL;
+
+	if (test_sta_flag(sta, WLAN_STA_RATE_CONTROL))
+		ref = local->rate_ctrl;
+
+	/* check if the driver has a SW RC implementation */
+	if (ref && ref->ops->get_expected_throughput)
+		return ref->ops->get_expected_throughput(sta->rate_ctrl_priv);
+
+	return drv_get_expected_throughput(local, &sta->sta);
+}
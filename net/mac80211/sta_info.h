@@ -14,6 +14,7 @@
 #include <linux/types.h>
 #include <linux/if_ether.h>
 #include <linux/workqueue.h>
+#include <linux/skbuff.h>
 #include <linux/average.h>
 #include <linux/etherdevice.h>
 #include <linux/rhashtable.h>
@@ -168,6 +169,9 @@ struct tid_ampdu_tx {
  * @reorder_buf: buffer to reorder incoming aggregated MPDUs. An MPDU may be an
  *	A-MSDU with individually reported subframes.
  * @reorder_time: jiffies when skb was added
+ * @reorder_ready: bitmap of reorder buffer slots holding a complete MPDU
+ *	(i.e. ready for release), so the release and timeout paths can
+ *	find the next frame without walking every slot.
  * @session_timer: check if peer keeps Tx-ing on the TID (by timeout value)
  * @reorder_timer: releases expired frames from the reorder buffer.
  * @last_rx: jiffies of last rx activity
@@ -182,6 +186,10 @@ struct tid_ampdu_tx {
  * @auto_seq: used for offloaded BA sessions to automatically pick head_seq_and
  *	and ssn.
  * @removed: this session is removed (but might have been found due to RCU)
+ * @reorder_holes: number of sequence numbers skipped because the frames
+ *	never arrived before the reorder timeout
+ * @reorder_timeouts: number of times frames were released due to timeout
+ * @reorder_drops: number of frames dropped as old, duplicate or incomplete
  *
  * This structure's lifetime is managed by RCU, assignments to
  * the array holding it must hold the aggregation mutex.
@@ -196,6 +204,7 @@ struct tid_ampdu_rx {
 	spinlock_t reorder_lock;
 	struct sk_buff_head *reorder_buf;
 	unsigned long *reorder_time;
+	DECLARE_BITMAP(reorder_ready, IEEE80211_MAX_AMPDU_BUF);
 	struct timer_list session_timer;
 	struct timer_list reorder_timer;
 	unsigned long last_rx;
@@ -207,6 +216,9 @@ struct tid_ampdu_rx {
 	u8 dialog_token;
 	bool auto_seq;
 	bool removed;
+	u32 reorder_holes;
+	u32 reorder_timeouts;
+	u32 reorder_drops;
 };
 
 /**
@@ -293,6 +305,8 @@ struct ieee80211_fast_tx {
  * @nonpeer_pm: STA power save mode towards non-peer neighbors
  * @processed_beacon: set to true after peer rates and capabilities are
  *	processed
+ * @beacon_crc: CRC of the elements of the last beacon fully processed
+ * @beacon_crc_valid: @beacon_crc is valid
  * @fail_avg: moving percentage of failed MSDUs
  */
 struct mesh_sta {
@@ -309,6 +323,8 @@ struct mesh_sta {
 	u8 plink_retries;
 
 	bool processed_beacon;
+	bool beacon_crc_valid;
+	u32 beacon_crc;
 
 	enum nl80211_plink_state plink_state;
 	u32 plink_timeout;
@@ -326,6 +342,32 @@ struct mesh_sta {
 
 DECLARE_EWMA(signal, 1024, 8)
 
+/* IEEE 802.11 (Ch. 9.5 Defragmentation) requires support for concurrent
+ * reception of at least three fragmented frames. Each station has its own
+ * cache of this size, with one more on the interface for frames from unknown
+ * transmitters. This limit can be increased by changing this define, at the
+ * cost of slower frame reassembly and increased memory use (about 2 kB of RAM
+ * per entry in use). */
+#define IEEE80211_FRAGMENT_MAX 4
+
+struct ieee80211_fragment_entry {
+	struct sk_buff_head skb_list;
+	unsigned long first_frag_time;
+	u16 seq;
+	u16 last_frag;
+	u8 rx_queue;
+	bool check_sequential_pn; /* needed for CCMP/GCMP */
+	u8 last_pn[6]; /* PN of the last fragment if CCMP was used */
+};
+
+struct ieee80211_fragment_cache {
+	struct ieee80211_fragment_entry	entries[IEEE80211_FRAGMENT_MAX];
+	unsigned int next;
+};
+
+/* airtime (in usecs) a station may use per round of the TX scheduler */
+#define IEEE80211_AIRTIME_QUANTUM	300
+
 /**
  * struct sta_info - STA information
  *
@@ -353,7 +395,11 @@ DECLARE_EWMA(signal, 1024, 8)
  * @_flags: STA flags, see &enum ieee80211_sta_info_flags, do not use directly
  * @ps_lock: used for powersave (when mac80211 is the AP) related locking
  * @ps_tx_buf: buffers (per AC) of frames to transmit to this station
- *	when it leaves power saving state or polls
+ *	when it leaves power saving state or polls, only modified under
+ *	local->ps_buf_lock through the ieee80211_sta_ps_buf_*() helpers
+ * @ps_buf_bytes: memory (skb truesize) used by the frames on @ps_tx_buf
+ * @ps_buf_list: entry in local->ps_buf_stations while @ps_tx_buf is
+ *	not empty
  * @tx_filtered: buffers (per AC) of frames we already tried to
  *	transmit but were filtered by hardware due to STA having
  *	entered power saving state, these are also delivered to
@@ -385,6 +431,10 @@ DECLARE_EWMA(signal, 1024, 8)
  *	the BSS one.
  * @tx_stats: TX statistics
  * @rx_stats: RX statistics
+ * @frags: fragment cache for host-based reassembly of frames from this
+ *	station, only accessed from the RX path
+ * @airtime: per-AC airtime used by this station, and the deficit for the
+ *	TX queue scheduler, protected by local->active_txq_lock
  * @status_stats: TX status statistics
  */
 struct sta_info {
@@ -426,6 +476,8 @@ struct sta_info {
 	spinlock_t ps_lock;
 	struct sk_buff_head ps_tx_buf[IEEE80211_NUM_ACS];
 	struct sk_buff_head tx_filtered[IEEE80211_NUM_ACS];
+	unsigned int ps_buf_bytes;
+	struct list_head ps_buf_list;
 	unsigned long driver_buffered_tids;
 	unsigned long txq_buffered_tids;
 
@@ -438,6 +490,8 @@ struct sta_info {
 		unsigned long last_rx;
 		unsigned long num_duplicates;
 		unsigned long fragments;
+		unsigned long frag_evicted;
+		unsigned long frag_timeouts;
 		unsigned long dropped;
 		int last_signal;
 		struct ewma_signal avg_signal;
@@ -451,6 +505,14 @@ struct sta_info {
 		u64 msdu[IEEE80211_NUM_TIDS + 1];
 	} rx_stats;
 
+	struct ieee80211_fragment_cache frags;
+
+	struct {
+		u64 rx_airtime;
+		u64 tx_airtime;
+		s64 deficit;
+	} airtime[IEEE80211_NUM_ACS];
+
 	/* Plus 1 for non-QoS frames */
 	__le16 last_seq_ctrl[IEEE80211_NUM_TIDS + 1];
 
@@ -575,9 +637,13 @@ rcu_dereference_protected_tid_tx(struct sta_info *sta, int tid)
 					 lockdep_is_held(&sta->ampdu_mlme.mtx));
 }
 
-/* Maximum number of frames to buffer per power saving station per AC */
+/* Maximum number of frames to buffer per station per AC on the filtered
+ * and aggregation pending queues */
 #define STA_MAX_TX_BUFFER	64
 
+/* Maximum memory used for buffering frames per power saving station */
+#define STA_MAX_PS_BUF_BYTES	(256 * 1024)
+
 /* Minimum buffered frame expiry time. If STA uses listen interval that is
  * smaller than this value, the minimum value here is used instead. */
 #define STA_TX_BUFFER_EXPIRE (10 * HZ)
@@ -608,7 +674,7 @@ u32 sta_addr_hash(const void *key, u32 length, u32 seed);
 	if (ether_addr_equal(_sta->addr, (_addr)))
 
 /*
- * Get STA info by index, BROKEN!
+ * Get STA info by index, BROKEN! Caller must hold local->sta_mtx.
  */
 struct sta_info *sta_info_get_by_idx(struct ieee80211_sub_if_data *sdata,
 				     int idx);
@@ -662,11 +728,19 @@ void sta_set_rate_info_tx(struct sta_info *sta,
 			  const struct ieee80211_tx_rate *rate,
 			  struct rate_info *rinfo);
 void sta_set_sinfo(struct sta_info *sta, struct station_info *sinfo);
+u32 sta_get_expected_throughput(struct sta_info *sta);
 
 void ieee80211_sta_expire(struct ieee80211_sub_if_data *sdata,
 			  unsigned long exp_time);
 u8 sta_info_tx_streams(struct sta_info *sta);
 
+bool ieee80211_sta_ps_buf_add(struct sta_info *sta, int ac,
+			      struct sk_buff *skb);
+struct sk_buff *ieee80211_sta_ps_buf_dequeue(struct sta_info *sta, int ac);
+int ieee80211_sta_ps_buf_splice(struct sta_info *sta, int ac,
+				struct sk_buff_head *list);
+void ieee80211_sta_ps_buf_purge(struct sta_info *sta);
+
 void ieee80211_sta_ps_deliver_wakeup(struct sta_info *sta);
 void ieee80211_sta_ps_deliver_poll_response(struct sta_info *sta);
 void ieee80211_sta_ps_deliver_uapsd(struct sta_info *sta);
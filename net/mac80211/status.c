@@ -671,22 +671,18 @@ void ieee80211_tx_status_noskb(struct ieee80211_hw *hw,
 }
 EXPORT_SYMBOL(ieee80211_tx_status_noskb);
 
-void ieee80211_tx_monitor(struct ieee80211_local *local, struct sk_buff *skb,
-			  struct ieee80211_supported_band *sband,
-			  int retry_count, int shift, bool send_to_cooked)
+static bool ieee80211_tx_monitor_prepare(struct ieee80211_local *local,
+					 struct sk_buff *skb,
+					 struct ieee80211_supported_band *sband,
+					 int retry_count, int shift)
 {
-	struct sk_buff *skb2;
 	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
-	struct ieee80211_sub_if_data *sdata;
-	struct net_device *prev_dev = NULL;
 	int rtap_len;
 
-	/* send frame to monitor interfaces now */
 	rtap_len = ieee80211_tx_radiotap_len(info);
 	if (WARN_ON_ONCE(skb_headroom(skb) < rtap_len)) {
 		pr_err("ieee80211_tx_status: headroom too small\n");
-		dev_kfree_skb(skb);
-		return;
+		return false;
 	}
 	ieee80211_add_tx_radiotap_header(local, sband, skb, retry_count,
 					 rtap_len, shift);
@@ -698,26 +694,37 @@ void ieee80211_tx_monitor(struct ieee80211_local *local, struct sk_buff *skb,
 	skb->protocol = htons(ETH_P_802_2);
 	memset(skb->cb, 0, sizeof(skb->cb));
 
+	return true;
+}
+
+void ieee80211_tx_monitor(struct ieee80211_local *local, struct sk_buff *skb,
+			  struct ieee80211_supported_band *sband,
+			  int retry_count, int shift, bool send_to_cooked)
+{
+	struct sk_buff *skb2;
+	struct ieee80211_sub_if_data *sdata;
+	struct net_device *prev_dev = NULL;
+
+	/* send frame to monitor interfaces now, radiotap only if needed */
 	rcu_read_lock();
 	list_for_each_entry_rcu(sdata, &local->interfaces, list) {
-		if (sdata->vif.type == NL80211_IFTYPE_MONITOR) {
-			if (!ieee80211_sdata_running(sdata))
-				continue;
+		if (!ieee80211_mntr_wants_frame(sdata, send_to_cooked))
+			continue;
 
-			if ((sdata->u.mntr_flags & MONITOR_FLAG_COOK_FRAMES) &&
-			    !send_to_cooked)
-				continue;
+		if (!prev_dev &&
+		    !ieee80211_tx_monitor_prepare(local, skb, sband,
+						  retry_count, shift))
+			break;
 
-			if (prev_dev) {
-				skb2 = skb_clone(skb, GFP_ATOMIC);
-				if (skb2) {
-					skb2->dev = prev_dev;
-					netif_rx(skb2);
-				}
+		if (prev_dev) {
+			skb2 = skb_clone(skb, GFP_ATOMIC);
+			if (skb2) {
+				skb2->dev = prev_dev;
+				netif_rx(skb2);
 			}
-
-			prev_dev = sdata->dev;
 		}
+
+		prev_dev = sdata->dev;
 	}
 	if (prev_dev) {
 		skb->dev = prev_dev;
@@ -728,151 +735,188 @@ void ieee80211_tx_monitor(struct ieee80211_local *local, struct sk_buff *skb,
 	dev_kfree_skb(skb);
 }
 
-void ieee80211_tx_status(struct ieee80211_hw *hw, struct sk_buff *skb)
+/*
+ * Per-station status processing that has to happen before rate control sees
+ * the frame. Returns true if the frame was consumed, i.e. it was filtered
+ * and is kept for retransmission.
+ */
+static bool ieee80211_tx_status_sta(struct ieee80211_local *local,
+				    struct sta_info *sta, struct sk_buff *skb)
 {
 	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *) skb->data;
-	struct ieee80211_local *local = hw_to_local(hw);
 	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
-	__le16 fc;
-	struct ieee80211_supported_band *sband;
-	struct sta_info *sta;
-	struct rhash_head *tmp;
+	__le16 fc = hdr->frame_control;
 	int retry_count;
 	int rates_idx;
-	bool send_to_cooked;
 	bool acked;
 	struct ieee80211_bar *bar;
-	int shift = 0;
 	int tid = IEEE80211_NUM_TIDS;
-	const struct bucket_table *tbl;
 
-	rates_idx = ieee80211_tx_get_rates(hw, info, &retry_count);
+	rates_idx = ieee80211_tx_get_rates(&local->hw, info, &retry_count);
 
-	rcu_read_lock();
+	if (info->flags & IEEE80211_TX_STATUS_EOSP)
+		clear_sta_flag(sta, WLAN_STA_SP);
 
-	sband = local->hw.wiphy->bands[info->band];
-	fc = hdr->frame_control;
+	acked = !!(info->flags & IEEE80211_TX_STAT_ACK);
+	if (!acked && test_sta_flag(sta, WLAN_STA_PS_STA)) {
+		/*
+		 * The STA is in power save mode, so assume
+		 * that this TX packet failed because of that.
+		 */
+		ieee80211_handle_filtered_frame(local, sta, skb);
+		return true;
+	}
 
-	tbl = rht_dereference_rcu(local->sta_hash.tbl, &local->sta_hash);
+	/* mesh Peer Service Period support */
+	if (ieee80211_vif_is_mesh(&sta->sdata->vif) &&
+	    ieee80211_is_data_qos(fc))
+		ieee80211_mpsp_trigger_process(ieee80211_get_qos_ctl(hdr),
+					       sta, true, acked);
+
+	if (ieee80211_hw_check(&local->hw, HAS_RATE_CONTROL) &&
+	    (ieee80211_is_data(hdr->frame_control)) &&
+	    (rates_idx != -1))
+		sta->tx_stats.last_rate = info->status.rates[rates_idx];
+
+	if ((info->flags & IEEE80211_TX_STAT_AMPDU_NO_BACK) &&
+	    (ieee80211_is_data_qos(fc))) {
+		u16 ssn;
+		u8 *qc;
+
+		qc = ieee80211_get_qos_ctl(hdr);
+		tid = qc[0] & 0xf;
+		ssn = ((le16_to_cpu(hdr->seq_ctrl) + 0x10)
+					& IEEE80211_SCTL_SEQ);
+		ieee80211_send_bar(&sta->sdata->vif, hdr->addr1,
+				   tid, ssn);
+	} else if (ieee80211_is_data_qos(fc)) {
+		u8 *qc = ieee80211_get_qos_ctl(hdr);
 
-	for_each_sta_info(local, tbl, hdr->addr1, sta, tmp) {
-		/* skip wrong virtual interface */
-		if (!ether_addr_equal(hdr->addr2, sta->sdata->vif.addr))
-			continue;
+		tid = qc[0] & 0xf;
+	}
 
-		shift = ieee80211_vif_get_shift(&sta->sdata->vif);
+	if (!acked && ieee80211_is_back_req(fc)) {
+		u16 control;
 
-		if (info->flags & IEEE80211_TX_STATUS_EOSP)
-			clear_sta_flag(sta, WLAN_STA_SP);
+		/*
+		 * BAR failed, store the last SSN and retry sending
+		 * the BAR when the next unicast transmission on the
+		 * same TID succeeds.
+		 */
+		bar = (struct ieee80211_bar *) skb->data;
+		control = le16_to_cpu(bar->control);
+		if (!(control & IEEE80211_BAR_CTRL_MULTI_TID)) {
+			u16 ssn = le16_to_cpu(bar->start_seq_num);
 
-		acked = !!(info->flags & IEEE80211_TX_STAT_ACK);
-		if (!acked && test_sta_flag(sta, WLAN_STA_PS_STA)) {
-			/*
-			 * The STA is in power save mode, so assume
-			 * that this TX packet failed because of that.
-			 */
-			ieee80211_handle_filtered_frame(local, sta, skb);
-			rcu_read_unlock();
-			return;
-		}
+			tid = (control &
+			       IEEE80211_BAR_CTRL_TID_INFO_MASK) >>
+			      IEEE80211_BAR_CTRL_TID_INFO_SHIFT;
 
-		/* mesh Peer Service Period support */
-		if (ieee80211_vif_is_mesh(&sta->sdata->vif) &&
-		    ieee80211_is_data_qos(fc))
-			ieee80211_mpsp_trigger_process(
-					ieee80211_get_qos_ctl(hdr),
-					sta, true, acked);
-
-		if (ieee80211_hw_check(&local->hw, HAS_RATE_CONTROL) &&
-		    (ieee80211_is_data(hdr->frame_control)) &&
-		    (rates_idx != -1))
-			sta->tx_stats.last_rate =
-				info->status.rates[rates_idx];
-
-		if ((info->flags & IEEE80211_TX_STAT_AMPDU_NO_BACK) &&
-		    (ieee80211_is_data_qos(fc))) {
-			u16 ssn;
-			u8 *qc;
-
-			qc = ieee80211_get_qos_ctl(hdr);
-			tid = qc[0] & 0xf;
-			ssn = ((le16_to_cpu(hdr->seq_ctrl) + 0x10)
-						& IEEE80211_SCTL_SEQ);
-			ieee80211_send_bar(&sta->sdata->vif, hdr->addr1,
-					   tid, ssn);
-		} else if (ieee80211_is_data_qos(fc)) {
-			u8 *qc = ieee80211_get_qos_ctl(hdr);
-
-			tid = qc[0] & 0xf;
+			ieee80211_set_bar_pending(sta, tid, ssn);
 		}
+	}
 
-		if (!acked && ieee80211_is_back_req(fc)) {
-			u16 control;
+	if (info->flags & IEEE80211_TX_STAT_TX_FILTERED) {
+		ieee80211_handle_filtered_frame(local, sta, skb);
+		return true;
+	}
 
-			/*
-			 * BAR failed, store the last SSN and retry sending
-			 * the BAR when the next unicast transmission on the
-			 * same TID succeeds.
-			 */
-			bar = (struct ieee80211_bar *) skb->data;
-			control = le16_to_cpu(bar->control);
-			if (!(control & IEEE80211_BAR_CTRL_MULTI_TID)) {
-				u16 ssn = le16_to_cpu(bar->start_seq_num);
+	if (!acked)
+		sta->status_stats.retry_failed++;
+	sta->status_stats.retry_count += retry_count;
 
-				tid = (control &
-				       IEEE80211_BAR_CTRL_TID_INFO_MASK) >>
-				      IEEE80211_BAR_CTRL_TID_INFO_SHIFT;
+	if (ieee80211_is_data_present(fc)) {
+		if (!acked)
+			sta->status_stats.msdu_failed[tid]++;
 
-				ieee80211_set_bar_pending(sta, tid, ssn);
-			}
-		}
+		sta->status_stats.msdu_retries[tid] += retry_count;
+	}
+
+	return false;
+}
+
+/*
+ * Charge the airtime a data frame used to its station, for the airtime
+ * fair scheduler. Drivers that report the real time on air do so in
+ * status.tx_time; otherwise estimate it from the expected throughput.
+ */
+static void ieee80211_tx_status_airtime(struct ieee80211_local *local,
+					struct sta_info *sta,
+					struct sk_buff *skb)
+{
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *) skb->data;
+	u8 tid = skb->priority & IEEE80211_QOS_CTL_TID_MASK;
+	u32 airtime, tput;
 
-		if (info->flags & IEEE80211_TX_STAT_TX_FILTERED) {
-			ieee80211_handle_filtered_frame(local, sta, skb);
-			rcu_read_unlock();
+	if (!local->ops->wake_tx_queue ||
+	    !ieee80211_is_data(hdr->frame_control))
+		return;
+
+	airtime = info->status.tx_time;
+	if (!airtime) {
+		tput = sta_get_expected_throughput(sta);
+		if (!tput)
 			return;
-		} else {
-			if (!acked)
-				sta->status_stats.retry_failed++;
-			sta->status_stats.retry_count += retry_count;
+		airtime = DIV_ROUND_UP(skb->len * 8000, tput);
+	}
 
-			if (ieee80211_is_data_present(fc)) {
-				if (!acked)
-					sta->status_stats.msdu_failed[tid]++;
+	ieee80211_sta_register_airtime(&sta->sta, tid, airtime, 0);
+}
 
-				sta->status_stats.msdu_retries[tid] +=
-					retry_count;
-			}
-		}
+/*
+ * Per-station status processing once rate control has seen the frame.
+ */
+static void ieee80211_tx_status_sta_done(struct ieee80211_local *local,
+					 struct sta_info *sta,
+					 struct sk_buff *skb)
+{
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+	bool acked = !!(info->flags & IEEE80211_TX_STAT_ACK);
 
-		rate_control_tx_status(local, sband, sta, skb);
-		if (ieee80211_vif_is_mesh(&sta->sdata->vif))
-			ieee80211s_update_metric(local, sta, skb);
-
-		if (!(info->flags & IEEE80211_TX_CTL_INJECTED) && acked)
-			ieee80211_frame_acked(sta, skb);
-
-		if ((sta->sdata->vif.type == NL80211_IFTYPE_STATION) &&
-		    ieee80211_hw_check(&local->hw, REPORTS_TX_ACK_STATUS))
-			ieee80211_sta_tx_notify(sta->sdata, (void *) skb->data,
-						acked, info->status.tx_time);
-
-		if (ieee80211_hw_check(&local->hw, REPORTS_TX_ACK_STATUS)) {
-			if (info->flags & IEEE80211_TX_STAT_ACK) {
-				if (sta->status_stats.lost_packets)
-					sta->status_stats.lost_packets = 0;
-
-				/* Track when last TDLS packet was ACKed */
-				if (test_sta_flag(sta, WLAN_STA_TDLS_PEER_AUTH))
-					sta->status_stats.last_tdls_pkt_time =
-						jiffies;
-			} else {
-				ieee80211_lost_packet(sta, info);
-			}
+	ieee80211_tx_status_airtime(local, sta, skb);
+
+	if (ieee80211_vif_is_mesh(&sta->sdata->vif))
+		ieee80211s_update_metric(local, sta, skb);
+
+	if (!(info->flags & IEEE80211_TX_CTL_INJECTED) && acked)
+		ieee80211_frame_acked(sta, skb);
+
+	if ((sta->sdata->vif.type == NL80211_IFTYPE_STATION) &&
+	    ieee80211_hw_check(&local->hw, REPORTS_TX_ACK_STATUS))
+		ieee80211_sta_tx_notify(sta->sdata, (void *) skb->data,
+					acked, info->status.tx_time);
+
+	if (ieee80211_hw_check(&local->hw, REPORTS_TX_ACK_STATUS)) {
+		if (acked) {
+			if (sta->status_stats.lost_packets)
+				sta->status_stats.lost_packets = 0;
+
+			/* Track when last TDLS packet was ACKed */
+			if (test_sta_flag(sta, WLAN_STA_TDLS_PEER_AUTH))
+				sta->status_stats.last_tdls_pkt_time = jiffies;
+		} else {
+			ieee80211_lost_packet(sta, info);
 		}
 	}
+}
 
-	rcu_read_unlock();
+/*
+ * Station independent part of the status processing: counters, ack and
+ * used-skb reporting, and delivery to monitor interfaces. Consumes the skb.
+ */
+static void ieee80211_tx_status_finish(struct ieee80211_local *local,
+				       struct sk_buff *skb, int shift)
+{
+	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *) skb->data;
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+	struct ieee80211_supported_band *sband;
+	__le16 fc = hdr->frame_control;
+	int retry_count;
+	bool send_to_cooked;
+
+	ieee80211_tx_get_rates(&local->hw, info, &retry_count);
+	sband = local->hw.wiphy->bands[info->band];
 
 	ieee80211_led_tx(local);
 
@@ -938,8 +982,104 @@ void ieee80211_tx_status(struct ieee80211_hw *hw, struct sk_buff *skb)
 	/* send to monitor interfaces */
 	ieee80211_tx_monitor(local, skb, sband, retry_count, shift, send_to_cooked);
 }
+
+static struct sta_info *
+ieee80211_tx_status_find_sta(struct ieee80211_local *local,
+			     struct ieee80211_hdr *hdr)
+{
+	const struct bucket_table *tbl;
+	struct rhash_head *tmp;
+	struct sta_info *sta;
+
+	tbl = rht_dereference_rcu(local->sta_hash.tbl, &local->sta_hash);
+
+	for_each_sta_info(local, tbl, hdr->addr1, sta, tmp) {
+		/* skip wrong virtual interface */
+		if (ether_addr_equal(hdr->addr2, sta->sdata->vif.addr))
+			return sta;
+	}
+
+	return NULL;
+}
+
+/*
+ * Process the status of frames that were all sent from the same address
+ * to the same receiver: the station is looked up only once, and rate
+ * control is updated for the whole batch under a single lock.
+ */
+static void ieee80211_tx_status_batch(struct ieee80211_local *local,
+				      struct sk_buff_head *skbs)
+{
+	struct ieee80211_hdr *hdr;
+	struct sk_buff_head done;
+	struct sta_info *sta;
+	struct sk_buff *skb;
+	int shift = 0;
+
+	__skb_queue_head_init(&done);
+	hdr = (struct ieee80211_hdr *)skb_peek(skbs)->data;
+
+	rcu_read_lock();
+
+	sta = ieee80211_tx_status_find_sta(local, hdr);
+	if (sta) {
+		shift = ieee80211_vif_get_shift(&sta->sdata->vif);
+
+		while ((skb = __skb_dequeue(skbs))) {
+			if (!ieee80211_tx_status_sta(local, sta, skb))
+				__skb_queue_tail(&done, skb);
+		}
+
+		rate_control_tx_status(local, sta, &done);
+
+		skb_queue_walk(&done, skb)
+			ieee80211_tx_status_sta_done(local, sta, skb);
+	} else {
+		skb_queue_splice_init(skbs, &done);
+	}
+
+	rcu_read_unlock();
+
+	while ((skb = __skb_dequeue(&done)))
+		ieee80211_tx_status_finish(local, skb, shift);
+}
+
+void ieee80211_tx_status(struct ieee80211_hw *hw, struct sk_buff *skb)
+{
+	struct sk_buff_head skbs;
+
+	__skb_queue_head_init(&skbs);
+	__skb_queue_tail(&skbs, skb);
+	ieee80211_tx_status_batch(hw_to_local(hw), &skbs);
+}
 EXPORT_SYMBOL(ieee80211_tx_status);
 
+void ieee80211_tx_status_list(struct ieee80211_hw *hw,
+			      struct sk_buff_head *skbs)
+{
+	struct ieee80211_local *local = hw_to_local(hw);
+	struct ieee80211_hdr *hdr, *prev = NULL;
+	struct sk_buff_head batch;
+	struct sk_buff *skb;
+
+	__skb_queue_head_init(&batch);
+
+	while ((skb = __skb_dequeue(skbs))) {
+		hdr = (struct ieee80211_hdr *)skb->data;
+
+		if (prev && (!ether_addr_equal(hdr->addr1, prev->addr1) ||
+			     !ether_addr_equal(hdr->addr2, prev->addr2)))
+			ieee80211_tx_status_batch(local, &batch);
+
+		__skb_queue_tail(&batch, skb);
+		prev = hdr;
+	}
+
+	if (!skb_queue_empty(&batch))
+		ieee80211_tx_status_batch(local, &batch);
+}
+EXPORT_SYMBOL(ieee80211_tx_status_list);
+
 void ieee80211_report_low_ack(struct ieee80211_sta *pubsta, u32 num_packets)
 {
 	struct sta_info *sta = container_of(pubsta, struct sta_info, sta);
@@ -1374,13 +1374,13 @@ int ieee80211_tdls_oper(struct wiphy *wiphy, struct net_device *dev,
 		 * The teardown message in ieee80211_tdls_mgmt_teardown() was
 		 * created while the queues were stopped, so it might still be
 		 * pending. Before flushing the queues we need to be sure the
-		 * message is handled by the tasklet handling pending messages,
+		 * message is handled by the tasklets handling pending messages,
 		 * otherwise we might start destroying the station before
 		 * sending the teardown packet.
-		 * Note that this only forces the tasklet to flush pendings -
-		 * not to stop the tasklet from rescheduling itself.
+		 * Note that this only forces the tasklets to flush pendings -
+		 * not to stop them from rescheduling themselves.
 		 */
-		tasklet_kill(&local->tx_pending_tasklet);
+		ieee80211_kill_tx_pending(local);
 		/* flush a potentially queued teardown packet */
 		ieee80211_flush_queues(local, sdata, false);
 
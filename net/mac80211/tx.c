@@ -341,57 +341,6 @@ ieee80211_tx_h_check_assoc(struct ieee80211_tx_data *tx)
 	return TX_CONTINUE;
 }
 
-/* This function is called whenever the AP is about to exceed the maximum limit
- * of buffered frames for power saving STAs. This situation should not really
- * happen often during normal operation, so dropping the oldest buffered packet
- * from each queue should be OK to make some room for new frames. */
-static void purge_old_ps_buffers(struct ieee80211_local *local)
-{
-	int total = 0, purged = 0;
-	struct sk_buff *skb;
-	struct ieee80211_sub_if_data *sdata;
-	struct sta_info *sta;
-
-	list_for_each_entry_rcu(sdata, &local->interfaces, list) {
-		struct ps_data *ps;
-
-		if (sdata->vif.type == NL80211_IFTYPE_AP)
-			ps = &sdata->u.ap.ps;
-		else if (ieee80211_vif_is_mesh(&sdata->vif))
-			ps = &sdata->u.mesh.ps;
-		else
-			continue;
-
-		skb = skb_dequeue(&ps->bc_buf);
-		if (skb) {
-			purged++;
-			dev_kfree_skb(skb);
-		}
-		total += skb_queue_len(&ps->bc_buf);
-	}
-
-	/*
-	 * Drop one frame from each station from the lowest-priority
-	 * AC that has frames at all.
-	 */
-	list_for_each_entry_rcu(sta, &local->sta_list, list) {
-		int ac;
-
-		for (ac = IEEE80211_AC_BK; ac >= IEEE80211_AC_VO; ac--) {
-			skb = skb_dequeue(&sta->ps_tx_buf[ac]);
-			total += skb_queue_len(&sta->ps_tx_buf[ac]);
-			if (skb) {
-				purged++;
-				ieee80211_free_txskb(&local->hw, skb);
-				break;
-			}
-		}
-	}
-
-	local->total_ps_buffered = total;
-	ps_dbg_hw(&local->hw, "PS buffers full - purged %d frames\n", purged);
-}
-
 static ieee80211_tx_result
 ieee80211_tx_h_multicast_ps_buf(struct ieee80211_tx_data *tx)
 {
@@ -442,15 +391,12 @@ ieee80211_tx_h_multicast_ps_buf(struct ieee80211_tx_data *tx)
 		return TX_CONTINUE;
 
 	/* buffered in mac80211 */
-	if (tx->local->total_ps_buffered >= TOTAL_MAX_TX_BUFFER)
-		purge_old_ps_buffers(tx->local);
-
 	if (skb_queue_len(&ps->bc_buf) >= AP_MAX_BC_BUFFER) {
 		ps_dbg(tx->sdata,
 		       "BC TX buffer full - dropping the oldest frame\n");
 		dev_kfree_skb(skb_dequeue(&ps->bc_buf));
 	} else
-		tx->local->total_ps_buffered++;
+		atomic_inc(&tx->local->total_ps_buffered);
 
 	skb_queue_tail(&ps->bc_buf, tx->skb);
 
@@ -504,8 +450,6 @@ ieee80211_tx_h_unicast_ps_buf(struct ieee80211_tx_data *tx)
 
 		ps_dbg(sta->sdata, "STA %pM aid %d: PS buffer for AC %d\n",
 		       sta->sta.addr, sta->sta.aid, ac);
-		if (tx->local->total_ps_buffered >= TOTAL_MAX_TX_BUFFER)
-			purge_old_ps_buffers(tx->local);
 
 		/* sync with ieee80211_sta_ps_deliver_wakeup */
 		spin_lock(&sta->ps_lock);
@@ -521,20 +465,11 @@ ieee80211_tx_h_unicast_ps_buf(struct ieee80211_tx_data *tx)
 			return TX_CONTINUE;
 		}
 
-		if (skb_queue_len(&sta->ps_tx_buf[ac]) >= STA_MAX_TX_BUFFER) {
-			struct sk_buff *old = skb_dequeue(&sta->ps_tx_buf[ac]);
-			ps_dbg(tx->sdata,
-			       "STA %pM TX buffer for AC %d full - dropping oldest frame\n",
-			       sta->sta.addr, ac);
-			ieee80211_free_txskb(&local->hw, old);
-		} else
-			tx->local->total_ps_buffered++;
-
 		info->control.jiffies = jiffies;
 		info->control.vif = &tx->sdata->vif;
 		info->flags |= IEEE80211_TX_INTFL_NEED_TXPROCESSING;
 		info->flags &= ~IEEE80211_TX_TEMPORARY_FLAGS;
-		skb_queue_tail(&sta->ps_tx_buf[ac], tx->skb);
+		ieee80211_sta_ps_buf_add(sta, ac, tx->skb);
 		spin_unlock(&sta->ps_lock);
 
 		if (!timer_pending(&local->sta_cleanup))
@@ -1274,7 +1209,11 @@ static void ieee80211_drv_tx(struct ieee80211_local *local,
 	if (atomic_read(&sdata->txqs_len[ac]) >= local->hw.txq_ac_max_pending)
 		netif_stop_subqueue(sdata->dev, ac);
 
-	skb_queue_tail(&txqi->queue, skb);
+	spin_lock_bh(&local->txq_lock);
+	ieee80211_txq_enqueue(local, txqi, skb);
+	spin_unlock_bh(&local->txq_lock);
+
+	ieee80211_schedule_txq(local, txqi);
 	drv_wake_tx_queue(local, txqi);
 
 	return;
@@ -1293,16 +1232,15 @@ struct sk_buff *ieee80211_tx_dequeue(struct ieee80211_hw *hw,
 	struct sk_buff *skb = NULL;
 	u8 ac = txq->ac;
 
-	spin_lock_bh(&txqi->queue.lock);
+	spin_lock_bh(&local->txq_lock);
 
 	if (test_bit(IEEE80211_TXQ_STOP, &txqi->flags))
 		goto out;
 
-	skb = __skb_dequeue(&txqi->queue);
+	skb = ieee80211_txq_dequeue(local, txqi);
 	if (!skb)
 		goto out;
 
-	atomic_dec(&sdata->txqs_len[ac]);
 	if (__netif_subqueue_stopped(sdata->dev, ac))
 		ieee80211_propagate_queue_wake(local, sdata->vif.hw_queue[ac]);
 
@@ -1320,17 +1258,133 @@ struct sk_buff *ieee80211_tx_dequeue(struct ieee80211_hw *hw,
 	}
 
 out:
-	spin_unlock_bh(&txqi->queue.lock);
+	spin_unlock_bh(&local->txq_lock);
 
 	return skb;
 }
 EXPORT_SYMBOL(ieee80211_tx_dequeue);
 
+/*
+ * Put a queue with frames on the schedule of its AC, unless it is there
+ * already or the driver holds it between ieee80211_next_txq() and
+ * ieee80211_return_txq(). Called with the AC's active_txq_lock held.
+ */
+static void __ieee80211_schedule_txq(struct ieee80211_local *local,
+				     struct txq_info *txqi)
+{
+	if (list_empty(&txqi->schedule_order) && txqi->backlog_packets &&
+	    !test_bit(IEEE80211_TXQ_SCHED_HELD, &txqi->flags))
+		list_add_tail(&txqi->schedule_order,
+			      &local->active_txqs[txqi->txq.ac]);
+}
+
+void ieee80211_schedule_txq(struct ieee80211_local *local,
+			    struct txq_info *txqi)
+{
+	u8 ac = txqi->txq.ac;
+
+	spin_lock_bh(&local->active_txq_lock[ac]);
+	__ieee80211_schedule_txq(local, txqi);
+	spin_unlock_bh(&local->active_txq_lock[ac]);
+}
+
+void ieee80211_unschedule_txq(struct ieee80211_local *local,
+			      struct txq_info *txqi)
+{
+	u8 ac = txqi->txq.ac;
+
+	spin_lock_bh(&local->active_txq_lock[ac]);
+	list_del_init(&txqi->schedule_order);
+	spin_unlock_bh(&local->active_txq_lock[ac]);
+}
+
+void ieee80211_txq_schedule_start(struct ieee80211_hw *hw, u8 ac)
+{
+	struct ieee80211_local *local = hw_to_local(hw);
+
+	spin_lock_bh(&local->active_txq_lock[ac]);
+	local->schedule_round[ac]++;
+	spin_unlock_bh(&local->active_txq_lock[ac]);
+}
+EXPORT_SYMBOL(ieee80211_txq_schedule_start);
+
+struct ieee80211_txq *ieee80211_next_txq(struct ieee80211_hw *hw, u8 ac)
+{
+	struct ieee80211_local *local = hw_to_local(hw);
+	struct txq_info *txqi;
+
+	spin_lock_bh(&local->active_txq_lock[ac]);
+
+ begin:
+	txqi = list_first_entry_or_null(&local->active_txqs[ac],
+					struct txq_info, schedule_order);
+	if (!txqi)
+		goto out;
+
+	if (txqi->txq.sta) {
+		struct sta_info *sta = container_of(txqi->txq.sta,
+						    struct sta_info, sta);
+
+		/*
+		 * A station that used up its airtime gets a new quantum
+		 * and has to wait for everybody else in the list first.
+		 */
+		if (sta->airtime[ac].deficit < 0) {
+			sta->airtime[ac].deficit += IEEE80211_AIRTIME_QUANTUM;
+			list_move_tail(&txqi->schedule_order,
+				       &local->active_txqs[ac]);
+			goto begin;
+		}
+	}
+
+	if (txqi->schedule_round == local->schedule_round[ac]) {
+		txqi = NULL;
+		goto out;
+	}
+
+	list_del_init(&txqi->schedule_order);
+	set_bit(IEEE80211_TXQ_SCHED_HELD, &txqi->flags);
+	txqi->schedule_round = local->schedule_round[ac];
+
+ out:
+	spin_unlock_bh(&local->active_txq_lock[ac]);
+
+	return txqi ? &txqi->txq : NULL;
+}
+EXPORT_SYMBOL(ieee80211_next_txq);
+
+void ieee80211_return_txq(struct ieee80211_hw *hw, struct ieee80211_txq *txq)
+{
+	struct ieee80211_local *local = hw_to_local(hw);
+	struct txq_info *txqi = to_txq_info(txq);
+
+	spin_lock_bh(&local->active_txq_lock[txq->ac]);
+	clear_bit(IEEE80211_TXQ_SCHED_HELD, &txqi->flags);
+	__ieee80211_schedule_txq(local, txqi);
+	spin_unlock_bh(&local->active_txq_lock[txq->ac]);
+}
+EXPORT_SYMBOL(ieee80211_return_txq);
+
+void ieee80211_sta_register_airtime(struct ieee80211_sta *pubsta, u8 tid,
+				    u32 tx_airtime, u32 rx_airtime)
+{
+	struct sta_info *sta = container_of(pubsta, struct sta_info, sta);
+	struct ieee80211_local *local = sta->local;
+	u8 ac = ieee802_1d_to_ac[tid & 7];
+
+	spin_lock_bh(&local->active_txq_lock[ac]);
+	sta->airtime[ac].tx_airtime += tx_airtime;
+	sta->airtime[ac].rx_airtime += rx_airtime;
+	sta->airtime[ac].deficit -= tx_airtime + rx_airtime;
+	spin_unlock_bh(&local->active_txq_lock[ac]);
+}
+EXPORT_SYMBOL(ieee80211_sta_register_airtime);
+
 static bool ieee80211_tx_frags(struct ieee80211_local *local,
 			       struct ieee80211_vif *vif,
 			       struct ieee80211_sta *sta,
 			       struct sk_buff_head *skbs,
-			       bool txpending)
+			       struct sk_buff_head *requeue)
 {
 	struct sk_buff *skb, *tmp;
 	unsigned long flags;
@@ -1349,7 +1403,8 @@ static bool ieee80211_tx_frags(struct ieee80211_local *local,
 
 		spin_lock_irqsave(&local->queue_stop_reason_lock, flags);
 		if (local->queue_stop_reasons[q] ||
-		    (!txpending && !skb_queue_empty(&local->pending[q]))) {
+		    (!requeue && (local->tx_pending[q].draining ||
+				  !skb_queue_empty(&local->pending[q])))) {
 			if (unlikely(info->flags &
 				     IEEE80211_TX_INTFL_OFFCHAN_TX_OK)) {
 				if (local->queue_stop_reasons[q] &
@@ -1373,10 +1428,11 @@ static bool ieee80211_tx_frags(struct ieee80211_local *local,
 				 * Since queue is stopped, queue up frames for
 				 * later transmission from the tx-pending
 				 * tasklet when the queue is woken again.
+				 * Frames the tasklet was draining go back to
+				 * the front of its list.
 				 */
-				if (txpending)
-					skb_queue_splice_init(skbs,
-							      &local->pending[q]);
+				if (requeue)
+					skb_queue_splice_init(skbs, requeue);
 				else
 					skb_queue_splice_tail_init(skbs,
 								   &local->pending[q]);
@@ -1402,7 +1458,7 @@ static bool ieee80211_tx_frags(struct ieee80211_local *local,
  */
 static bool __ieee80211_tx(struct ieee80211_local *local,
 			   struct sk_buff_head *skbs, int led_len,
-			   struct sta_info *sta, bool txpending)
+			   struct sta_info *sta, struct sk_buff_head *requeue)
 {
 	struct ieee80211_tx_info *info;
 	struct ieee80211_sub_if_data *sdata;
@@ -1429,7 +1485,7 @@ static bool __ieee80211_tx(struct ieee80211_local *local,
 
 	switch (sdata->vif.type) {
 	case NL80211_IFTYPE_MONITOR:
-		if (sdata->u.mntr_flags & MONITOR_FLAG_ACTIVE) {
+		if (sdata->u.mntr.flags & MONITOR_FLAG_ACTIVE) {
 			vif = &sdata->vif;
 			break;
 		}
@@ -1453,8 +1509,7 @@ static bool __ieee80211_tx(struct ieee80211_local *local,
 		break;
 	}
 
-	result = ieee80211_tx_frags(local, vif, pubsta, skbs,
-				    txpending);
+	result = ieee80211_tx_frags(local, vif, pubsta, skbs, requeue);
 
 	ieee80211_tpt_led_trig_tx(local, fc, led_len);
 
@@ -1562,7 +1617,7 @@ EXPORT_SYMBOL(ieee80211_tx_prepare_skb);
  */
 static bool ieee80211_tx(struct ieee80211_sub_if_data *sdata,
 			 struct sta_info *sta, struct sk_buff *skb,
-			 bool txpending)
+			 struct sk_buff_head *requeue)
 {
 	struct ieee80211_local *local = sdata->local;
 	struct ieee80211_tx_data tx;
@@ -1595,7 +1650,7 @@ static bool ieee80211_tx(struct ieee80211_sub_if_data *sdata,
 
 	if (!invoke_tx_handlers(&tx))
 		result = __ieee80211_tx(local, &tx.skbs, led_len,
-					tx.sta, txpending);
+					tx.sta, requeue);
 
 	return result;
 }
@@ -1670,7 +1725,7 @@ void ieee80211_xmit(struct ieee80211_sub_if_data *sdata,
 	}
 
 	ieee80211_set_qos_hdr(sdata, skb);
-	ieee80211_tx(sdata, sta, skb, false);
+	ieee80211_tx(sdata, sta, skb, NULL);
 }
 
 static bool ieee80211_parse_tx_radiotap(struct sk_buff *skb)
@@ -2852,7 +2907,7 @@ static bool ieee80211_xmit_fast(struct ieee80211_sub_if_data *sdata,
 				     struct ieee80211_sub_if_data, u.ap);
 
 	__skb_queue_tail(&tx.skbs, skb);
-	ieee80211_tx_frags(local, &sdata->vif, &sta->sta, &tx.skbs, false);
+	ieee80211_tx_frags(local, &sdata->vif, &sta->sta, &tx.skbs, NULL);
 	return true;
 }
 
@@ -3003,13 +3058,25 @@ void ieee80211_clear_tx_pending(struct ieee80211_local *local)
 	}
 }
 
+/*
+ * Wait for all pending-frame tasklets that are scheduled or running.
+ */
+void ieee80211_kill_tx_pending(struct ieee80211_local *local)
+{
+	int i;
+
+	for (i = 0; i < IEEE80211_MAX_QUEUES; i++)
+		tasklet_kill(&local->tx_pending[i].tasklet);
+}
+
 /*
  * Returns false if the frame couldn't be transmitted but was queued instead,
- * which in this case means re-queued -- take as an indication to stop sending
- * more pending frames.
+ * which in this case means re-queued onto @requeue -- take as an indication
+ * to stop sending more pending frames.
  */
 static bool ieee80211_tx_pending_skb(struct ieee80211_local *local,
-				     struct sk_buff *skb)
+				     struct sk_buff *skb,
+				     struct sk_buff_head *requeue)
 {
 	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
 	struct ieee80211_sub_if_data *sdata;
@@ -3027,7 +3094,7 @@ static bool ieee80211_tx_pending_skb(struct ieee80211_local *local,
 			return true;
 		}
 		info->band = chanctx_conf->def.chan->band;
-		result = ieee80211_tx(sdata, NULL, skb, true);
+		result = ieee80211_tx(sdata, NULL, skb, requeue);
 	} else {
 		struct sk_buff_head skbs;
 
@@ -3037,56 +3104,65 @@ static bool ieee80211_tx_pending_skb(struct ieee80211_local *local,
 		hdr = (struct ieee80211_hdr *)skb->data;
 		sta = sta_info_get(sdata, hdr->addr1);
 
-		result = __ieee80211_tx(local, &skbs, skb->len, sta, true);
+		result = __ieee80211_tx(local, &skbs, skb->len, sta, requeue);
 	}
 
 	return result;
 }
 
 /*
- * Transmit all pending packets. Called from tasklet.
+ * Transmit all pending packets of one hardware queue. Called from tasklet.
+ *
+ * The pending queue is spliced onto the private drain list under
+ * queue_stop_reason_lock and sent from there without retaking the lock for
+ * every frame. New frames for the queue keep getting appended to the pending
+ * queue meanwhile, and whatever couldn't be sent is put back in front of them.
  */
 void ieee80211_tx_pending(unsigned long data)
 {
-	struct ieee80211_local *local = (struct ieee80211_local *)data;
+	struct ieee80211_pending_queue *pq =
+		(struct ieee80211_pending_queue *)data;
+	struct ieee80211_local *local = pq->local;
+	struct sk_buff_head *pending = &local->pending[pq->queue];
+	struct sk_buff *skb;
 	unsigned long flags;
-	int i;
-	bool txok;
+	bool txok = true;
 
 	rcu_read_lock();
 
 	spin_lock_irqsave(&local->queue_stop_reason_lock, flags);
-	for (i = 0; i < local->hw.queues; i++) {
-		/*
-		 * If queue is stopped by something other than due to pending
-		 * frames, or we have no pending frames, proceed to next queue.
-		 */
-		if (local->queue_stop_reasons[i] ||
-		    skb_queue_empty(&local->pending[i]))
-			continue;
+	/*
+	 * If queue is stopped by something other than due to pending
+	 * frames, or we have no pending frames, there's nothing to do.
+	 */
+	while (txok && !local->queue_stop_reasons[pq->queue] &&
+	       !skb_queue_empty(pending)) {
+		skb_queue_splice_init(pending, &pq->drain);
+		pq->draining = true;
+		spin_unlock_irqrestore(&local->queue_stop_reason_lock, flags);
 
-		while (!skb_queue_empty(&local->pending[i])) {
-			struct sk_buff *skb = __skb_dequeue(&local->pending[i]);
+		while ((skb = __skb_dequeue(&pq->drain))) {
 			struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
 
-			if (WARN_ON(!info->control.vif)) {
+			if (WARN_ON(!info->control.vif) ||
+			    !ieee80211_sdata_running(
+					vif_to_sdata(info->control.vif))) {
 				ieee80211_free_txskb(&local->hw, skb);
 				continue;
 			}
 
-			spin_unlock_irqrestore(&local->queue_stop_reason_lock,
-						flags);
-
-			txok = ieee80211_tx_pending_skb(local, skb);
-			spin_lock_irqsave(&local->queue_stop_reason_lock,
-					  flags);
+			txok = ieee80211_tx_pending_skb(local, skb, &pq->drain);
 			if (!txok)
 				break;
 		}
 
-		if (skb_queue_empty(&local->pending[i]))
-			ieee80211_propagate_queue_wake(local, i);
+		spin_lock_irqsave(&local->queue_stop_reason_lock, flags);
+		skb_queue_splice_init(&pq->drain, pending);
+		pq->draining = false;
 	}
+
+	if (!local->queue_stop_reasons[pq->queue] && skb_queue_empty(pending))
+		ieee80211_propagate_queue_wake(local, pq->queue);
 	spin_unlock_irqrestore(&local->queue_stop_reason_lock, flags);
 
 	rcu_read_unlock();
@@ -3776,7 +3852,7 @@ ieee80211_get_buffered_bc(struct ieee80211_hw *hw,
 		skb = skb_dequeue(&ps->bc_buf);
 		if (!skb)
 			goto out;
-		local->total_ps_buffered--;
+		atomic_dec(&local->total_ps_buffered);
 
 		if (!skb_queue_empty(&ps->bc_buf) && skb->len >= 2) {
 			struct ieee80211_hdr *hdr =
@@ -0,0 +1,433 @@
+/*
+ * FQ-CoDel for the mac80211 intermediate TX queues
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * The CoDel control law follows net/sched/sch_codel.c and the flow
+ * scheduling follows net/sched/sch_fq_codel.c; neither can be used
+ * directly as the qdisc code keeps its state in the skb control buffer,
+ * which mac80211 needs for its own TX information.
+ *
+ * Frames of each intermediate queue (one per station and TID, and one per
+ * interface) are hashed into flows, which are served by deficit round
+ * robin with new flows first. The flow table is shared by all queues of
+ * the device; a flow is owned by a queue while it has frames, and frames
+ * hashing to a flow owned by another queue go to the queue's default flow.
+ * Each flow runs CoDel on the time its frames spent queued.
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/skbuff.h>
+#include <linux/ktime.h>
+#include <net/inet_ecn.h>
+#include <net/mac80211.h>
+#include "ieee80211_i.h"
+
+#define IEEE80211_TXQ_FLOWS		1024
+#define IEEE80211_TXQ_LIMIT		8192
+#define IEEE80211_TXQ_QUANTUM		300
+
+/* CoDel times are kept in units of 1024 ns, as in sch_codel */
+#define IEEE80211_CODEL_SHIFT		10
+#define IEEE80211_CODEL_TARGET_US	20000
+#define IEEE80211_CODEL_INTERVAL_US	100000
+
+#define IEEE80211_REC_INV_SQRT_BITS	(8 * sizeof(u16))
+#define IEEE80211_REC_INV_SQRT_SHIFT	(32 - IEEE80211_REC_INV_SQRT_BITS)
+
+static u32 ieee80211_codel_now(void)
+{
+	return ktime_get_ns() >> IEEE80211_CODEL_SHIFT;
+}
+
+static inline bool ieee80211_codel_after(u32 a, u32 b)
+{
+	return (s32)(a - b) > 0;
+}
+
+static inline bool ieee80211_codel_after_eq(u32 a, u32 b)
+{
+	return (s32)(a - b) >= 0;
+}
+
+u32 ieee80211_codel_us_to_time(u32 us)
+{
+	return ((u64)us * NSEC_PER_USEC) >> IEEE80211_CODEL_SHIFT;
+}
+
+u32 ieee80211_codel_time_to_us(u32 time)
+{
+	return div_u64((u64)time << IEEE80211_CODEL_SHIFT, NSEC_PER_USEC);
+}
+
+/*
+ * Newton approximation of 1/sqrt(count) for the control law, see
+ * codel_Newton_step() in include/net/codel.h
+ */
+static void ieee80211_codel_newton_step(struct ieee80211_codel_vars *vars)
+{
+	u32 invsqrt = ((u32)vars->rec_inv_sqrt) << IEEE80211_REC_INV_SQRT_SHIFT;
+	u32 invsqrt2 = ((u64)invsqrt * invsqrt) >> 32;
+	u64 val = (3LL << 32) - ((u64)vars->count * invsqrt2);
+
+	val >>= 2; /* avoid overflow in following multiply */
+	val = (val * invsqrt) >> (32 - 2 + 1);
+
+	vars->rec_inv_sqrt = val >> IEEE80211_REC_INV_SQRT_SHIFT;
+}
+
+/* next drop time: t + interval / sqrt(count) */
+static u32 ieee80211_codel_control_law(u32 t, u32 interval, u32 rec_inv_sqrt)
+{
+	u32 scale = rec_inv_sqrt << IEEE80211_REC_INV_SQRT_SHIFT;
+
+	return t + reciprocal_scale(interval, scale);
+}
+
+void ieee80211_txq_flow_init(struct txq_flow *flow)
+{
+	__skb_queue_head_init(&flow->queue);
+	INIT_LIST_HEAD(&flow->flowchain);
+}
+
+int ieee80211_txq_setup_flows(struct ieee80211_local *local)
+{
+	int i;
+
+	if (!local->ops->wake_tx_queue)
+		return 0;
+
+	local->txq_flows = kcalloc(IEEE80211_TXQ_FLOWS,
+				   sizeof(*local->txq_flows), GFP_KERNEL);
+	if (!local->txq_flows)
+		return -ENOMEM;
+
+	local->txq_flows_cnt = IEEE80211_TXQ_FLOWS;
+	for (i = 0; i < local->txq_flows_cnt; i++)
+		ieee80211_txq_flow_init(&local->txq_flows[i]);
+
+	local->txq_limit = IEEE80211_TXQ_LIMIT;
+	local->txq_quantum = IEEE80211_TXQ_QUANTUM;
+	local->txq_cparams.target =
+		ieee80211_codel_us_to_time(IEEE80211_CODEL_TARGET_US);
+	local->txq_cparams.interval =
+		ieee80211_codel_us_to_time(IEEE80211_CODEL_INTERVAL_US);
+	local->txq_cparams.ecn = true;
+
+	return 0;
+}
+
+void ieee80211_txq_teardown_flows(struct ieee80211_local *local)
+{
+	kfree(local->txq_flows);
+	local->txq_flows = NULL;
+	local->txq_flows_cnt = 0;
+}
+
+static struct sk_buff *ieee80211_txq_flow_pop(struct ieee80211_local *local,
+					      struct txq_info *txqi,
+					      struct txq_flow *flow)
+{
+	struct ieee80211_sub_if_data *sdata = vif_to_sdata(txqi->txq.vif);
+	struct sk_buff *skb;
+
+	lockdep_assert_held(&local->txq_lock);
+
+	skb = __skb_dequeue(&flow->queue);
+	if (!skb)
+		return NULL;
+
+	flow->backlog -= skb->len;
+	txqi->backlog_bytes -= skb->len;
+	txqi->backlog_packets--;
+	local->txq_backlog--;
+	atomic_dec(&sdata->txqs_len[txqi->txq.ac]);
+
+	return skb;
+}
+
+static bool ieee80211_codel_should_drop(struct ieee80211_local *local,
+					struct txq_flow *flow,
+					struct sk_buff *skb, u32 now)
+{
+	struct ieee80211_codel_vars *vars = &flow->cvars;
+	u32 sojourn;
+
+	if (!skb) {
+		vars->first_above_time = 0;
+		return false;
+	}
+
+	sojourn = now - IEEE80211_SKB_CB(skb)->control.enqueue_time;
+
+	if (!ieee80211_codel_after_eq(sojourn, local->txq_cparams.target) ||
+	    flow->backlog <= ETH_DATA_LEN) {
+		/* went below - stay below for at least interval */
+		vars->first_above_time = 0;
+		return false;
+	}
+
+	if (vars->first_above_time == 0) {
+		/* just went above from below; if still above at
+		 * first_above_time, will say it's ok to drop
+		 */
+		vars->first_above_time = now + local->txq_cparams.interval;
+		return false;
+	}
+
+	return ieee80211_codel_after(now, vars->first_above_time);
+}
+
+static bool ieee80211_codel_mark(struct ieee80211_local *local,
+				 struct sk_buff *skb)
+{
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+	struct ieee80211_hdr *hdr = (void *)skb->data;
+
+	if (!local->txq_cparams.ecn)
+		return false;
+
+	/*
+	 * Frames are queued after the TX handlers, so the payload of frames
+	 * protected in software can no longer be changed.
+	 */
+	if (ieee80211_has_protected(hdr->frame_control) &&
+	    (!info->control.hw_key ||
+	     info->control.hw_key->cipher == WLAN_CIPHER_SUITE_TKIP))
+		return false;
+
+	return INET_ECN_set_ce(skb);
+}
+
+static void ieee80211_codel_drop(struct ieee80211_local *local,
+				 struct txq_info *txqi, struct sk_buff *skb)
+{
+	txqi->codel_drops++;
+	local->txq_codel_drops++;
+	ieee80211_free_txskb(&local->hw, skb);
+}
+
+static struct sk_buff *ieee80211_codel_dequeue(struct ieee80211_local *local,
+					       struct txq_info *txqi,
+					       struct txq_flow *flow)
+{
+	struct ieee80211_codel_vars *vars = &flow->cvars;
+	u32 interval = local->txq_cparams.interval;
+	u32 now = ieee80211_codel_now();
+	u16 rec_inv_sqrt_max = ~0U >> IEEE80211_REC_INV_SQRT_SHIFT;
+	struct sk_buff *skb;
+	bool drop;
+
+	skb = ieee80211_txq_flow_pop(local, txqi, flow);
+	drop = ieee80211_codel_should_drop(local, flow, skb, now);
+
+	if (vars->dropping) {
+		if (!drop) {
+			/* sojourn time below target - leave dropping state */
+			vars->dropping = false;
+			return skb;
+		}
+
+		/*
+		 * Time for the next drop; each drop increases count and
+		 * so shortens the time to the next one, until the queue
+		 * is under control again.
+		 */
+		while (vars->dropping &&
+		       ieee80211_codel_after_eq(now, vars->drop_next)) {
+			vars->count++;
+			ieee80211_codel_newton_step(vars);
+
+			if (ieee80211_codel_mark(local, skb)) {
+				txqi->ecn_marks++;
+				local->txq_ecn_marks++;
+				vars->drop_next =
+					ieee80211_codel_control_law(
+						vars->drop_next, interval,
+						vars->rec_inv_sqrt);
+				return skb;
+			}
+
+			ieee80211_codel_drop(local, txqi, skb);
+			skb = ieee80211_txq_flow_pop(local, txqi, flow);
+			if (!ieee80211_codel_should_drop(local, flow, skb, now))
+				vars->dropping = false;
+			else
+				vars->drop_next =
+					ieee80211_codel_control_law(
+						vars->drop_next, interval,
+						vars->rec_inv_sqrt);
+		}
+	} else if (drop) {
+		u32 delta;
+
+		if (ieee80211_codel_mark(local, skb)) {
+			txqi->ecn_marks++;
+			local->txq_ecn_marks++;
+		} else {
+			ieee80211_codel_drop(local, txqi, skb);
+			skb = ieee80211_txq_flow_pop(local, txqi, flow);
+			ieee80211_codel_should_drop(local, flow, skb, now);
+		}
+
+		vars->dropping = true;
+		/*
+		 * If we went above target close to when we last went below
+		 * it, assume that the drop rate that controlled the queue on
+		 * the last cycle is a good starting point to control it now.
+		 */
+		delta = vars->count - vars->lastcount;
+		if (delta > 1 &&
+		    !ieee80211_codel_after_eq(now - vars->drop_next,
+					      16 * interval)) {
+			vars->count = delta;
+			ieee80211_codel_newton_step(vars);
+		} else {
+			vars->count = 1;
+			vars->rec_inv_sqrt = rec_inv_sqrt_max;
+		}
+		vars->lastcount = vars->count;
+		vars->drop_next =
+			ieee80211_codel_control_law(now, interval,
+						    vars->rec_inv_sqrt);
+	}
+
+	return skb;
+}
+
+/* drop the head of the longest flow in the table to stay within the limit */
+static bool ieee80211_txq_drop_fattest(struct ieee80211_local *local,
+				       struct txq_info *txqi)
+{
+	struct txq_flow *flow, *fattest = &txqi->def_flow;
+	struct sk_buff *skb;
+	int i;
+
+	for (i = 0; i < local->txq_flows_cnt; i++) {
+		flow = &local->txq_flows[i];
+		if (flow->backlog > fattest->backlog)
+			fattest = flow;
+	}
+
+	/* the default flow is the only one not in the table */
+	if (fattest != &txqi->def_flow)
+		txqi = fattest->txqi;
+
+	/* the rest of the backlog may be in other queues' default flows */
+	skb = ieee80211_txq_flow_pop(local, txqi, fattest);
+	if (!skb)
+		return false;
+
+	txqi->overlimit++;
+	local->txq_overlimit++;
+	ieee80211_free_txskb(&local->hw, skb);
+	return true;
+}
+
+void ieee80211_txq_enqueue(struct ieee80211_local *local,
+			   struct txq_info *txqi, struct sk_buff *skb)
+{
+	struct txq_flow *flow;
+	u32 idx;
+
+	lockdep_assert_held(&local->txq_lock);
+
+	idx = reciprocal_scale(skb_get_hash(skb), local->txq_flows_cnt);
+	flow = &local->txq_flows[idx];
+	if (flow->txqi && flow->txqi != txqi) {
+		txqi->collisions++;
+		local->txq_collisions++;
+		flow = &txqi->def_flow;
+	}
+	flow->txqi = txqi;
+
+	IEEE80211_SKB_CB(skb)->control.enqueue_time = ieee80211_codel_now();
+	__skb_queue_tail(&flow->queue, skb);
+	flow->backlog += skb->len;
+	txqi->backlog_bytes += skb->len;
+	txqi->backlog_packets++;
+	local->txq_backlog++;
+
+	if (list_empty(&flow->flowchain)) {
+		flow->deficit = local->txq_quantum;
+		list_add_tail(&flow->flowchain, &txqi->new_flows);
+	}
+
+	while (local->txq_backlog > local->txq_limit) {
+		if (!ieee80211_txq_drop_fattest(local, txqi))
+			break;
+	}
+}
+
+struct sk_buff *ieee80211_txq_dequeue(struct ieee80211_local *local,
+				      struct txq_info *txqi)
+{
+	struct list_head *head;
+	struct txq_flow *flow;
+	struct sk_buff *skb;
+
+	lockdep_assert_held(&local->txq_lock);
+
+begin:
+	head = &txqi->new_flows;
+	if (list_empty(head)) {
+		head = &txqi->old_flows;
+		if (list_empty(head))
+			return NULL;
+	}
+
+	flow = list_first_entry(head, struct txq_flow, flowchain);
+
+	if (flow->deficit <= 0) {
+		flow->deficit += local->txq_quantum;
+		list_move_tail(&flow->flowchain, &txqi->old_flows);
+		goto begin;
+	}
+
+	skb = ieee80211_codel_dequeue(local, txqi, flow);
+	if (!skb) {
+		/* force a pass through old_flows to prevent starvation */
+		if (head == &txqi->new_flows &&
+		    !list_empty(&txqi->old_flows)) {
+			list_move_tail(&flow->flowchain, &txqi->old_flows);
+		} else {
+			list_del_init(&flow->flowchain);
+			flow->txqi = NULL;
+		}
+		goto begin;
+	}
+
+	flow->deficit -= skb->len;
+
+	return skb;
+}
+
+void ieee80211_txq_purge(struct ieee80211_local *local,
+			 struct txq_info *txqi)
+{
+	struct txq_flow *flow, *tmp;
+	struct sk_buff *skb;
+
+	spin_lock_bh(&local->txq_lock);
+
+	list_splice_tail_init(&txqi->new_flows, &txqi->old_flows);
+	list_for_each_entry_safe(flow, tmp, &txqi->old_flows, flowchain) {
+		while ((skb = ieee80211_txq_flow_pop(local, txqi, flow)))
+			ieee80211_free_txskb(&local->hw, skb);
+
+		list_del_init(&flow->flowchain);
+		flow->txqi = NULL;
+		memset(&flow->cvars, 0, sizeof(flow->cvars));
+	}
+
+	spin_unlock_bh(&local->txq_lock);
+
+	/*
+	 * Only now that the queue is empty, a driver returning it from
+	 * ieee80211_next_txq() can no longer put it back on the schedule.
+	 */
+	ieee80211_unschedule_txq(local, txqi);
+}
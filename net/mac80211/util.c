@@ -300,12 +300,13 @@ static void __ieee80211_wake_queue(struct ieee80211_hw *hw, int queue,
 		/* someone still has this queue stopped */
 		return;
 
-	if (skb_queue_empty(&local->pending[queue])) {
+	if (skb_queue_empty(&local->pending[queue]) &&
+	    !local->tx_pending[queue].draining) {
 		rcu_read_lock();
 		ieee80211_propagate_queue_wake(local, queue);
 		rcu_read_unlock();
 	} else
-		tasklet_schedule(&local->tx_pending_tasklet);
+		tasklet_schedule(&local->tx_pending[queue].tasklet);
 }
 
 void ieee80211_wake_queue_by_reason(struct ieee80211_hw *hw, int queue,
@@ -594,7 +595,7 @@ static void __iterate_interfaces(struct ieee80211_local *local,
 	list_for_each_entry_rcu(sdata, &local->interfaces, list) {
 		switch (sdata->vif.type) {
 		case NL80211_IFTYPE_MONITOR:
-			if (!(sdata->u.mntr_flags & MONITOR_FLAG_ACTIVE))
+			if (!(sdata->u.mntr.flags & MONITOR_FLAG_ACTIVE))
 				continue;
 			break;
 		case NL80211_IFTYPE_AP_VLAN:
@@ -1107,6 +1108,70 @@ u32 ieee802_11_parse_elems_crc(const u8 *start, size_t len, bool action,
 	return crc;
 }
 
+/*
+ * Checksum all elements of a beacon except the TIM in a single pass, without
+ * parsing them. This is used to recognise beacons identical to the last one
+ * that was fully processed. Only the elements that are needed even for such
+ * a beacon (the TIM, which changes every time, and a few mesh ones) are
+ * stored in @elems, everything else is left unset.
+ */
+u32 ieee802_11_beacon_crc(const u8 *start, size_t len,
+			  struct ieee802_11_elems *elems, u32 crc)
+{
+	size_t left = len;
+	const u8 *pos = start;
+
+	memset(elems, 0, sizeof(*elems));
+	elems->ie_start = start;
+	elems->total_len = len;
+
+	while (left >= 2) {
+		u8 id = pos[0], elen = pos[1];
+
+		if (elen + 2 > left) {
+			elems->parse_error = true;
+			break;
+		}
+
+		switch (id) {
+		case WLAN_EID_TIM:
+			if (elen >= sizeof(struct ieee80211_tim_ie)) {
+				elems->tim = (void *)(pos + 2);
+				elems->tim_len = elen;
+			}
+			/* DTIM count and bitmap differ in every beacon */
+			goto next;
+		case WLAN_EID_MESH_CONFIG:
+			if (elen >= sizeof(struct ieee80211_meshconf_ie))
+				elems->mesh_config = (void *)(pos + 2);
+			break;
+		case WLAN_EID_MESH_AWAKE_WINDOW:
+			if (elen >= 2)
+				elems->awake_window = (void *)(pos + 2);
+			break;
+		case WLAN_EID_CHANNEL_SWITCH:
+			elems->ch_switch_ie = (void *)(pos + 2);
+			break;
+		case WLAN_EID_EXT_CHANSWITCH_ANN:
+			elems->ext_chansw_ie = (void *)(pos + 2);
+			break;
+		case WLAN_EID_CHAN_SWITCH_PARAM:
+			elems->mesh_chansw_params_ie = (void *)(pos + 2);
+			break;
+		}
+
+		crc = crc32_be(crc, pos, elen + 2);
+ next:
+		left -= elen + 2;
+		pos += elen + 2;
+	}
+
+	if (left != 0)
+		elems->parse_error = true;
+
+	return crc;
+}
+
 void ieee80211_set_wmm_default(struct ieee80211_sub_if_data *sdata,
 			       bool bss_notify, bool enable_qos)
 {
@@ -3333,7 +3398,10 @@ void ieee80211_init_tx_queue(struct ieee80211_sub_if_data *sdata,
 			     struct sta_info *sta,
 			     struct txq_info *txqi, int tid)
 {
-	skb_queue_head_init(&txqi->queue);
+	ieee80211_txq_flow_init(&txqi->def_flow);
+	INIT_LIST_HEAD(&txqi->new_flows);
+	INIT_LIST_HEAD(&txqi->old_flows);
+	INIT_LIST_HEAD(&txqi->schedule_order);
 	txqi->txq.vif = &sdata->vif;
 
 	if (sta) {
@@ -342,7 +342,7 @@ struct wiphy *wiphy_new_nm(const struct cfg80211_ops *ops, int sizeof_priv,
 	static atomic_t wiphy_counter = ATOMIC_INIT(0);
 
 	struct cfg80211_registered_device *rdev;
-	int alloc_size;
+	int alloc_size, i;
 
 	/*
 	 * Make sure the padding is >= the rest of the struct so that we
@@ -416,6 +416,8 @@ use_default_name:
 	spin_lock_init(&rdev->beacon_registrations_lock);
 	spin_lock_init(&rdev->bss_lock);
 	INIT_LIST_HEAD(&rdev->bss_list);
+	for (i = 0; i < CFG80211_BSS_HASH_SIZE; i++)
+		INIT_LIST_HEAD(&rdev->bss_hash[i]);
 	INIT_WORK(&rdev->scan_done_wk, __cfg80211_scan_done);
 	INIT_WORK(&rdev->sched_scan_results_wk, __cfg80211_sched_scan_results);
 	INIT_LIST_HEAD(&rdev->mlme_unreg);
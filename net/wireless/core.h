@@ -19,6 +19,10 @@
 
 #define WIPHY_IDX_INVALID	-1
 
+/* BSS entries are also hashed by BSSID for fast lookup */
+#define CFG80211_BSS_HASH_BITS	8
+#define CFG80211_BSS_HASH_SIZE	(1 << CFG80211_BSS_HASH_BITS)
+
 struct cfg80211_registered_device {
 	const struct cfg80211_ops *ops;
 	struct list_head list;
@@ -43,6 +47,9 @@ struct cfg80211_registered_device {
 	 */
 	const struct ieee80211_regdomain *requested_regd;
 
+	/* compiled rule lookup for the wiphy's channels, see reg.c */
+	struct reg_rule_index *reg_index;
+
 	/* If a Country IE has been received this tells us the environment
 	 * which its telling us its in. This defaults to ENVIRON_ANY */
 	enum environment_cap env;
@@ -70,8 +77,10 @@ struct cfg80211_registered_device {
 	/* BSSes/scanning */
 	spinlock_t bss_lock;
 	struct list_head bss_list;
+	struct list_head bss_hash[CFG80211_BSS_HASH_SIZE];
 	struct rb_root bss_tree;
 	u32 bss_generation;
+	u32 bss_entries;
 	struct cfg80211_scan_request *scan_req; /* protected by RTNL */
 	struct sk_buff *scan_msg;
 	struct cfg80211_sched_scan_request __rcu *sched_scan_req;
@@ -135,6 +144,7 @@ extern int cfg80211_rdev_list_generation;
 
 struct cfg80211_internal_bss {
 	struct list_head list;
+	struct list_head hash_list;
 	struct list_head hidden_list;
 	struct rb_node rbn;
 	u64 ts_boottime;
@@ -403,6 +403,8 @@ static const struct nla_policy nl80211_policy[NUM_NL80211_ATTR] = {
 	[NL80211_ATTR_NETNS_FD] = { .type = NLA_U32 },
 	[NL80211_ATTR_SCHED_SCAN_DELAY] = { .type = NLA_U32 },
 	[NL80211_ATTR_REG_INDOOR] = { .type = NLA_FLAG },
+	[NL80211_ATTR_STA_INFO_FILTER] = { .type = NLA_U32 },
+	[NL80211_ATTR_STA_INFO_MAX_AGE] = { .type = NLA_U32 },
 };
 
 /* policy for the key attributes */
@@ -2512,6 +2514,7 @@ static const struct nla_policy mntr_flags_policy[NL80211_MNTR_FLAG_MAX + 1] = {
 	[NL80211_MNTR_FLAG_OTHER_BSS] = { .type = NLA_FLAG },
 	[NL80211_MNTR_FLAG_COOK_FRAMES] = { .type = NLA_FLAG },
 	[NL80211_MNTR_FLAG_ACTIVE] = { .type = NLA_FLAG },
+	[NL80211_MNTR_FLAG_BOUND_ONLY] = { .type = NLA_FLAG },
 };
 
 static int parse_monitor_flags(struct nlattr *nla, u32 *mntrflags)
@@ -3887,12 +3890,25 @@ static int nl80211_dump_station(struct sk_buff *skb,
 	struct wireless_dev *wdev;
 	u8 mac_addr[ETH_ALEN];
 	int sta_idx = cb->args[2];
+	bool first = !cb->args[0];
 	int err;
 
 	err = nl80211_prepare_wdev_dump(skb, cb, &rdev, &wdev);
 	if (err)
 		return err;
 
+	/* prepare_wdev_dump parsed the attributes, but only the first time */
+	if (first) {
+		struct nlattr *filter, *max_age;
+
+		filter = nl80211_fam.attrbuf[NL80211_ATTR_STA_INFO_FILTER];
+		max_age = nl80211_fam.attrbuf[NL80211_ATTR_STA_INFO_MAX_AGE];
+		if (filter)
+			cb->args[3] = nla_get_u32(filter);
+		if (max_age)
+			cb->args[4] = nla_get_u32(max_age);
+	}
+
 	if (!wdev->netdev) {
 		err = -EINVAL;
 		goto out_err;
@@ -3905,6 +3921,7 @@ static int nl80211_dump_station(struct sk_buff *skb,
 
 	while (1) {
 		memset(&sinfo, 0, sizeof(sinfo));
+		sinfo.max_age = cb->args[4];
 		err = rdev_dump_station(rdev, wdev->netdev, sta_idx,
 					mac_addr, &sinfo);
 		if (err == -ENOENT)
@@ -3912,6 +3929,9 @@ static int nl80211_dump_station(struct sk_buff *skb,
 		if (err)
 			goto out_err;
 
+		if (cb->args[3])
+			sinfo.filled &= cb->args[3];
+
 		if (nl80211_send_station(skb, NL80211_CMD_NEW_STATION,
 				NETLINK_CB_PORTID(cb->skb),
 				cb->nlh->nlmsg_seq, NLM_F_MULTI,
@@ -6794,7 +6814,7 @@ static int nl80211_send_bss(struct sk_buff *msg, struct netlink_callback *cb,
 	 */
 	ies = rcu_dereference(res->ies);
 	if (ies) {
-		if (nla_put_u64(msg, NL80211_BSS_TSF, ies->tsf))
+		if (nla_put_u64(msg, NL80211_BSS_TSF, ACCESS_ONCE(ies->tsf)))
 			goto fail_unlock_rcu;
 		if (ies->len && nla_put(msg, NL80211_BSS_INFORMATION_ELEMENTS,
 					ies->len, ies->data))
@@ -6804,7 +6824,8 @@ static int nl80211_send_bss(struct sk_buff *msg, struct netlink_callback *cb,
 	/* and this pointer is always (unless driver didn't know) beacon data */
 	ies = rcu_dereference(res->beacon_ies);
 	if (ies && ies->from_beacon) {
-		if (nla_put_u64(msg, NL80211_BSS_BEACON_TSF, ies->tsf))
+		if (nla_put_u64(msg, NL80211_BSS_BEACON_TSF,
+				ACCESS_ONCE(ies->tsf)))
 			goto fail_unlock_rcu;
 		if (ies->len && nla_put(msg, NL80211_BSS_BEACON_IES,
 					ies->len, ies->data))
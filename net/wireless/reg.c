@@ -117,6 +117,31 @@ static struct platform_device *reg_pdev;
  */
 const struct ieee80211_regdomain __rcu *cfg80211_regdomain;
 
+/*
+ * Bumped whenever cfg80211_regdomain or a wiphy's regd is replaced, so
+ * compiled rule indexes can tell that their regulatory domain is stale
+ * even if a new one was allocated at the same address.
+ * (protected by RTNL)
+ */
+static unsigned int reg_regdom_gen;
+
+/*
+ * Compiled lookup of the rule covering each of a wiphy's channels at
+ * 20 MHz, so that re-applying an unchanged regulatory domain doesn't
+ * have to search its rules again for every channel.
+ * (protected by RTNL)
+ */
+struct reg_rule_index {
+	const struct ieee80211_regdomain *regd;
+	unsigned int gen;
+	s8 *rule[IEEE80211_NUM_BANDS];
+	s8 data[];
+};
+
+/* reg_rule_index entries that aren't a rule index */
+#define REG_INDEX_NO_BAND	-1	/* no rule in the band, -ERANGE */
+#define REG_INDEX_NO_FIT	-2	/* no rule fits, -EINVAL */
+
 /*
  * Number of devices that registered to the core
  * that support cellular base station regulatory hints
@@ -326,6 +351,7 @@ static void reset_regdomains(bool full_reset,
 
 	cfg80211_world_regdom = &world_regdom;
 	rcu_assign_pointer(cfg80211_regdomain, new_regdom);
+	reg_regdom_gen++;
 
 	if (!full_reset)
 		return;
@@ -1116,6 +1142,87 @@ const struct ieee80211_reg_rule *freq_reg_info(struct wiphy *wiphy,
 }
 EXPORT_SYMBOL(freq_reg_info);
 
+static struct reg_rule_index *
+reg_index_build(struct wiphy *wiphy, const struct ieee80211_regdomain *regd)
+{
+	struct cfg80211_registered_device *rdev = wiphy_to_rdev(wiphy);
+	struct reg_rule_index *idx = rdev->reg_index;
+	const struct ieee80211_reg_rule *rule;
+	struct ieee80211_supported_band *sband;
+	enum ieee80211_band band;
+	int i, n_channels = 0;
+	s8 *pos;
+
+	ASSERT_RTNL();
+
+	for (band = 0; band < IEEE80211_NUM_BANDS; band++)
+		if (wiphy->bands[band])
+			n_channels += wiphy->bands[band]->n_channels;
+
+	/* the wiphy's bands are fixed, so the allocation can be reused */
+	if (!idx) {
+		idx = kzalloc(sizeof(*idx) + n_channels, GFP_KERNEL);
+		if (!idx)
+			return NULL;
+		rdev->reg_index = idx;
+	}
+
+	pos = idx->data;
+	for (band = 0; band < IEEE80211_NUM_BANDS; band++) {
+		sband = wiphy->bands[band];
+		idx->rule[band] = sband ? pos : NULL;
+		if (!sband)
+			continue;
+
+		for (i = 0; i < sband->n_channels; i++) {
+			rule = freq_reg_info_regd(wiphy,
+				MHZ_TO_KHZ(sband->channels[i].center_freq),
+				regd, MHZ_TO_KHZ(20));
+			if (!IS_ERR(rule))
+				*pos++ = rule - regd->reg_rules;
+			else if (PTR_ERR(rule) == -ERANGE)
+				*pos++ = REG_INDEX_NO_BAND;
+			else
+				*pos++ = REG_INDEX_NO_FIT;
+		}
+	}
+
+	idx->regd = regd;
+	idx->gen = reg_regdom_gen;
+
+	return idx;
+}
+
+/*
+ * Same as freq_reg_info() for one of the wiphy's own channels, but uses
+ * the compiled index, which is only rebuilt if the regulatory domain
+ * changed since it was last used.
+ */
+static const struct ieee80211_reg_rule *
+reg_chan_rule(struct wiphy *wiphy, struct ieee80211_channel *chan)
+{
+	const struct ieee80211_regdomain *regd = reg_get_regdomain(wiphy);
+	struct reg_rule_index *idx = wiphy_to_rdev(wiphy)->reg_index;
+	struct ieee80211_supported_band *sband = wiphy->bands[chan->band];
+	s8 rule;
+
+	if (!regd)
+		return ERR_PTR(-EINVAL);
+
+	if (!idx || idx->regd != regd || idx->gen != reg_regdom_gen)
+		idx = reg_index_build(wiphy, regd);
+	if (!idx)
+		return freq_reg_info(wiphy, MHZ_TO_KHZ(chan->center_freq));
+
+	rule = idx->rule[chan->band][chan - sband->channels];
+	if (rule == REG_INDEX_NO_BAND)
+		return ERR_PTR(-ERANGE);
+	if (rule == REG_INDEX_NO_FIT)
+		return ERR_PTR(-EINVAL);
+
+	return &regd->reg_rules[rule];
+}
+
 const char *reg_initiator_name(enum nl80211_reg_initiator initiator)
 {
 	switch (initiator) {
@@ -1192,7 +1299,7 @@ static void handle_channel(struct wiphy *wiphy,
 
 	flags = chan->orig_flags;
 
-	reg_rule = freq_reg_info(wiphy, MHZ_TO_KHZ(chan->center_freq));
+	reg_rule = reg_chan_rule(wiphy, chan);
 	if (IS_ERR(reg_rule)) {
 		/*
 		 * We will disable all channels that do not match our
@@ -2048,6 +2155,7 @@ reg_process_hint_driver(struct wiphy *wiphy,
 
 		tmp = get_wiphy_regdom(wiphy);
 		rcu_assign_pointer(wiphy->regd, regd);
+		reg_regdom_gen++;
 		rcu_free_regdom(tmp);
 	}
 
@@ -2326,6 +2434,7 @@ static void reg_process_self_managed_hints(void)
 
 		tmp = get_wiphy_regdom(wiphy);
 		rcu_assign_pointer(wiphy->regd, regd);
+		reg_regdom_gen++;
 		rcu_free_regdom(tmp);
 
 		for (band = 0; band < IEEE80211_NUM_BANDS; band++)
@@ -2962,6 +3071,7 @@ static int reg_set_rd_driver(const struct ieee80211_regdomain *rd,
 	 */
 	tmp = get_wiphy_regdom(request_wiphy);
 	rcu_assign_pointer(request_wiphy->regd, rd);
+	reg_regdom_gen++;
 	rcu_free_regdom(tmp);
 
 	rd = NULL;
@@ -3168,6 +3278,10 @@ void wiphy_regulatory_deregister(struct wiphy *wiphy)
 
 	rcu_free_regdom(get_wiphy_regdom(wiphy));
 	RCU_INIT_POINTER(wiphy->regd, NULL);
+	reg_regdom_gen++;
+
+	kfree(wiphy_to_rdev(wiphy)->reg_index);
+	wiphy_to_rdev(wiphy)->reg_index = NULL;
 
 	if (lr)
 		request_wiphy = wiphy_idx_to_wiphy(lr->wiphy_idx);
@@ -3228,6 +3342,7 @@ int __init regulatory_init(void)
 	reg_regdb_size_check();
 
 	rcu_assign_pointer(cfg80211_regdomain, cfg80211_world_regdom);
+	reg_regdom_gen++;
 
 	user_alpha2[0] = '9';
 	user_alpha2[1] = '7';
@@ -11,6 +11,7 @@
 #include <linux/wireless.h>
 #include <linux/nl80211.h>
 #include <linux/etherdevice.h>
+#include <linux/jhash.h>
 #include <net/arp.h>
 #include <net/cfg80211.h>
 #include <net/cfg80211-wext.h>
@@ -27,7 +28,11 @@
  * registered device (@bss_list) as well as an RB-tree for faster
  * lookup. In the RB-tree, entries can be looked up using their
  * channel, MESHID, MESHCONF (for MBSSes) or channel, BSSID, SSID
- * for other BSSes.
+ * for other BSSes. Entries are additionally hashed by BSSID
+ * (@bss_hash), which is what lookups for a known BSSID use.
+ *
+ * The number of entries is capped at @bss_entries_limit; when a new
+ * entry would exceed it the least recently updated one is dropped.
  *
  * Due to the possibility of hidden SSIDs, there's a second level
  * structure, the "hidden_list" and "hidden_beacon_bss" pointer.
@@ -58,6 +63,18 @@
 
 #define IEEE80211_SCAN_RESULT_EXPIRE	(30 * HZ)
 
+static int bss_entries_limit = 1000;
+module_param(bss_entries_limit, int, 0644);
+MODULE_PARM_DESC(bss_entries_limit,
+		 "limit to number of scan BSS entries (per wiphy, default 1000)");
+
+static inline struct list_head *
+cfg80211_bss_hash(struct cfg80211_registered_device *rdev, const u8 *bssid)
+{
+	return &rdev->bss_hash[jhash(bssid, ETH_ALEN, 0) &
+			       (CFG80211_BSS_HASH_SIZE - 1)];
+}
+
 static void bss_free(struct cfg80211_internal_bss *bss)
 {
 	struct cfg80211_bss_ies *ies;
@@ -135,7 +152,12 @@ static bool __cfg80211_unlink_bss(struct cfg80211_registered_device *rdev,
 	}
 
 	list_del_init(&bss->list);
+	list_del_init(&bss->hash_list);
 	rb_erase(&bss->rbn, &rdev->bss_tree);
+	rdev->bss_entries--;
+	WARN_ONCE((rdev->bss_entries == 0) ^ list_empty(&rdev->bss_list),
+		  "rdev bss entries[%d]/list[empty:%d] corruption\n",
+		  rdev->bss_entries, list_empty(&rdev->bss_list));
 	bss_ref_put(rdev, bss);
 	return true;
 }
@@ -162,6 +184,41 @@ static void __cfg80211_bss_expire(struct cfg80211_registered_device *rdev,
 		rdev->bss_generation++;
 }
 
+static bool cfg80211_bss_expire_oldest(struct cfg80211_registered_device *rdev)
+{
+	struct cfg80211_internal_bss *bss, *oldest = NULL;
+	bool ret;
+
+	lockdep_assert_held(&rdev->bss_lock);
+
+	list_for_each_entry(bss, &rdev->bss_list, list) {
+		if (atomic_read(&bss->hold))
+			continue;
+
+		/* beacon entries with probe responses can't be unlinked */
+		if (!list_empty(&bss->hidden_list) &&
+		    !bss->pub.hidden_beacon_bss)
+			continue;
+
+		if (oldest && time_before(oldest->ts, bss->ts))
+			continue;
+		oldest = bss;
+	}
+
+	if (WARN_ON(!oldest))
+		return false;
+
+	/*
+	 * The callers make sure to increase rdev->bss_generation if anything
+	 * gets removed (and a new entry added), so there's no need to also do
+	 * it here.
+	 */
+
+	ret = __cfg80211_unlink_bss(rdev, oldest);
+	WARN_ON(!ret);
+	return ret;
+}
+
 void ___cfg80211_scan_done(struct cfg80211_registered_device *rdev,
 			   bool send_message)
 {
@@ -576,6 +633,35 @@ static bool cfg80211_bss_type_match(u16 capability,
 	return ret;
 }
 
+static bool cfg80211_bss_match(struct cfg80211_internal_bss *bss,
+			       unsigned long now,
+			       struct ieee80211_channel *channel,
+			       const u8 *bssid,
+			       const u8 *ssid, size_t ssid_len,
+			       enum ieee80211_bss_type bss_type,
+			       enum ieee80211_privacy privacy)
+{
+	int bss_privacy;
+
+	if (!cfg80211_bss_type_match(bss->pub.capability,
+				     bss->pub.channel->band, bss_type))
+		return false;
+
+	bss_privacy = (bss->pub.capability & WLAN_CAPABILITY_PRIVACY);
+	if ((privacy == IEEE80211_PRIVACY_ON && !bss_privacy) ||
+	    (privacy == IEEE80211_PRIVACY_OFF && bss_privacy))
+		return false;
+	if (channel && bss->pub.channel != channel)
+		return false;
+	if (!is_valid_ether_addr(bss->pub.bssid))
+		return false;
+	/* Don't get expired BSS structs */
+	if (time_after(now, bss->ts + IEEE80211_SCAN_RESULT_EXPIRE) &&
+	    !atomic_read(&bss->hold))
+		return false;
+	return is_bss(&bss->pub, bssid, ssid, ssid_len);
+}
+
 /* Returned bss is reference counted and must be cleaned up appropriately. */
 struct cfg80211_bss *cfg80211_get_bss(struct wiphy *wiphy,
 				      struct ieee80211_channel *channel,
@@ -587,37 +673,36 @@ struct cfg80211_bss *cfg80211_get_bss(struct wiphy *wiphy,
 	struct cfg80211_registered_device *rdev = wiphy_to_rdev(wiphy);
 	struct cfg80211_internal_bss *bss, *res = NULL;
 	unsigned long now = jiffies;
-	int bss_privacy;
 
 	trace_cfg80211_get_bss(wiphy, channel, bssid, ssid, ssid_len, bss_type,
 			       privacy);
 
 	spin_lock_bh(&rdev->bss_lock);
 
-	list_for_each_entry(bss, &rdev->bss_list, list) {
-		if (!cfg80211_bss_type_match(bss->pub.capability,
-					     bss->pub.channel->band, bss_type))
-			continue;
-
-		bss_privacy = (bss->pub.capability & WLAN_CAPABILITY_PRIVACY);
-		if ((privacy == IEEE80211_PRIVACY_ON && !bss_privacy) ||
-		    (privacy == IEEE80211_PRIVACY_OFF && bss_privacy))
-			continue;
-		if (channel && bss->pub.channel != channel)
-			continue;
-		if (!is_valid_ether_addr(bss->pub.bssid))
-			continue;
-		/* Don't get expired BSS structs */
-		if (time_after(now, bss->ts + IEEE80211_SCAN_RESULT_EXPIRE) &&
-		    !atomic_read(&bss->hold))
-			continue;
-		if (is_bss(&bss->pub, bssid, ssid, ssid_len)) {
-			res = bss;
-			bss_ref_get(rdev, res);
-			break;
+	if (bssid) {
+		list_for_each_entry(bss, cfg80211_bss_hash(rdev, bssid),
+				    hash_list) {
+			if (cfg80211_bss_match(bss, now, channel, bssid,
+					       ssid, ssid_len, bss_type,
+					       privacy)) {
+				res = bss;
+				break;
+			}
+		}
+	} else {
+		list_for_each_entry(bss, &rdev->bss_list, list) {
+			if (cfg80211_bss_match(bss, now, channel, NULL,
+					       ssid, ssid_len, bss_type,
+					       privacy)) {
+				res = bss;
+				break;
+			}
 		}
 	}
 
+	if (res)
+		bss_ref_get(rdev, res);
+
 	spin_unlock_bh(&rdev->bss_lock);
 	if (!res)
 		return NULL;
@@ -679,6 +764,42 @@ rb_find_bss(struct cfg80211_registered_device *rdev,
 	return NULL;
 }
 
+static bool cfg80211_bss_is_mesh(struct cfg80211_bss *pub)
+{
+	const struct cfg80211_bss_ies *ies = rcu_access_pointer(pub->ies);
+
+	if (!WLAN_CAPABILITY_IS_STA_BSS(pub->capability))
+		return false;
+
+	return cfg80211_find_ie(WLAN_EID_MESH_ID, ies->data, ies->len) &&
+	       cfg80211_find_ie(WLAN_EID_MESH_CONFIG, ies->data, ies->len);
+}
+
+/*
+ * Find the entry that cmp_bss() considers equal to @res in regular mode.
+ * Mesh BSSes aren't compared by BSSID so they need the RB-tree, everything
+ * else can only match an entry with the same BSSID.
+ */
+static struct cfg80211_internal_bss *
+cfg80211_find_bss(struct cfg80211_registered_device *rdev,
+		  struct cfg80211_internal_bss *res)
+{
+	struct cfg80211_internal_bss *bss;
+
+	if (cfg80211_bss_is_mesh(&res->pub))
+		return rb_find_bss(rdev, res, BSS_CMP_REGULAR);
+
+	list_for_each_entry(bss, cfg80211_bss_hash(rdev, res->pub.bssid),
+			    hash_list) {
+		if (!ether_addr_equal(bss->pub.bssid, res->pub.bssid))
+			continue;
+		if (!cmp_bss(&res->pub, &bss->pub, BSS_CMP_REGULAR))
+			return bss;
+	}
+
+	return NULL;
+}
+
 static bool cfg80211_combine_bsses(struct cfg80211_registered_device *rdev,
 				   struct cfg80211_internal_bss *new)
 {
@@ -709,7 +830,8 @@ static bool cfg80211_combine_bsses(struct cfg80211_registered_device *rdev,
 
 	/* This is the bad part ... */
 
-	list_for_each_entry(bss, &rdev->bss_list, list) {
+	list_for_each_entry(bss, cfg80211_bss_hash(rdev, new->pub.bssid),
+			    hash_list) {
 		if (!ether_addr_equal(bss->pub.bssid, new->pub.bssid))
 			continue;
 		if (bss->pub.channel != new->pub.channel)
@@ -741,6 +863,91 @@ static bool cfg80211_combine_bsses(struct cfg80211_registered_device *rdev,
 	return true;
 }
 
+static void cfg80211_bss_refresh(struct cfg80211_internal_bss *found,
+				 struct cfg80211_internal_bss *tmp,
+				 bool signal_valid)
+{
+	found->pub.beacon_interval = tmp->pub.beacon_interval;
+	/*
+	 * don't update the signal if beacon was heard on
+	 * adjacent channel.
+	 */
+	if (signal_valid)
+		found->pub.signal = tmp->pub.signal;
+	found->pub.capability = tmp->pub.capability;
+	found->ts = tmp->ts;
+	found->ts_boottime = tmp->ts_boottime;
+}
+
+/*
+ * Fast path for frames carrying exactly the IEs already stored for their
+ * BSS, as most beacons do: refresh the entry without allocating a new copy
+ * of the IEs. Only the TSF differs, and it's updated in place under RCU
+ * readers. That's only done where a u64 store is a single access; on
+ * 32-bit a changed TSF takes the full update so a new IEs object with the
+ * new TSF is published instead and readers never see a torn value.
+ *
+ * Returns a referenced BSS, or %NULL if the full update must be done.
+ */
+static struct cfg80211_internal_bss *
+cfg80211_bss_update_unchanged(struct cfg80211_registered_device *rdev,
+			      struct cfg80211_internal_bss *tmp,
+			      enum cfg80211_bss_frame_type ftype,
+			      const u8 *ie, size_t ielen, u32 hash, u64 tsf,
+			      bool signal_valid)
+{
+	struct cfg80211_internal_bss *bss, *found = NULL;
+	struct cfg80211_bss_ies *ies;
+
+	tmp->ts = jiffies;
+
+	spin_lock_bh(&rdev->bss_lock);
+
+	list_for_each_entry(bss, cfg80211_bss_hash(rdev, tmp->pub.bssid),
+			    hash_list) {
+		if (bss->pub.channel != tmp->pub.channel ||
+		    !ether_addr_equal(bss->pub.bssid, tmp->pub.bssid))
+			continue;
+
+		if (ftype == CFG80211_BSS_FTYPE_PRESP) {
+			ies = rcu_dereference_protected(bss->pub.proberesp_ies,
+					lockdep_is_held(&rdev->bss_lock));
+		} else {
+			/* probe response members of a hidden SSID group */
+			if (bss->pub.hidden_beacon_bss)
+				continue;
+			ies = rcu_dereference_protected(bss->pub.beacon_ies,
+					lockdep_is_held(&rdev->bss_lock));
+		}
+
+		/* only if these IEs are also what the entry reports */
+		if (!ies || ies != rcu_access_pointer(bss->pub.ies))
+			continue;
+		if (ies->hash != hash || ies->len != ielen ||
+		    ies->from_beacon != (ftype == CFG80211_BSS_FTYPE_BEACON))
+			continue;
+		if (memcmp(ies->data, ie, ielen))
+			continue;
+
+		if (BITS_PER_LONG < 64 && ies->tsf != tsf)
+			break;
+
+		ACCESS_ONCE(ies->tsf) = tsf;
+		found = bss;
+		break;
+	}
+
+	if (found) {
+		cfg80211_bss_refresh(found, tmp, signal_valid);
+		rdev->bss_generation++;
+		bss_ref_get(rdev, found);
+	}
+
+	spin_unlock_bh(&rdev->bss_lock);
+
+	return found;
+}
+
 /* Returned bss is reference counted and must be cleaned up appropriately. */
 static struct cfg80211_internal_bss *
 cfg80211_bss_update(struct cfg80211_registered_device *rdev,
@@ -761,7 +968,7 @@ cfg80211_bss_update(struct cfg80211_registered_device *rdev,
 		return NULL;
 	}
 
-	found = rb_find_bss(rdev, tmp, BSS_CMP_REGULAR);
+	found = cfg80211_find_bss(rdev, tmp);
 
 	if (found) {
 		/* Update IEs */
@@ -829,16 +1036,7 @@ cfg80211_bss_update(struct cfg80211_registered_device *rdev,
 					  rcu_head);
 		}
 
-		found->pub.beacon_interval = tmp->pub.beacon_interval;
-		/*
-		 * don't update the signal if beacon was heard on
-		 * adjacent channel.
-		 */
-		if (signal_valid)
-			found->pub.signal = tmp->pub.signal;
-		found->pub.capability = tmp->pub.capability;
-		found->ts = tmp->ts;
-		found->ts_boottime = tmp->ts_boottime;
+		cfg80211_bss_refresh(found, tmp, signal_valid);
 	} else {
 		struct cfg80211_internal_bss *new;
 		struct cfg80211_internal_bss *hidden;
@@ -864,6 +1062,13 @@ cfg80211_bss_update(struct cfg80211_registered_device *rdev,
 		new->refcount = 1;
 		INIT_LIST_HEAD(&new->hidden_list);
 
+		/* make room before linking it to any hidden SSID group */
+		if (rdev->bss_entries >= bss_entries_limit &&
+		    !cfg80211_bss_expire_oldest(rdev)) {
+			bss_ref_put(rdev, new);
+			goto drop;
+		}
+
 		if (rcu_access_pointer(tmp->pub.proberesp_ies)) {
 			hidden = rb_find_bss(rdev, tmp, BSS_CMP_HIDE_ZLEN);
 			if (!hidden)
@@ -891,6 +1096,9 @@ cfg80211_bss_update(struct cfg80211_registered_device *rdev,
 		}
 
 		list_add_tail(&new->list, &rdev->bss_list);
+		list_add_tail(&new->hash_list,
+			      cfg80211_bss_hash(rdev, new->pub.bssid));
+		rdev->bss_entries++;
 		rb_insert_bss(rdev, new);
 		found = new;
 	}
@@ -946,11 +1154,13 @@ cfg80211_inform_bss_data(struct wiphy *wiphy,
 			 u16 beacon_interval, const u8 *ie, size_t ielen,
 			 gfp_t gfp)
 {
+	struct cfg80211_registered_device *rdev;
 	struct cfg80211_bss_ies *ies;
 	struct ieee80211_channel *channel;
 	struct cfg80211_internal_bss tmp = {}, *res;
 	int bss_type;
 	bool signal_valid;
+	u32 hash;
 
 	if (WARN_ON(!wiphy))
 		return NULL;
@@ -971,6 +1181,16 @@ cfg80211_inform_bss_data(struct wiphy *wiphy,
 	tmp.pub.capability = capability;
 	tmp.ts_boottime = data->boottime_ns;
 
+	signal_valid = abs(data->chan->center_freq - channel->center_freq) <=
+		wiphy->max_adj_channel_rssi_comp;
+	rdev = wiphy_to_rdev(wiphy);
+
+	hash = jhash(ie, ielen, 0);
+	res = cfg80211_bss_update_unchanged(rdev, &tmp, ftype, ie, ielen, hash,
+					    tsf, signal_valid);
+	if (res)
+		goto found;
+
 	/*
 	 * If we do not know here whether the IEs are from a Beacon or Probe
 	 * Response frame, we need to pick one of the options and only use it
@@ -983,6 +1203,7 @@ cfg80211_inform_bss_data(struct wiphy *wiphy,
 	if (!ies)
 		return NULL;
 	ies->len = ielen;
+	ies->hash = hash;
 	ies->tsf = tsf;
 	ies->from_beacon = false;
 	memcpy(ies->data, ie, ielen);
@@ -1000,12 +1221,11 @@ cfg80211_inform_bss_data(struct wiphy *wiphy,
 	}
 	rcu_assign_pointer(tmp.pub.ies, ies);
 
-	signal_valid = abs(data->chan->center_freq - channel->center_freq) <=
-		wiphy->max_adj_channel_rssi_comp;
-	res = cfg80211_bss_update(wiphy_to_rdev(wiphy), &tmp, signal_valid);
+	res = cfg80211_bss_update(rdev, &tmp, signal_valid);
 	if (!res)
 		return NULL;
 
+ found:
 	if (channel->band == IEEE80211_BAND_60GHZ) {
 		bss_type = res->pub.capability & WLAN_CAPABILITY_DMG_TYPE_MASK;
 		if (bss_type == WLAN_CAPABILITY_DMG_TYPE_AP ||
@@ -1030,12 +1250,16 @@ cfg80211_inform_bss_frame_data(struct wiphy *wiphy,
 			       gfp_t gfp)
 
 {
+	struct cfg80211_registered_device *rdev;
 	struct cfg80211_internal_bss tmp = {}, *res;
 	struct cfg80211_bss_ies *ies;
 	struct ieee80211_channel *channel;
+	enum cfg80211_bss_frame_type ftype;
 	bool signal_valid;
 	size_t ielen = len - offsetof(struct ieee80211_mgmt,
 				      u.probe_resp.variable);
+	u64 tsf;
+	u32 hash;
 	int bss_type;
 
 	BUILD_BUG_ON(offsetof(struct ieee80211_mgmt, u.probe_resp.variable) !=
@@ -1061,34 +1285,51 @@ cfg80211_inform_bss_frame_data(struct wiphy *wiphy,
 	if (!channel)
 		return NULL;
 
+	memcpy(tmp.pub.bssid, mgmt->bssid, ETH_ALEN);
+	tmp.pub.channel = channel;
+	tmp.pub.scan_width = data->scan_width;
+	tmp.pub.signal = data->signal;
+	tmp.pub.beacon_interval = le16_to_cpu(mgmt->u.probe_resp.beacon_int);
+	tmp.pub.capability = le16_to_cpu(mgmt->u.probe_resp.capab_info);
+	tmp.ts_boottime = data->boottime_ns;
+
+	signal_valid = abs(data->chan->center_freq - channel->center_freq) <=
+		wiphy->max_adj_channel_rssi_comp;
+	rdev = wiphy_to_rdev(wiphy);
+
+	if (ieee80211_is_probe_resp(mgmt->frame_control))
+		ftype = CFG80211_BSS_FTYPE_PRESP;
+	else
+		ftype = CFG80211_BSS_FTYPE_BEACON;
+	tsf = le64_to_cpu(mgmt->u.probe_resp.timestamp);
+
+	hash = jhash(mgmt->u.probe_resp.variable, ielen, 0);
+	res = cfg80211_bss_update_unchanged(rdev, &tmp, ftype,
+					    mgmt->u.probe_resp.variable, ielen,
+					    hash, tsf, signal_valid);
+	if (res)
+		goto found;
+
 	ies = kzalloc(sizeof(*ies) + ielen, gfp);
 	if (!ies)
 		return NULL;
 	ies->len = ielen;
-	ies->tsf = le64_to_cpu(mgmt->u.probe_resp.timestamp);
+	ies->hash = hash;
+	ies->tsf = tsf;
 	ies->from_beacon = ieee80211_is_beacon(mgmt->frame_control);
 	memcpy(ies->data, mgmt->u.probe_resp.variable, ielen);
 
-	if (ieee80211_is_probe_resp(mgmt->frame_control))
+	if (ftype == CFG80211_BSS_FTYPE_PRESP)
 		rcu_assign_pointer(tmp.pub.proberesp_ies, ies);
 	else
 		rcu_assign_pointer(tmp.pub.beacon_ies, ies);
 	rcu_assign_pointer(tmp.pub.ies, ies);
-	
-	memcpy(tmp.pub.bssid, mgmt->bssid, ETH_ALEN);
-	tmp.pub.channel = channel;
-	tmp.pub.scan_width = data->scan_width;
-	tmp.pub.signal = data->signal;
-	tmp.pub.beacon_interval = le16_to_cpu(mgmt->u.probe_resp.beacon_int);
-	tmp.pub.capability = le16_to_cpu(mgmt->u.probe_resp.capab_info);
-	tmp.ts_boottime = data->boottime_ns;
 
-	signal_valid = abs(data->chan->center_freq - channel->center_freq) <=
-		wiphy->max_adj_channel_rssi_comp;
-	res = cfg80211_bss_update(wiphy_to_rdev(wiphy), &tmp, signal_valid);
+	res = cfg80211_bss_update(rdev, &tmp, signal_valid);
 	if (!res)
 		return NULL;
 
+ found:
 	if (channel->band == IEEE80211_BAND_60GHZ) {
 		bss_type = res->pub.capability & WLAN_CAPABILITY_DMG_TYPE_MASK;
 		if (bss_type == WLAN_CAPABILITY_DMG_TYPE_AP ||
@@ -1593,7 +1834,8 @@ ieee80211_bss(struct wiphy *wiphy, struct iw_request_info *info,
 
 	memset(&iwe, 0, sizeof(iwe));
 	iwe.cmd = IWEVCUSTOM;
-	sprintf(buf, "tsf=%016llx", (unsigned long long)(ies->tsf));
+	sprintf(buf, "tsf=%016llx",
+		(unsigned long long)ACCESS_ONCE(ies->tsf));
 	iwe.u.data.length = strlen(buf);
 	current_ev = iwe_stream_add_point_check(info, current_ev, end_buf,
 						&iwe, buf);
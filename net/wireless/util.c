@@ -644,6 +644,47 @@ int ieee80211_data_from_8023(struct sk_buff *skb, const u8 *addr,
 }
 EXPORT_SYMBOL(ieee80211_data_from_8023);
 
+/*
+ * Number of payload bytes copied into the head of a subframe whose payload
+ * is otherwise referenced from the A-MSDU buffer; this keeps the LLC/SNAP
+ * header and the start of the network header in the linear area.
+ */
+#define AMSDU_SUBFRAME_COPY_LEN	32
+
+static struct sk_buff *
+__ieee80211_amsdu_copy(struct sk_buff *skb, unsigned int hlen, int len,
+		       bool reuse_frag)
+{
+	struct sk_buff *frame;
+	struct page *page;
+	int cur_len = len;
+
+	if (reuse_frag)
+		cur_len = min_t(int, len, AMSDU_SUBFRAME_COPY_LEN);
+
+	/*
+	 * Allocate and reserve two bytes more for payload
+	 * alignment since sizeof(struct ethhdr) is 14.
+	 */
+	frame = dev_alloc_skb(hlen + sizeof(struct ethhdr) + 2 + cur_len);
+	if (!frame)
+		return NULL;
+
+	skb_reserve(frame, hlen + sizeof(struct ethhdr) + 2);
+	memcpy(skb_put(frame, cur_len), skb->data, cur_len);
+
+	if (cur_len == len)
+		return frame;
+
+	/* attach the rest of the payload without copying it */
+	page = virt_to_head_page(skb->head);
+	get_page(page);
+	skb_add_rx_frag(frame, 0, page,
+			skb->data + cur_len - (u8 *)page_address(page),
+			len - cur_len, len - cur_len);
+
+	return frame;
+}
 
 void ieee80211_amsdu_to_8023s(struct sk_buff *skb, struct sk_buff_head *list,
 			      const u8 *addr, enum nl80211_iftype iftype,
@@ -656,6 +697,7 @@ void ieee80211_amsdu_to_8023s(struct sk_buff *skb, struct sk_buff_head *list,
 	const struct ethhdr *eth;
 	int remaining, err;
 	u8 dst[ETH_ALEN], src[ETH_ALEN];
+	bool reuse_frag;
 
 	if (has_80211_header) {
 		err = ieee80211_data_to_8023(skb, addr, iftype);
@@ -670,6 +712,12 @@ void ieee80211_amsdu_to_8023s(struct sk_buff *skb, struct sk_buff_head *list,
 		eth = (struct ethhdr *) skb->data;
 	}
 
+	/*
+	 * Subframes can point into the original buffer if its head is a page
+	 * fragment; otherwise each of them gets a private copy.
+	 */
+	reuse_frag = skb->head_frag && !skb_is_nonlinear(skb);
+
 	while (skb != frame) {
 		u8 padding;
 		__be16 len = eth->h_proto;
@@ -690,18 +738,12 @@ void ieee80211_amsdu_to_8023s(struct sk_buff *skb, struct sk_buff_head *list,
 			frame = skb;
 		else {
 			unsigned int hlen = ALIGN(extra_headroom, 4);
-			/*
-			 * Allocate and reserve two bytes more for payload
-			 * alignment since sizeof(struct ethhdr) is 14.
-			 */
-			frame = dev_alloc_skb(hlen + subframe_len + 2);
+
+			frame = __ieee80211_amsdu_copy(skb, hlen, ntohs(len),
+						       reuse_frag);
 			if (!frame)
 				goto purge;
 
-			skb_reserve(frame, hlen + sizeof(struct ethhdr) + 2);
-			memcpy(skb_put(frame, ntohs(len)), skb->data,
-				ntohs(len));
-
 			eth = (struct ethhdr *)skb_pull(skb, ntohs(len) +
 							padding);
 			if (!eth) {